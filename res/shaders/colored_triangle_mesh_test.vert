@@ -1,37 +1,40 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 #extension GL_EXT_buffer_reference : require
 
-
-layout (location = 0) out vec3 outColor;
-layout (location = 1) out vec2 outUV;
-
-struct Vertex {
-	vec3 position;
-	float uv_x;
-	vec3 normal;
-	float uv_y;
-	vec4 color;
-}; 
-
-layout(buffer_reference, std430) readonly buffer VertexBuffer{ 
-	Vertex vertices[];
-};
+#include "draw_data.glsl"
 
 //push constants block
 layout( push_constant ) uniform constants
-{	
-	mat4 render_matrix;
-	VertexBuffer vertexBuffer;
+{
+	DrawDataBuffer drawData;
 } PushConstants;
 
+
+// bit for bit the depth of the prepass
+invariant gl_Position;
+
+layout (location = 0) out vec3 outColor;
+layout (location = 1) out vec2 outUV;
+
+layout(set = 0, binding = 0) uniform SceneData {
+	mat4 view;
+	mat4 proj;
+	mat4 viewproj;
+	vec4 ambientColor;
+	vec4 sunlightDirection; //w for sun power
+	vec4 sunlightColor;
+} sceneData;
+
 void main() 
 {	
 	//load vertex data from device address
-	Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+	DrawData draw = PushConstants.drawData.draws[gl_InstanceIndex];
+	Vertex v = load_vertex(draw, uint(gl_VertexIndex));
 
 	//output data
 	//gl_Position = PushConstants.render_matrix * vec4(v.position * 0.5, 1.0);
-	gl_Position = PushConstants.render_matrix *vec4(v.position, 1.0f);
+	gl_Position = sceneData.viewproj * draw.worldMatrix * vec4(v.position, 1.0f);
 	outColor = v.color.xyz;
 	outUV.x = v.uv_x;
 	outUV.y = v.uv_y;
@@ -0,0 +1,14 @@
+#version 450
+
+//shader input
+layout (location = 0) in vec2 inUV;
+//output write
+layout (location = 0) out vec4 outFragColor;
+
+//the finished scene
+layout(set = 0, binding = 0) uniform sampler2D drawImage;
+
+void main() 
+{
+	outFragColor = vec4(texture(drawImage, inUV).rgb, 1.0f);
+}
@@ -0,0 +1,19 @@
+#version 450
+
+layout (location = 0) out vec2 outUV;
+
+//push constants block
+layout( push_constant ) uniform constants
+{	
+	// draw extent over draw image extent, the draw image is bigger than what was rendered into it
+	vec2 uvScale;
+} PushConstants;
+
+void main() 
+{
+	// one triangle covering the whole screen, no vertex buffer needed
+	vec2 uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+
+	gl_Position = vec4(uv * 2.0f - 1.0f, 0.0f, 1.0f);
+	outUV = uv * PushConstants.uvScale;
+}
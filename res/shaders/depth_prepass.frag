@@ -0,0 +1,6 @@
+#version 450
+
+// nothing is written, the prepass only fills the depth
+void main() 
+{
+}
@@ -0,0 +1,35 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+
+#include "draw_data.glsl"
+
+// only the scene set, the materials dont matter for depth
+layout(set = 0, binding = 0) uniform SceneData {
+	mat4 view;
+	mat4 proj;
+	mat4 viewproj;
+	vec4 ambientColor;
+	vec4 sunlightDirection;
+	vec4 sunlightColor;
+} sceneData;
+
+//push constants block
+layout( push_constant ) uniform constants
+{
+	DrawDataBuffer drawData;
+} PushConstants;
+
+// same math as mesh.vert, the color pass has to land on exactly this depth
+invariant gl_Position;
+
+void main() 
+{
+	// firstInstance of every draw is its index in the draw data
+	DrawData draw = PushConstants.drawData.draws[gl_InstanceIndex];
+
+	vec4 position = vec4(load_position(draw, uint(gl_VertexIndex)), 1.0f);
+
+	gl_Position =  sceneData.viewproj * draw.worldMatrix *position;
+}
@@ -0,0 +1,97 @@
+struct Vertex {
+	vec3 position;
+	float uv_x;
+	vec3 normal;
+	float uv_y;
+	vec4 color;
+}; 
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer{ 
+	Vertex vertices[];
+};
+
+// 16 bytes, position unorm16 xyz, octahedral normal snorm8 xy, half float uv, unorm8 color
+struct CompactVertex {
+	uint positionXY;
+	uint positionZNormal;
+	uint uv;
+	uint color;
+};
+
+layout(buffer_reference, std430) readonly buffer CompactVertexBuffer{ 
+	CompactVertex vertices[];
+};
+
+// positions alone for the depth only passes, float xyz for Vertex meshes
+layout(buffer_reference, std430) readonly buffer PositionBuffer{ 
+	float positions[];
+};
+
+// and the first two words of every CompactVertex for compact ones
+layout(buffer_reference, std430) readonly buffer CompactPositionBuffer{ 
+	uvec2 positions[];
+};
+
+// one entry per draw, written in draw order so the draw index is the instance index
+struct DrawData {
+	mat4 worldMatrix;
+	VertexBuffer vertexBuffer;
+	uint materialIndex;
+	// 0 for Vertex, 1 for CompactVertex
+	uint vertexFormat;
+	PositionBuffer positionBuffer;
+	// compact positions are offset + unorm * scale
+	vec4 positionOffset;
+	vec4 positionScale;
+};
+
+layout(buffer_reference, std430) readonly buffer DrawDataBuffer{ 
+	DrawData draws[];
+};
+
+vec3 decode_octahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	// the lower half is folded over the diagonals
+	float t = max(-n.z, 0.0);
+	n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+	return normalize(n);
+}
+
+// compact positions are offset + unorm * scale, written out the same way everywhere so the depth only passes
+// land on exactly the depth the full vertex gives
+vec3 decode_position(DrawData draw, uvec2 words)
+{
+	vec3 position = vec3(unpackUnorm2x16(words.x), unpackUnorm2x16(words.y).x);
+	return draw.positionOffset.xyz + position * draw.positionScale.xyz;
+}
+
+// only the position, from the position stream of the draw
+vec3 load_position(DrawData draw, uint index)
+{
+	if (draw.vertexFormat == 0) {
+		uint first = index * 3;
+		return vec3(draw.positionBuffer.positions[first], draw.positionBuffer.positions[first + 1], draw.positionBuffer.positions[first + 2]);
+	}
+
+	return decode_position(draw, CompactPositionBuffer(draw.positionBuffer).positions[index]);
+}
+
+// the vertex in whichever format the draw uses
+Vertex load_vertex(DrawData draw, uint index)
+{
+	if (draw.vertexFormat == 0) {
+		return draw.vertexBuffer.vertices[index];
+	}
+
+	CompactVertex c = CompactVertexBuffer(draw.vertexBuffer).vertices[index];
+
+	Vertex v;
+	v.position = decode_position(draw, uvec2(c.positionXY, c.positionZNormal));
+	v.normal = decode_octahedral(unpackSnorm4x8(c.positionZNormal).zw);
+	vec2 uv = unpackHalf2x16(c.uv);
+	v.uv_x = uv.x;
+	v.uv_y = uv.y;
+	v.color = unpackUnorm4x8(c.color);
+	return v;
+}
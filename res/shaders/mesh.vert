@@ -4,39 +4,32 @@
 #extension GL_EXT_buffer_reference : require
 
 #include "input_structures.glsl"
-
-layout (location = 0) out vec3 outNormal;
-layout (location = 1) out vec3 outColor;
-layout (location = 2) out vec2 outUV;
-
-struct Vertex {
-	vec3 position;
-	float uv_x;
-	vec3 normal;
-	float uv_y;
-	vec4 color;
-}; 
-
-layout(buffer_reference, std430) readonly buffer VertexBuffer{ 
-	Vertex vertices[];
-};
+#include "draw_data.glsl"
 
 //push constants block
 layout( push_constant ) uniform constants
 {
-	mat4 render_matrix;
-	VertexBuffer vertexBuffer;
+	DrawDataBuffer drawData;
 } PushConstants;
 
+// bit for bit the depth of the prepass, so the equal depths pass
+invariant gl_Position;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec2 outUV;
+
 void main() 
 {
-	Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+	// firstInstance of every draw is its index in the draw data
+	DrawData draw = PushConstants.drawData.draws[gl_InstanceIndex];
+	Vertex v = load_vertex(draw, uint(gl_VertexIndex));
 	
 	vec4 position = vec4(v.position, 1.0f);
 
-	gl_Position =  sceneData.viewproj * PushConstants.render_matrix *position;
+	gl_Position =  sceneData.viewproj * draw.worldMatrix *position;
 
-	outNormal = (PushConstants.render_matrix * vec4(v.normal, 0.f)).xyz;
+	outNormal = (draw.worldMatrix * vec4(v.normal, 0.f)).xyz;
 	outColor = v.color.xyz * materialData.colorFactors.xyz;	
 	outUV.x = v.uv_x;
 	outUV.y = v.uv_y;
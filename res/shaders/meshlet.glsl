@@ -0,0 +1,81 @@
+// shared by the task and mesh shaders, the layouts match the cull pass
+
+// object space sphere, the normal cone as (axis, cutoff) and the index range of one meshlet
+struct Meshlet {
+	vec4 sphere;
+	vec4 cone;
+	uint firstIndex;
+	uint indexCount;
+	uint vertexCount;
+	uint pad;
+};
+
+layout(buffer_reference, std430) readonly buffer MeshletBuffer{
+	Meshlet meshlets[];
+};
+
+struct CullData {
+	vec4 sphere;
+	uint indexCount;
+	uint firstIndex;
+	uint batch;
+	uint commandOffset;
+	MeshletBuffer meshlets;
+	uint meshletCount;
+	int vertexOffset;
+	uint meshTasks;
+	uint pad[3];
+};
+
+layout(buffer_reference, std430) readonly buffer CullDataBuffer{
+	CullData objects[];
+};
+
+// a task command is written as an indexed one, the group counts first and the draw index as vertexOffset
+struct DrawCommand {
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+layout(buffer_reference, std430) readonly buffer CommandBuffer{
+	DrawCommand commands[];
+};
+
+layout(buffer_reference, std430) readonly buffer CullParams{
+	mat4 viewproj;
+	mat4 occlusionViewProj;
+	vec2 pyramidSize;
+	uint pyramidLevels;
+	uint drawCount;
+	uint occlusion;
+	uint phaseStride;
+	uint commandStride;
+	uint pad;
+	vec4 cameraPosition;
+};
+
+// the index buffer of the mesh as words, 16 bit indices are two to a word
+layout(buffer_reference, std430) readonly buffer IndexBuffer{
+	uint indices[];
+};
+
+layout( push_constant ) uniform constants
+{
+	DrawDataBuffer drawData;
+	CullDataBuffer cullData;
+	CommandBuffer commands;
+	CullParams params;
+	IndexBuffer indexBuffer;
+	// first command of the batch in the command buffer
+	uint commandOffset;
+	uint shortIndices;
+} PushConstants;
+
+// the meshlets of the task workgroup that survived, each becomes one mesh workgroup
+struct MeshletPayload {
+	uint drawIndex;
+	uint meshlets[32];
+};
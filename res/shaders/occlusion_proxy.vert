@@ -0,0 +1,17 @@
+#version 450
+
+//push constants block
+layout( push_constant ) uniform constants
+{
+	// viewproj * world * the box of the object, maps the unit cube onto its bounds
+	mat4 boxMatrix;
+} PushConstants;
+
+void main() 
+{
+	// a cube as one 14 vertex strip, no vertex buffer needed
+	uint bit = 1u << gl_VertexIndex;
+	vec3 corner = vec3((0x287au & bit) != 0u, (0x02afu & bit) != 0u, (0x31e3u & bit) != 0u);
+
+	gl_Position = PushConstants.boxMatrix * vec4(corner * 2.0f - 1.0f, 1.0f);
+}
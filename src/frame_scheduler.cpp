@@ -0,0 +1,131 @@
+#include "frame_scheduler.h"
+#include "SDL3/SDL.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+
+float FrameScheduler::current_cap() const {
+	if (!focused && unfocusedFps > 0.f) {
+		return targetFps > 0.f ? std::min(targetFps, unfocusedFps) : unfocusedFps;
+	}
+	return targetFps;
+}
+
+void FrameScheduler::wait_for_next_frame() {
+
+	// nothing is drawn while minimized, sleep until the os tells us something happened
+	if (minimized) {
+		SDL_WaitEventTimeout(nullptr, -1);
+		stats.eventWakeups++;
+		// dont count the time spent minimized as a pacing hitch
+		lastFrameStart = Clock::time_point{};
+		deadline = Clock::time_point{};
+		return;
+	}
+
+	if (idle) {
+		if (SDL_WaitEventTimeout(nullptr, idleTimeoutMs)) {
+			stats.eventWakeups++;
+		}
+		lastFrameStart = Clock::time_point{};
+		deadline = Clock::time_point{};
+		return;
+	}
+
+	float cap = current_cap();
+	float jitterMs = 0.f;
+
+	if (cap > 0.f) {
+		auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / cap));
+
+		Clock::time_point now = Clock::now();
+		// after a long stall start counting from now instead of rendering a burst of frames to catch up
+		if (deadline == Clock::time_point{} || now - deadline > interval) {
+			deadline = now;
+		}
+		else {
+			if (!focused) {
+				// unfocused frames dont need precise timing, any event wakes us up and the frame starts early
+				if (wait_for_event(deadline)) {
+					stats.eventWakeups++;
+					deadline = Clock::now();
+				}
+			}
+			precise_wait(deadline);
+			jitterMs = std::chrono::duration<float, std::milli>(Clock::now() - deadline).count();
+		}
+
+		deadline += interval;
+	}
+	else {
+		deadline = Clock::time_point{};
+	}
+
+	record_frame(Clock::now(), jitterMs);
+}
+
+bool FrameScheduler::wait_for_event(Clock::time_point until) {
+	Clock::time_point now = Clock::now();
+	if (until <= now) {
+		return false;
+	}
+
+	// leave the tail for the spin so the wake up is still on time when no event shows up
+	auto sleepTime = until - now - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float, std::milli>(spinThresholdMs));
+	int32_t sleepMs = (int32_t)std::chrono::duration_cast<std::chrono::milliseconds>(sleepTime).count();
+	if (sleepMs <= 0) {
+		return false;
+	}
+
+	// a null event only peeks, the event stays queued for the main loop
+	return SDL_WaitEventTimeout(nullptr, sleepMs);
+}
+
+void FrameScheduler::precise_wait(Clock::time_point until) {
+	auto spinThreshold = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float, std::milli>(spinThresholdMs));
+
+	Clock::time_point now = Clock::now();
+	if (until - now > spinThreshold) {
+		auto sleepTime = until - now - spinThreshold;
+		SDL_DelayNS((Uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(sleepTime).count());
+	}
+
+	while (Clock::now() < until) {
+		std::this_thread::yield();
+	}
+}
+
+void FrameScheduler::record_frame(Clock::time_point frameStart, float jitterMs) {
+	if (lastFrameStart != Clock::time_point{}) {
+		float intervalMs = std::chrono::duration<float, std::milli>(frameStart - lastFrameStart).count();
+
+		jitterSamples[sampleIndex] = std::abs(jitterMs);
+		intervalSamples[sampleIndex] = intervalMs;
+		sampleIndex = (sampleIndex + 1) % sampleCount;
+		samplesFilled = std::min(samplesFilled + 1, sampleCount);
+
+		float jitterSum = 0.f;
+		float jitterMax = 0.f;
+		float intervalSum = 0.f;
+		for (size_t i = 0; i < samplesFilled; i++) {
+			jitterSum += jitterSamples[i];
+			jitterMax = std::max(jitterMax, jitterSamples[i]);
+			intervalSum += intervalSamples[i];
+		}
+
+		float intervalAverage = intervalSum / samplesFilled;
+		float variance = 0.f;
+		for (size_t i = 0; i < samplesFilled; i++) {
+			float d = intervalSamples[i] - intervalAverage;
+			variance += d * d;
+		}
+
+		stats.jitterAverageMs = jitterSum / samplesFilled;
+		stats.jitterMaxMs = jitterMax;
+		stats.intervalAverageMs = intervalAverage;
+		stats.intervalDeviationMs = std::sqrt(variance / samplesFilled);
+	}
+
+	lastFrameStart = frameStart;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <array>
+
+// paces the main loop, caps the frame rate with a sleep followed by a short spin and blocks on window events
+// instead of spinning when the window is minimized or unfocused
+class FrameScheduler {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// 0 leaves the frame rate uncapped (the present mode still limits it)
+	float targetFps = 0.f;
+	// cap used while the window doesnt have focus, 0 keeps the normal cap
+	float unfocusedFps = 15.f;
+	// the os sleep overshoots, so the last part of the wait is spun
+	float spinThresholdMs = 1.5f;
+
+	bool focused = true;
+	bool minimized = false;
+	// set when render on demand has nothing to draw, the loop then sleeps until an event shows up
+	bool idle = false;
+	// wake up now and then while idle so things like the text cursor still blink
+	int32_t idleTimeoutMs = 500;
+
+	// blocks until the next frame is due, returns early if a window event arrives while idle
+	void wait_for_next_frame();
+
+	struct Stats {
+		// how far the wake up landed from the deadline
+		float jitterAverageMs = 0.f;
+		float jitterMaxMs = 0.f;
+		// spread of the frame to frame interval, catches pacing problems even when uncapped
+		float intervalAverageMs = 0.f;
+		float intervalDeviationMs = 0.f;
+		uint64_t eventWakeups = 0;
+	} stats;
+
+private:
+	static constexpr size_t sampleCount = 120;
+
+	Clock::time_point lastFrameStart{};
+	Clock::time_point deadline{};
+
+	std::array<float, sampleCount> jitterSamples{};
+	std::array<float, sampleCount> intervalSamples{};
+	size_t sampleIndex = 0;
+	size_t samplesFilled = 0;
+
+	float current_cap() const;
+	bool wait_for_event(Clock::time_point until);
+	void precise_wait(Clock::time_point until);
+	void record_frame(Clock::time_point frameStart, float jitterMs);
+};
@@ -0,0 +1,94 @@
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const std::filesystem::path& path) {
+
+	close();
+
+#if defined(_WIN32)
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+
+	// the view keeps the file and the mapping alive, both handles can go right away
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (!mapping) {
+		return false;
+	}
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!view) {
+		return false;
+	}
+
+	mapped = (const uint8_t*)view;
+	mappedSize = (size_t)size.QuadPart;
+
+	WIN32_MEMORY_RANGE_ENTRY range{ view, mappedSize };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+
+	struct stat info {};
+	if (fstat(file, &info) != 0 || info.st_size == 0) {
+		::close(file);
+		return false;
+	}
+
+	void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (view == MAP_FAILED) {
+		return false;
+	}
+
+	mapped = (const uint8_t*)view;
+	mappedSize = (size_t)info.st_size;
+
+	madvise(view, mappedSize, MADV_SEQUENTIAL);
+	madvise(view, mappedSize, MADV_WILLNEED);
+#endif
+
+	return true;
+}
+
+void MappedFile::close() {
+
+	if (!mapped) {
+		return;
+	}
+
+#if defined(_WIN32)
+	UnmapViewOfFile(mapped);
+#else
+	munmap((void*)mapped, mappedSize);
+#endif
+
+	mapped = nullptr;
+	mappedSize = 0;
+}
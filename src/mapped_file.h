@@ -0,0 +1,25 @@
+#pragma once
+#include <filesystem>
+#include <cstdint>
+
+// a whole file mapped read only. the os reads pages in as they are touched, open also asks it to read the whole
+// file ahead in large chunks so the first pass over it doesnt fault page by page. data read from the mapping
+// comes straight out of the page cache, there is no buffer of our own in between
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// false if the file doesnt exist, is empty or cant be mapped
+	bool open(const std::filesystem::path& path);
+	void close();
+
+	const uint8_t* data() const { return mapped; }
+	size_t size() const { return mappedSize; }
+
+private:
+	const uint8_t* mapped = nullptr;
+	size_t mappedSize = 0;
+};
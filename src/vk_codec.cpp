@@ -0,0 +1,141 @@
+#include "vk_codec.h"
+#include <algorithm>
+
+
+static uint32_t zigzag(int32_t v) {
+	return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v) {
+	return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static void write_varint(std::vector<uint8_t>& bytes, uint32_t v) {
+	while (v >= 0x80) {
+		bytes.push_back((uint8_t)(v | 0x80));
+		v >>= 7;
+	}
+	bytes.push_back((uint8_t)v);
+}
+
+// at most 5 bytes like the gpu decoder and never past the end of the block, corrupt data decodes to garbage but
+// doesnt read anything it shouldnt
+static uint32_t read_varint(const uint8_t*& p, const uint8_t* end) {
+	uint32_t v = 0;
+	for (uint32_t shift = 0; shift < 35 && p < end; shift += 7) {
+		uint8_t byte = *p++;
+		v |= (uint32_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			break;
+		}
+	}
+	return v;
+}
+
+static void finish(meshcodec::Stream& stream) {
+	stream.blockOffsets.push_back((uint32_t)stream.bytes.size());
+	while (stream.bytes.size() % 4 != 0) {
+		stream.bytes.push_back(0);
+	}
+}
+
+template<typename T>
+static meshcodec::Stream encode_index_stream(const T* indices, uint32_t count) {
+
+	meshcodec::Stream stream;
+	stream.count = count;
+	stream.bytes.reserve(count + count / 4);
+
+	for (uint32_t first = 0; first < count; first += meshcodec::indexBlockSize) {
+		stream.blockOffsets.push_back((uint32_t)stream.bytes.size());
+
+		uint32_t last = std::min(first + meshcodec::indexBlockSize, count);
+		uint32_t previous = 0;
+		for (uint32_t i = first; i < last; i++) {
+			write_varint(stream.bytes, zigzag((int32_t)((uint32_t)indices[i] - previous)));
+			previous = indices[i];
+		}
+	}
+
+	finish(stream);
+	return stream;
+}
+
+bool meshcodec::is_consistent(StreamView stream, uint32_t blockSize) {
+
+	size_t blocks = ((size_t)stream.count + blockSize - 1) / blockSize;
+	if (stream.blockOffsets.size() != blocks + 1) {
+		return false;
+	}
+
+	for (size_t b = 0; b < blocks; b++) {
+		if (stream.blockOffsets[b] > stream.blockOffsets[b + 1]) {
+			return false;
+		}
+	}
+	return stream.blockOffsets[blocks] <= stream.bytes.size();
+}
+
+meshcodec::Stream meshcodec::encode_indices(const uint32_t* indices, uint32_t count) {
+	return encode_index_stream(indices, count);
+}
+
+meshcodec::Stream meshcodec::encode_indices(const uint16_t* indices, uint32_t count) {
+	return encode_index_stream(indices, count);
+}
+
+void meshcodec::decode_indices(StreamView stream, uint32_t* destination) {
+
+	for (uint32_t b = 0; b < stream.block_count(); b++) {
+		const uint8_t* p = stream.bytes.data() + stream.blockOffsets[b];
+		const uint8_t* end = stream.bytes.data() + stream.blockOffsets[b + 1];
+
+		uint32_t first = b * indexBlockSize;
+		uint32_t last = std::min(first + indexBlockSize, stream.count);
+		uint32_t previous = 0;
+		for (uint32_t i = first; i < last; i++) {
+			previous += (uint32_t)unzigzag(read_varint(p, end));
+			destination[i] = previous;
+		}
+	}
+}
+
+meshcodec::Stream meshcodec::encode_vertices(const uint16_t* vertices, uint32_t count, uint32_t channels) {
+
+	Stream stream;
+	stream.count = count;
+	stream.bytes.reserve(count * channels);
+
+	for (uint32_t first = 0; first < count; first += vertexBlockSize) {
+		stream.blockOffsets.push_back((uint32_t)stream.bytes.size());
+
+		uint32_t last = std::min(first + vertexBlockSize, count);
+		for (uint32_t v = first; v < last; v++) {
+			for (uint32_t c = 0; c < channels; c++) {
+				uint16_t previous = v > first ? vertices[(v - 1) * channels + c] : 0;
+				// the difference wraps around in 16 bits, so it never takes more than three bytes
+				write_varint(stream.bytes, zigzag((int16_t)(uint16_t)(vertices[v * channels + c] - previous)));
+			}
+		}
+	}
+
+	finish(stream);
+	return stream;
+}
+
+void meshcodec::decode_vertices(StreamView stream, uint32_t channels, uint16_t* destination) {
+
+	for (uint32_t b = 0; b < stream.block_count(); b++) {
+		const uint8_t* p = stream.bytes.data() + stream.blockOffsets[b];
+		const uint8_t* end = stream.bytes.data() + stream.blockOffsets[b + 1];
+
+		uint32_t first = b * vertexBlockSize;
+		uint32_t last = std::min(first + vertexBlockSize, stream.count);
+		for (uint32_t v = first; v < last; v++) {
+			for (uint32_t c = 0; c < channels; c++) {
+				uint16_t previous = v > first ? destination[(v - 1) * channels + c] : 0;
+				destination[v * channels + c] = (uint16_t)(previous + unzigzag(read_varint(p, end)));
+			}
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "vk_types.h"
+#include <span>
+
+// lossless index and vertex compression for the mesh cache and the uploads. every value is stored as the
+// zigzagged difference to the one before it in 7 bit groups, small differences take a single byte.
+// the streams are cut into blocks that restart the prediction, so each block decodes on its own and the
+// gpu decodes one block per invocation (mesh_decode.comp)
+namespace meshcodec {
+
+	inline constexpr uint32_t indexBlockSize = 256;
+	inline constexpr uint32_t vertexBlockSize = 64;
+
+	struct Stream {
+		// indices or vertices
+		uint32_t count = 0;
+		// byte offset of every block and the size of the data at the end
+		std::vector<uint32_t> blockOffsets;
+		// padded to a multiple of 4, the gpu reads whole words
+		std::vector<uint8_t> bytes;
+
+		uint32_t block_count() const { return blockOffsets.empty() ? 0 : (uint32_t)blockOffsets.size() - 1; }
+		size_t size_bytes() const { return blockOffsets.size() * sizeof(uint32_t) + bytes.size(); }
+	};
+
+	// the same without owning the data, of a Stream or of one read straight out of the mapped mesh cache
+	struct StreamView {
+		uint32_t count = 0;
+		std::span<const uint32_t> blockOffsets;
+		std::span<const uint8_t> bytes;
+
+		StreamView() = default;
+		StreamView(const Stream& stream) : count(stream.count), blockOffsets(stream.blockOffsets), bytes(stream.bytes) {}
+		StreamView(uint32_t count, std::span<const uint32_t> blockOffsets, std::span<const uint8_t> bytes) : count(count), blockOffsets(blockOffsets), bytes(bytes) {}
+
+		uint32_t block_count() const { return blockOffsets.empty() ? 0 : (uint32_t)blockOffsets.size() - 1; }
+		size_t size_bytes() const { return blockOffsets.size() * sizeof(uint32_t) + bytes.size(); }
+	};
+
+	// whether the block offsets match the count and stay inside the bytes, a stream read from a file is checked with
+	// this before it is decoded on either side
+	bool is_consistent(StreamView stream, uint32_t blockSize);
+
+	// every index is predicted by the one before it, after the fetch reordering new vertices come in increasing order
+	Stream encode_indices(const uint32_t* indices, uint32_t count);
+	Stream encode_indices(const uint16_t* indices, uint32_t count);
+	void decode_indices(StreamView stream, uint32_t* destination);
+
+	// vertices are taken as channels of 16 bits, every channel is predicted by the same one of the vertex before
+	Stream encode_vertices(const uint16_t* vertices, uint32_t count, uint32_t channels);
+	void decode_vertices(StreamView stream, uint32_t channels, uint16_t* destination);
+}
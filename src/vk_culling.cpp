@@ -0,0 +1,316 @@
+#include "vk_culling.h"
+#include <algorithm>
+#include <bit>
+#include <random>
+#include <immintrin.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+// msvc allows the intrinsics of any instruction set in any function, the cpu check decides if they run
+#define CULL_TARGET_AVX2
+#else
+#define CULL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+
+Frustum frustum_from_matrix(const glm::mat4& viewproj) {
+
+	// glm is column major, so row r of the matrix is (m[0][r], m[1][r], m[2][r], m[3][r])
+	glm::vec4 row0{ viewproj[0][0], viewproj[1][0], viewproj[2][0], viewproj[3][0] };
+	glm::vec4 row1{ viewproj[0][1], viewproj[1][1], viewproj[2][1], viewproj[3][1] };
+	glm::vec4 row2{ viewproj[0][2], viewproj[1][2], viewproj[2][2], viewproj[3][2] };
+	glm::vec4 row3{ viewproj[0][3], viewproj[1][3], viewproj[2][3], viewproj[3][3] };
+
+	// vulkan clip depth is 0..w, with reverse z near and far just trade places
+	Frustum frustum;
+	frustum.planes[0] = row3 + row0;
+	frustum.planes[1] = row3 - row0;
+	frustum.planes[2] = row3 + row1;
+	frustum.planes[3] = row3 - row1;
+	frustum.planes[4] = row2;
+	frustum.planes[5] = row3 - row2;
+
+	for (glm::vec4& plane : frustum.planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+void CullBounds::clear() {
+	centerX.clear();
+	centerY.clear();
+	centerZ.clear();
+	radius.clear();
+	extentX.clear();
+	extentY.clear();
+	extentZ.clear();
+}
+
+void CullBounds::reserve(size_t count) {
+	centerX.reserve(count);
+	centerY.reserve(count);
+	centerZ.reserve(count);
+	radius.reserve(count);
+	extentX.reserve(count);
+	extentY.reserve(count);
+	extentZ.reserve(count);
+}
+
+void CullBounds::push_back(const Bounds& bounds, const glm::mat4& transform) {
+
+	glm::vec3 center = transform * glm::vec4(bounds.origin, 1.f);
+
+	// every world axis picks up the absolute contribution of every local axis
+	glm::vec3 extent{ 0.f };
+	for (int axis = 0; axis < 3; axis++) {
+		extent += glm::abs(glm::vec3(transform[axis])) * bounds.extents[axis];
+	}
+
+	float scale = std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])) });
+
+	centerX.push_back(center.x);
+	centerY.push_back(center.y);
+	centerZ.push_back(center.z);
+	radius.push_back(bounds.sphereRadius * scale);
+	extentX.push_back(extent.x);
+	extentY.push_back(extent.y);
+	extentZ.push_back(extent.z);
+}
+
+// the sphere and the box are both conservative, so whichever reaches less far past the center decides
+static size_t cull_scalar(const CullBounds& bounds, const Frustum& frustum, size_t first, uint32_t* out) {
+
+	size_t written = 0;
+	for (size_t i = first; i < bounds.size(); i++) {
+		bool inside = true;
+		for (const glm::vec4& plane : frustum.planes) {
+			float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+			float reach = std::abs(plane.x) * bounds.extentX[i] + std::abs(plane.y) * bounds.extentY[i] + std::abs(plane.z) * bounds.extentZ[i];
+			reach = std::min(reach, bounds.radius[i]);
+
+			if (distance + reach < 0.f) {
+				inside = false;
+				break;
+			}
+		}
+
+		if (inside) {
+			out[written++] = (uint32_t)i;
+		}
+	}
+	return written;
+}
+
+// 4 objects per iteration, the planes are splatted once outside the loop
+static size_t cull_sse(const CullBounds& bounds, const Frustum& frustum, size_t& first, uint32_t* out) {
+
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+	for (int p = 0; p < 6; p++) {
+		const glm::vec4& plane = frustum.planes[p];
+		planeX[p] = _mm_set1_ps(plane.x);
+		planeY[p] = _mm_set1_ps(plane.y);
+		planeZ[p] = _mm_set1_ps(plane.z);
+		planeW[p] = _mm_set1_ps(plane.w);
+		absX[p] = _mm_set1_ps(std::abs(plane.x));
+		absY[p] = _mm_set1_ps(std::abs(plane.y));
+		absZ[p] = _mm_set1_ps(std::abs(plane.z));
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+
+	size_t written = 0;
+	size_t i = first;
+	for (; i + 4 <= bounds.size(); i += 4) {
+		__m128 cx = _mm_loadu_ps(&bounds.centerX[i]);
+		__m128 cy = _mm_loadu_ps(&bounds.centerY[i]);
+		__m128 cz = _mm_loadu_ps(&bounds.centerZ[i]);
+		__m128 r = _mm_loadu_ps(&bounds.radius[i]);
+		__m128 ex = _mm_loadu_ps(&bounds.extentX[i]);
+		__m128 ey = _mm_loadu_ps(&bounds.extentY[i]);
+		__m128 ez = _mm_loadu_ps(&bounds.extentZ[i]);
+
+		__m128 inside = _mm_cmpeq_ps(zero, zero);
+		for (int p = 0; p < 6; p++) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)), _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+			__m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)), _mm_mul_ps(absZ[p], ez));
+			reach = _mm_min_ps(reach, r);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), zero));
+		}
+
+		// compacted straight from the lane mask, lowest lane first so the indices stay sorted
+		uint32_t mask = (uint32_t)_mm_movemask_ps(inside);
+		while (mask) {
+			out[written++] = (uint32_t)(i + std::countr_zero(mask));
+			mask &= mask - 1;
+		}
+	}
+
+	first = i;
+	return written;
+}
+
+// same as the sse path with 8 objects per iteration
+CULL_TARGET_AVX2 static size_t cull_avx2(const CullBounds& bounds, const Frustum& frustum, size_t& first, uint32_t* out) {
+
+	__m256 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+	for (int p = 0; p < 6; p++) {
+		const glm::vec4& plane = frustum.planes[p];
+		planeX[p] = _mm256_set1_ps(plane.x);
+		planeY[p] = _mm256_set1_ps(plane.y);
+		planeZ[p] = _mm256_set1_ps(plane.z);
+		planeW[p] = _mm256_set1_ps(plane.w);
+		absX[p] = _mm256_set1_ps(std::abs(plane.x));
+		absY[p] = _mm256_set1_ps(std::abs(plane.y));
+		absZ[p] = _mm256_set1_ps(std::abs(plane.z));
+	}
+
+	const __m256 zero = _mm256_setzero_ps();
+
+	size_t written = 0;
+	size_t i = first;
+	for (; i + 8 <= bounds.size(); i += 8) {
+		__m256 cx = _mm256_loadu_ps(&bounds.centerX[i]);
+		__m256 cy = _mm256_loadu_ps(&bounds.centerY[i]);
+		__m256 cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+		__m256 r = _mm256_loadu_ps(&bounds.radius[i]);
+		__m256 ex = _mm256_loadu_ps(&bounds.extentX[i]);
+		__m256 ey = _mm256_loadu_ps(&bounds.extentY[i]);
+		__m256 ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+
+		__m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+		for (int p = 0; p < 6; p++) {
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], cx), _mm256_mul_ps(planeY[p], cy)), _mm256_add_ps(_mm256_mul_ps(planeZ[p], cz), planeW[p]));
+			__m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absX[p], ex), _mm256_mul_ps(absY[p], ey)), _mm256_mul_ps(absZ[p], ez));
+			reach = _mm256_min_ps(reach, r);
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero, _CMP_GE_OQ));
+		}
+
+		uint32_t mask = (uint32_t)_mm256_movemask_ps(inside);
+		while (mask) {
+			out[written++] = (uint32_t)(i + std::countr_zero(mask));
+			mask &= mask - 1;
+		}
+	}
+
+	first = i;
+	return written;
+}
+
+static bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+
+	// the os also has to save the ymm registers on a context switch
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+		return false;
+	}
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+culling::Path culling::best_path() {
+	static const Path path = cpu_has_avx2() ? Path::AVX2 : Path::SSE;
+	return path;
+}
+
+const char* culling::path_name(Path path) {
+	switch (path) {
+	case Path::AVX2: return "avx2";
+	case Path::SSE: return "sse";
+	default: return "scalar";
+	}
+}
+
+void culling::cull(const CullBounds& bounds, const Frustum& frustum, std::vector<uint32_t>& visible, Path path) {
+
+	// sized for the worst case and trimmed after, the wide paths write without any capacity checks
+	size_t start = visible.size();
+	visible.resize(start + bounds.size());
+	uint32_t* out = visible.data() + start;
+
+	size_t written = 0;
+	size_t first = 0;
+
+	if (path == Path::AVX2) {
+		written += cull_avx2(bounds, frustum, first, out);
+	}
+	if (path == Path::AVX2 || path == Path::SSE) {
+		written += cull_sse(bounds, frustum, first, out + written);
+	}
+	// whatever did not fill a whole register
+	written += cull_scalar(bounds, frustum, first, out + written);
+
+	visible.resize(start + written);
+}
+
+std::vector<culling::BenchmarkResult> culling::benchmark(size_t objectCount, int iterations) {
+
+	// fixed seed so runs compare
+	std::mt19937 rng(1337);
+	std::uniform_real_distribution<float> position(-200.f, 200.f);
+	std::uniform_real_distribution<float> size(0.2f, 4.f);
+
+	CullBounds bounds;
+	bounds.reserve(objectCount);
+	for (size_t i = 0; i < objectCount; i++) {
+		Bounds object;
+		object.origin = glm::vec3{ 0.f };
+		object.extents = glm::vec3{ size(rng), size(rng), size(rng) };
+		object.sphereRadius = glm::length(object.extents);
+
+		glm::mat4 transform = glm::translate(glm::mat4{ 1.f }, glm::vec3{ position(rng), position(rng), position(rng) });
+		bounds.push_back(object, transform);
+	}
+
+	// reverse z like the renderer
+	glm::mat4 view = glm::lookAt(glm::vec3{ 0.f, 0.f, 0.f }, glm::vec3{ 0.f, 0.f, -1.f }, glm::vec3{ 0.f, 1.f, 0.f });
+	glm::mat4 proj = glm::perspective(glm::radians(70.f), 16.f / 9.f, 1000.f, 0.1f);
+	Frustum frustum = frustum_from_matrix(proj * view);
+
+	std::vector<Path> paths = { Path::Scalar, Path::SSE };
+	if (best_path() == Path::AVX2) {
+		paths.push_back(Path::AVX2);
+	}
+
+	std::vector<BenchmarkResult> results;
+	std::vector<uint32_t> visible;
+	visible.reserve(objectCount);
+
+	for (Path path : paths) {
+		// best of the runs, the slower ones are mostly the os getting in the way
+		double bestMicroseconds = 0.0;
+		for (int run = 0; run < std::max(iterations, 1); run++) {
+			visible.clear();
+
+			auto start = std::chrono::high_resolution_clock::now();
+			cull(bounds, frustum, visible, path);
+			auto end = std::chrono::high_resolution_clock::now();
+
+			double microseconds = std::chrono::duration<double, std::micro>(end - start).count();
+			if (run == 0 || microseconds < bestMicroseconds) {
+				bestMicroseconds = microseconds;
+			}
+		}
+
+		BenchmarkResult result;
+		result.path = path;
+		result.objects = objectCount;
+		result.visible = visible.size();
+		result.objectsPerMicrosecond = bestMicroseconds > 0.0 ? objectCount / bestMicroseconds : 0.0;
+		results.push_back(result);
+	}
+
+	return results;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "vk_types.h"
+
+// the six planes as (normal, distance), normalized so the sphere test can compare against the radius directly,
+// a point is inside a plane when dot(normal, p) + distance >= 0
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+Frustum frustum_from_matrix(const glm::mat4& viewproj);
+
+// world space bounds of every object, one array per component so a whole group of objects loads with a
+// single instruction per component. index i is the same object in every array
+struct CullBounds {
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+	std::vector<float> extentX;
+	std::vector<float> extentY;
+	std::vector<float> extentZ;
+
+	size_t size() const { return centerX.size(); }
+	void clear();
+	void reserve(size_t count);
+	// transforms the object space bounds, the box stays axis aligned and grows to cover the rotation
+	void push_back(const Bounds& bounds, const glm::mat4& transform);
+};
+
+namespace culling {
+
+	enum class Path {
+		Scalar,
+		SSE,
+		AVX2
+	};
+
+	// widest path the cpu and os support, checked once
+	Path best_path();
+	const char* path_name(Path path);
+
+	// appends the indices of every object whose sphere and box are both not fully outside a plane,
+	// indices come out in increasing order
+	void cull(const CullBounds& bounds, const Frustum& frustum, std::vector<uint32_t>& visible, Path path);
+
+	struct BenchmarkResult {
+		Path path;
+		size_t objects;
+		size_t visible;
+		double objectsPerMicrosecond;
+	};
+
+	// culls a random field of objects with every supported path, half of them roughly in view
+	std::vector<BenchmarkResult> benchmark(size_t objectCount, int iterations);
+}
@@ -214,6 +214,21 @@ void DescriptorAllocatorGrowable::defer_pool_main_deletion() {
 
 }
 
+void DescriptorAllocatorGrowable::defer_pool_deletion(DeletionQueue& queue) {
+	std::vector<VkDescriptorPool> pools = std::move(readyPools);
+	pools.insert(pools.end(), fullPools.begin(), fullPools.end());
+	readyPools.clear();
+	fullPools.clear();
+
+	if (!pools.empty()) {
+		queue.push_deletion_lambda([device = VulkanEngine::Get().device, pools]() {
+			for (VkDescriptorPool p : pools) {
+				vkDestroyDescriptorPool(device, p, nullptr);
+			}
+		});
+	}
+}
+
 void DescriptorAllocatorGrowable::destroy_pools() {
 	for (auto p : readyPools) {
 		//printf("[ACTIVE FRAME READY POOL DELETED] VkDescriptorPool: %p\n", (void*)p);
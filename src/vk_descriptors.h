@@ -2,6 +2,7 @@
 
 #include <vk_types.h>
 
+struct DeletionQueue;
 
 
 struct DescriptorLayoutBuilder {
@@ -43,6 +44,8 @@ public:
 	void init(VkDevice device, uint32_t initialSets, std::span<PoolSizeRatio> poolRatios);
 	void clear_pools(VkDevice device);
 	void defer_pool_main_deletion();
+	// hands the pools to a queue that destroys them later, the allocator starts over empty
+	void defer_pool_deletion(DeletionQueue& queue);
 
 	void destroy_pools();
 	VkDescriptorSet allocate(VkDevice device, VkDescriptorSetLayout layout, void* pNext = nullptr);
@@ -0,0 +1,96 @@
+#include "vk_drawlist.h"
+#include <cstring>
+#include <algorithm>
+
+
+// positive floats compare the same way as their bits do, so the depth can go into the key as is
+static uint32_t depth_bits(float depth) {
+	depth = std::max(depth, 0.f);
+	uint32_t bits;
+	std::memcpy(&bits, &depth, sizeof(bits));
+	return bits;
+}
+
+void DrawList::sort(const glm::mat4& view) {
+
+	order.resize(objects.size());
+	materialIds.clear();
+
+	for (uint32_t i = 0; i < objects.size(); i++) {
+		const RenderObject& object = objects[i];
+
+		// ids in order of first use, there are never more than a handful so 16 bits is plenty
+		auto [it, inserted] = materialIds.try_emplace(object.material, (uint32_t)materialIds.size());
+		uint64_t material = it->second & 0xFFFF;
+		uint64_t pipeline = object.material->pipeline->pipelineID & 0x3FFF;
+		uint64_t pass = object.material->passType == MaterialPass::Transparent ? 1 : 0;
+
+		// view space distance of the bounds center, the camera looks down -z
+		glm::vec4 center = view * object.transform * glm::vec4(object.bounds.origin, 1.f);
+		uint64_t depth = depth_bits(-center.z);
+
+		SortEntry& entry = order[i];
+		entry.object = i;
+		entry.state = (uint32_t)((pass << 30) | (pipeline << 16) | material);
+
+		if (pass == 0) {
+			entry.key = (pass << 62) | (pipeline << 48) | (material << 32) | depth;
+		}
+		else {
+			entry.key = (pass << 62) | ((~depth & 0xFFFFFFFF) << 30) | (pipeline << 16) | material;
+		}
+	}
+
+	drawsort::radix_sort(order, scratch);
+}
+
+void drawsort::radix_sort(std::vector<DrawList::SortEntry>& entries, std::vector<DrawList::SortEntry>& scratch) {
+
+	constexpr uint32_t digits = 8;
+	constexpr uint32_t buckets = 256;
+
+	size_t count = entries.size();
+	if (count < 2) {
+		return;
+	}
+	scratch.resize(count);
+
+	// every histogram in one read over the keys
+	uint32_t histograms[digits][buckets] = {};
+	for (const DrawList::SortEntry& entry : entries) {
+		for (uint32_t d = 0; d < digits; d++) {
+			histograms[d][(entry.key >> (d * 8)) & 0xFF]++;
+		}
+	}
+
+	DrawList::SortEntry* src = entries.data();
+	DrawList::SortEntry* dst = scratch.data();
+
+	for (uint32_t d = 0; d < digits; d++) {
+		uint32_t* histogram = histograms[d];
+
+		// all keys share this digit, the pass wouldnt move anything
+		if (histogram[(src[0].key >> (d * 8)) & 0xFF] == count) {
+			continue;
+		}
+
+		uint32_t offsets[buckets];
+		uint32_t sum = 0;
+		for (uint32_t b = 0; b < buckets; b++) {
+			offsets[b] = sum;
+			sum += histogram[b];
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			uint32_t bucket = (src[i].key >> (d * 8)) & 0xFF;
+			dst[offsets[bucket]++] = src[i];
+		}
+
+		std::swap(src, dst);
+	}
+
+	// an odd number of passes leaves the result in the scratch buffer
+	if (src != entries.data()) {
+		entries.swap(scratch);
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "vk_types.h"
+
+struct MeshAsset;
+
+// one draw, plain data so the whole list can be rebuilt and sorted every frame
+struct RenderObject {
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	VkBuffer indexBuffer;
+	VkIndexType indexType;
+	// the mesh shaders read the meshlet indices through this
+	VkDeviceAddress indexBufferAddress;
+
+	MaterialInstance* material;
+
+	glm::mat4 transform;
+	Bounds bounds;
+	VkDeviceAddress vertexBufferAddress;
+	// first GPUMeshlet of the surface
+	VkDeviceAddress meshlets;
+	uint32_t meshletCount;
+
+	const MeshAsset* mesh;
+};
+
+// draw order is decided by a 64 bit key per object
+// opaque:      | pass 2 | pipeline 14 | material 16 | depth 32 |     state first, front to back inside a state
+// transparent: | pass 2 | ~depth 32 | pipeline 14 | material 16 |   back to front, state only breaks ties
+struct DrawList {
+
+	struct SortEntry {
+		uint64_t key;
+		uint32_t object;
+		// pass, pipeline and material without the depth, binds only change when this does
+		uint32_t state;
+	};
+
+	std::vector<RenderObject> objects;
+	// filled by sort, the order the objects get drawn in
+	std::vector<SortEntry> order;
+
+	void clear() { objects.clear(); order.clear(); }
+
+	// view is the camera matrix the depth is measured in
+	void sort(const glm::mat4& view);
+
+private:
+	std::vector<SortEntry> scratch;
+	std::unordered_map<const MaterialInstance*, uint32_t> materialIds;
+};
+
+// the low 16 bits of the state are the material id of the draw
+inline uint32_t material_index(const DrawList::SortEntry& entry) { return entry.state & 0xFFFF; }
+
+namespace drawsort {
+	// LSD radix sort on the full key, 8 bits per pass, passes where every key has the same digit are skipped
+	void radix_sort(std::vector<DrawList::SortEntry>& entries, std::vector<DrawList::SortEntry>& scratch);
+}
@@ -53,9 +53,15 @@ void VulkanEngine::run() {
 	fmt::print("GROTESK RUNNING\n");
 	// main loop
 	while (!quit) {
+		// sleeps off the frame cap, blocks on events while minimized
+		scheduler.minimized = stop_rendering;
+		scheduler.idle = renderer->is_idle();
+		scheduler.wait_for_next_frame();
+
 		// Handle events on queue
 		while (SDL_PollEvent(&event) != 0) {
 			ImGui_ImplSDL3_ProcessEvent(&event);
+			renderer->mark_ui_active();
 			// close the window when user alt-f4s or clicks the X button
 			switch (event.type) {
 			case SDL_EVENT_QUIT:
@@ -67,6 +73,19 @@ void VulkanEngine::run() {
 			case SDL_EVENT_WINDOW_RESTORED:
 				stop_rendering = false;
 				break;
+			case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
+				// a window shrunk to nothing without being minimized only comes back through a resize
+				if (event.window.data1 > 0 && event.window.data2 > 0) {
+					stop_rendering = false;
+					resize_requested = true;
+				}
+				break;
+			case SDL_EVENT_WINDOW_FOCUS_GAINED:
+				scheduler.focused = true;
+				break;
+			case SDL_EVENT_WINDOW_FOCUS_LOST:
+				scheduler.focused = false;
+				break;
 				// KEYBOARD EVENTS WHEN PRESSED
 			case SDL_EVENT_KEY_DOWN:
 				switch (event.key.key) {
@@ -83,30 +102,36 @@ void VulkanEngine::run() {
 			default:
 				break;
 			}
+
+			switch (event.type) {
+			case SDL_EVENT_KEY_DOWN:
+			case SDL_EVENT_KEY_UP:
+			case SDL_EVENT_TEXT_INPUT:
+			case SDL_EVENT_MOUSE_MOTION:
+			case SDL_EVENT_MOUSE_BUTTON_DOWN:
+			case SDL_EVENT_MOUSE_BUTTON_UP:
+			case SDL_EVENT_MOUSE_WHEEL:
+				latency.record_input(event.common.timestamp);
+				break;
+			default:
+				break;
+			}
 		}
 
-		// do not draw if we are minimized
+		// do not draw if we are minimized, the scheduler waits for the restore event
 		if (stop_rendering) {
-			// throttle the speed to avoid the endless spinning
-			std::this_thread::sleep_for(std::chrono::milliseconds(100));
 			continue;
 		}
+		// has to happen outside of an imgui frame since the imgui backend is recreated
+		if (renderer->requestedRenderMode != renderer->renderMode) {
+			renderer->set_render_mode(renderer->requestedRenderMode);
+		}
+
 		ImGui_ImplVulkan_NewFrame();
 		ImGui_ImplSDL3_NewFrame();
 		ImGui::NewFrame();
 
-		if (ImGui::Begin("background")) {
-			ComputeEffect& selected = renderer->backgroundEffects[renderer->currentBackgroundEffect];
-			ImGui::Text("Selected effect: ", selected.name);
-
-			ImGui::SliderInt("Effect Index", &renderer->currentBackgroundEffect, 0, renderer->backgroundEffects.size() - 1);
-
-			ImGui::InputFloat4("data1", (float*)&selected.data.data1);
-			ImGui::InputFloat4("data2", (float*)&selected.data.data2);
-			ImGui::InputFloat4("data3", (float*)&selected.data.data3);
-			ImGui::InputFloat4("data4", (float*)&selected.data.data4);
-		}
-		ImGui::End();
+		build_ui();
 
 		ImGui::Render();
 
@@ -116,22 +141,17 @@ void VulkanEngine::run() {
 		//add borderless fullscreen, and fullscreen, make sure the new pools and sets are allocated correctly
 		if (resize_requested == true) {
 
-			vkDeviceWaitIdle(device);
-			mainDeletionQueue.resizeFlush(device, vmaAllocator);
-
-			destroy_swapchain();
-
 			int w, h;
 			SDL_GetWindowSize(window, &w, &h);
-			if (w == 0 || h == 0) return;
-			windowExtent.width = w;
-			windowExtent.height = h;
-
-			init_swapchain_resources();
+			if (w == 0 || h == 0) {
+				// no surface to present to, wait for the window to come back like when minimized
+				stop_rendering = true;
+				continue;
+			}
 
-			renderer->init_framebuffers();
+			resize_swapchain((uint32_t)w, (uint32_t)h);
 
-			renderer->init_descriptors();
+			renderer->mark_dirty(DIRTY_RESIZE);
 
 			resize_requested = false;
 		}
@@ -142,6 +162,7 @@ void VulkanEngine::run() {
 			vkDeviceWaitIdle(device);
 
 			renderer->HotloadShader();
+			renderer->mark_dirty(DIRTY_PIPELINES);
 
 			hotload_requested = false;
 			fmt::print("hotload finished: {}\n", hotload_requested);
@@ -153,6 +174,172 @@ void VulkanEngine::run() {
 	}
 }
 
+void VulkanEngine::build_ui() {
+
+	if (ImGui::Begin("background")) {
+		ComputeEffect& selected = renderer->backgroundEffects[renderer->currentBackgroundEffect];
+		ImGui::Text("Selected effect: ", selected.name);
+
+		bool changed = false;
+		changed |= ImGui::SliderInt("Effect Index", &renderer->currentBackgroundEffect, 0, renderer->backgroundEffects.size() - 1);
+
+		changed |= ImGui::InputFloat4("data1", (float*)&selected.data.data1);
+		changed |= ImGui::InputFloat4("data2", (float*)&selected.data.data2);
+		changed |= ImGui::InputFloat4("data3", (float*)&selected.data.data3);
+		changed |= ImGui::InputFloat4("data4", (float*)&selected.data.data4);
+
+		if (changed) {
+			renderer->mark_dirty(DIRTY_BACKGROUND);
+		}
+	}
+	ImGui::End();
+
+	if (ImGui::Begin("frame pacing")) {
+		ImGui::Text("Active present mode: %s", string_VkPresentModeKHR(activePresentMode));
+
+		if (ImGui::BeginCombo("Present mode", string_VkPresentModeKHR(presentMode))) {
+			for (VkPresentModeKHR mode : supportedPresentModes) {
+				bool selected = mode == presentMode;
+				if (ImGui::Selectable(string_VkPresentModeKHR(mode), selected) && !selected) {
+					presentMode = mode;
+					// the present mode is baked into the swapchain so it has to be rebuilt
+					resize_requested = true;
+					latency.reset();
+				}
+			}
+			ImGui::EndCombo();
+		}
+
+		if (ImGui::Checkbox("Low latency mode", &lowLatencyMode)) {
+			set_frames_in_flight(lowLatencyMode ? 1 : FRAME_OVERLAP);
+			latency.reset();
+		}
+
+		int inFlight = (int)framesInFlight;
+		if (ImGui::SliderInt("Frames in flight", &inFlight, 1, FRAME_OVERLAP)) {
+			set_frames_in_flight((uint32_t)inFlight);
+			latency.reset();
+		}
+
+		int renderMode = (int)renderer->requestedRenderMode;
+		const char* renderModes[] = { "Classic render passes", "Dynamic rendering" };
+		if (ImGui::Combo("Render path", &renderMode, renderModes, IM_ARRAYSIZE(renderModes))) {
+			renderer->requestedRenderMode = (RenderMode)renderMode;
+		}
+
+		if (ImGui::Checkbox("Render on demand", &renderer->renderOnDemand)) {
+			renderer->mark_dirty(DIRTY_ALL);
+		}
+		if (ImGui::Checkbox("GPU culled indirect draws", &renderer->gpuDrivenDraws)) {
+			// the cull data is only written while the mode is on
+			renderer->mark_dirty(DIRTY_SCENE);
+		}
+		// only the indirect draws read everything that changes per frame from buffers
+		ImGui::BeginDisabled(!renderer->gpuDrivenDraws);
+		ImGui::Checkbox("Cache geometry commands", &renderer->cacheGeometryCommands);
+		ImGui::EndDisabled();
+		if (ImGui::Checkbox("Occlusion culling (hi-z)", &renderer->occlusionCulling)) {
+			renderer->mark_dirty(DIRTY_SCENE);
+		}
+		if (ImGui::Checkbox("Meshlet culling", &renderer->meshletCulling)) {
+			// the batches are sized for a command per meshlet, the worst case when every other one is culled
+			renderer->mark_dirty(DIRTY_SCENE);
+		}
+		ImGui::BeginDisabled(!meshShaderSupported || !renderer->gpuDrivenDraws || !renderer->meshletCulling);
+		if (ImGui::Checkbox("Mesh shaders (task + mesh)", &renderer->meshShading)) {
+			renderer->mark_dirty(DIRTY_SCENE);
+		}
+		ImGui::EndDisabled();
+		if (ImGui::Checkbox("Depth prepass", &renderer->depthPrepass)) {
+			renderer->mark_dirty(DIRTY_SCENE);
+		}
+		if (ImGui::Checkbox("Mesh LODs", &renderer->meshLods)) {
+			renderer->mark_dirty(DIRTY_SCENE);
+		}
+		if (ImGui::SliderFloat("LOD pixel error", &renderer->lodPixelError, 0.25f, 16.f, "%.2f px", ImGuiSliderFlags_Logarithmic)) {
+			renderer->mark_dirty(DIRTY_SCENE);
+		}
+		if (ImGui::SliderFloat("LOD bias", &renderer->lodBias, -4.f, 4.f)) {
+			renderer->mark_dirty(DIRTY_SCENE);
+		}
+		if (ImGui::Checkbox("CPU frustum culling", &renderer->cpuCulling)) {
+			renderer->mark_dirty(DIRTY_SCENE);
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Benchmark culling")) {
+			renderer->cullBenchmark = culling::benchmark(100000, 50);
+		}
+		if (ImGui::SliderInt("Object grid", &renderer->objectGridSize, 1, 64)) {
+			renderer->mark_dirty(DIRTY_SCENE);
+		}
+
+		ImGui::Separator();
+		ImGui::SliderFloat("Frame cap", &scheduler.targetFps, 0.f, 360.f, scheduler.targetFps > 0.f ? "%.0f fps" : "uncapped");
+		ImGui::SliderFloat("Unfocused cap", &scheduler.unfocusedFps, 0.f, 60.f, scheduler.unfocusedFps > 0.f ? "%.0f fps" : "same as focused");
+		ImGui::SliderFloat("Spin threshold", &scheduler.spinThresholdMs, 0.f, 4.f, "%.2f ms");
+
+		ImGui::Separator();
+		ImGui::Text("Frame time: %.2f ms", 1000.f / ImGui::GetIO().Framerate);
+		ImGui::Text("Frame interval: %.2f ms (deviation %.2f ms)", scheduler.stats.intervalAverageMs, scheduler.stats.intervalDeviationMs);
+		ImGui::Text("Wake up jitter: avg %.3f ms, max %.3f ms", scheduler.stats.jitterAverageMs, scheduler.stats.jitterMaxMs);
+		ImGui::Text("Event wakeups: %llu", (unsigned long long)scheduler.stats.eventWakeups);
+		ImGui::Text("Scene redraws: %llu, skipped: %llu", (unsigned long long)renderer->sceneRedraws, (unsigned long long)renderer->sceneSkips);
+		ImGui::Text("Geometry commands: %llu recorded, %llu reused", (unsigned long long)renderer->geometryRecords, (unsigned long long)renderer->geometryReuses);
+		ImGui::Text("Draw list: %zu objects, %zu indirect batches", renderer->get_draw_count(), renderer->get_indirect_batch_count());
+		ImGui::Text("Indirect commands: %u max", renderer->get_indirect_command_count());
+		ImGui::Text("Triangles: %llu of %llu at full detail", (unsigned long long)renderer->get_lod_triangles(), (unsigned long long)renderer->get_full_triangles());
+		ImGui::Text("Depth pyramid: %ux%u, %u levels", renderer->get_depth_pyramid_extent().width, renderer->get_depth_pyramid_extent().height, renderer->get_depth_pyramid_levels());
+		ImGui::Text("CPU culling (%s): %zu draws visible", culling::path_name(renderer->cullPath), renderer->get_visible_draw_count());
+		for (const culling::BenchmarkResult& result : renderer->cullBenchmark) {
+			ImGui::Text("  %s: %.1f objects/us, %zu of %zu visible", culling::path_name(result.path), result.objectsPerMicrosecond, result.visible, result.objects);
+		}
+		ImGui::Text("State filter: %u commands, %u redundant dropped", renderer->lastRecordStats.recorded, renderer->lastRecordStats.elided);
+
+		const RenderGraph::Stats& graphStats = renderer->renderGraph.get_stats();
+		ImGui::Text("Render graph: %u passes, %u barriers in %u batches", graphStats.passes, graphStats.barriers, graphStats.barrierBatches);
+		ImGui::Text("Transients: %u images in %u blocks, %.1f MB aliased", graphStats.transientImages, graphStats.memoryBlocks, graphStats.aliasedBytes / (1024.0 * 1024.0));
+		ImGui::Text("Input to present: %.2f ms (avg %.2f ms, max %.2f ms)", latency.lastMs, latency.averageMs, latency.maxMs);
+	}
+	ImGui::End();
+
+	if (ImGui::Begin("occlusion")) {
+		if (ImGui::Checkbox("Software occlusion culling", &renderer->softwareOcclusion)) {
+			renderer->mark_dirty(DIRTY_SCENE);
+		}
+		if (ImGui::SliderInt("Resolution", &renderer->occlusionResolution, 64, (int)SoftwareOcclusion::maxWidth)) {
+			renderer->mark_dirty(DIRTY_SCENE);
+		}
+		if (ImGui::Checkbox("Show depth buffer", &renderer->showOcclusionDebug)) {
+			renderer->mark_dirty(DIRTY_SCENE);
+		}
+
+		const SoftwareOcclusion::Stats& stats = renderer->get_occlusion_stats();
+		VkExtent2D extent = renderer->get_occlusion_extent();
+		ImGui::Text("Buffer: %ux%u, %u occluder triangles", extent.width, extent.height, stats.occluderTriangles);
+		ImGui::Text("Tested %u, occluded %u", stats.tested, stats.occluded);
+		ImGui::Text("Raster %.3f ms, test %.3f ms", stats.rasterMs, stats.testMs);
+
+		VkDescriptorSet texture = renderer->get_occlusion_debug_texture();
+		if (renderer->showOcclusionDebug && texture != VK_NULL_HANDLE) {
+			ImVec2 uvMax((float)extent.width / SoftwareOcclusion::maxWidth, (float)extent.height / SoftwareOcclusion::maxHeight);
+			ImGui::Image((ImTextureID)texture, ImVec2((float)extent.width, (float)extent.height), ImVec2(0.f, 0.f), uvMax);
+		}
+
+		ImGui::Separator();
+		ImGui::BeginDisabled(!conditionalRenderingSupported);
+		if (ImGui::Checkbox("Occlusion queries (conditional rendering)", &renderer->occlusionQueries)) {
+			renderer->mark_dirty(DIRTY_SCENE);
+		}
+		ImGui::EndDisabled();
+		if (ImGui::SliderInt("Query min indices", &renderer->occlusionQueryMinIndices, 0, 100000, "%d", ImGuiSliderFlags_Logarithmic)) {
+			renderer->mark_dirty(DIRTY_SCENE);
+		}
+		const Renderer::OcclusionQueryStats& queryStats = renderer->get_occlusion_query_stats();
+		ImGui::Text("Queried %u draws, %u skipped on the gpu", queryStats.queried, queryStats.skipped);
+	}
+	ImGui::End();
+}
+
 bool VulkanEngine::init_SDL3() {
 
 	if (!SDL_Init(SDL_INIT_VIDEO)) {
@@ -216,6 +403,8 @@ void VulkanEngine::init_vulkan() {
 	VkPhysicalDeviceVulkan12Features features12{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
 	features12.bufferDeviceAddress = true;
 	features12.descriptorIndexing = true;
+	features12.drawIndirectCount = true;
+	features12.hostQueryReset = true;
 
 	vkb::PhysicalDeviceSelector selector{ vkb_inst };
 	vkb::PhysicalDevice chosenPhysicalDevice = selector
@@ -226,6 +415,21 @@ void VulkanEngine::init_vulkan() {
 		.select()
 		.value();
 
+	VkPhysicalDeviceConditionalRenderingFeaturesEXT conditionalRenderingFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CONDITIONAL_RENDERING_FEATURES_EXT };
+	conditionalRenderingFeatures.conditionalRendering = true;
+	conditionalRenderingSupported = chosenPhysicalDevice.enable_extension_if_present(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME)
+		&& chosenPhysicalDevice.enable_extension_features_if_present(conditionalRenderingFeatures);
+
+	VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT };
+	meshShaderFeatures.taskShader = true;
+	meshShaderFeatures.meshShader = true;
+	// the task shader finds its command through gl_DrawID, the other draws get by without draw parameters
+	VkPhysicalDeviceShaderDrawParametersFeatures drawParametersFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_DRAW_PARAMETERS_FEATURES };
+	drawParametersFeatures.shaderDrawParameters = true;
+	meshShaderSupported = chosenPhysicalDevice.enable_extension_if_present(VK_EXT_MESH_SHADER_EXTENSION_NAME)
+		&& chosenPhysicalDevice.enable_extension_features_if_present(meshShaderFeatures)
+		&& chosenPhysicalDevice.enable_extension_features_if_present(drawParametersFeatures);
+
 	vkb::DeviceBuilder deviceBuilder{ chosenPhysicalDevice };
 
 	vkb::Device vkbDevice = deviceBuilder.build().value();
@@ -236,6 +440,17 @@ void VulkanEngine::init_vulkan() {
 	graphicsQueue = vkbDevice.get_queue(vkb::QueueType::graphics).value();
 	graphicsQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
 
+	if (conditionalRenderingSupported) {
+		cmdBeginConditionalRendering = (PFN_vkCmdBeginConditionalRenderingEXT)vkGetDeviceProcAddr(device, "vkCmdBeginConditionalRenderingEXT");
+		cmdEndConditionalRendering = (PFN_vkCmdEndConditionalRenderingEXT)vkGetDeviceProcAddr(device, "vkCmdEndConditionalRenderingEXT");
+	}
+	fmt::print("conditional rendering: {}\n", conditionalRenderingSupported ? "supported" : "not supported");
+
+	if (meshShaderSupported) {
+		cmdDrawMeshTasksIndirectCount = (PFN_vkCmdDrawMeshTasksIndirectCountEXT)vkGetDeviceProcAddr(device, "vkCmdDrawMeshTasksIndirectCountEXT");
+	}
+	fmt::print("mesh shaders: {}\n", meshShaderSupported ? "supported" : "not supported");
+
 	VmaAllocatorCreateInfo allocatorInfo = {};
 	allocatorInfo.physicalDevice = physicalDevice;
 	allocatorInfo.device = device;
@@ -243,7 +458,19 @@ void VulkanEngine::init_vulkan() {
 	allocatorInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
 	vmaCreateAllocator(&allocatorInfo, &vmaAllocator);
 	
-	
+	query_present_modes();
+}
+
+void VulkanEngine::query_present_modes() {
+	uint32_t modeCount = 0;
+	VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &modeCount, nullptr));
+
+	supportedPresentModes.resize(modeCount);
+	VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &modeCount, supportedPresentModes.data()));
+
+	for (VkPresentModeKHR mode : supportedPresentModes) {
+		fmt::print("supported present mode: {}\n", string_VkPresentModeKHR(mode));
+	}
 }
 
 void VulkanEngine::cleanup() {
@@ -304,6 +531,11 @@ void VulkanEngine::init_commands() {
 
 		VK_CHECK(vkAllocateCommandBuffers(device, &cmdAllocInfo, &frames[i].mainCommandBuffer));
 
+		VK_CHECK(vkAllocateCommandBuffers(device, &cmdAllocInfo, &frames[i].presentCommandBuffer));
+
+		cmdAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		VK_CHECK(vkAllocateCommandBuffers(device, &cmdAllocInfo, &frames[i].geometryCommandBuffer));
+		VK_CHECK(vkAllocateCommandBuffers(device, &cmdAllocInfo, &frames[i].directCommandBuffer));
 	}
 	
 
@@ -333,7 +565,37 @@ void VulkanEngine::init_sync_structures() {
 }
 
 
-void VulkanEngine::create_swapchain(uint32_t width, uint32_t height) {
+void VulkanEngine::resize_swapchain(uint32_t width, uint32_t height) {
+
+	windowExtent.width = width;
+	windowExtent.height = height;
+
+	// the old swapchain is handed to the new one so the driver can reuse its resources, frames in flight
+	// may still be presenting from it so it is destroyed with the last submitted frame instead of waiting idle
+	VkSwapchainKHR oldSwapchain = swapchain;
+	std::vector<VkImageView> oldImageViews = swapchainImageViews;
+	std::vector<VkSemaphore> oldRenderSemaphores = swapchainImageRenderSemaphores;
+
+	if (!create_swapchain(width, height, oldSwapchain)) {
+		return;
+	}
+
+	get_last_frame().deletionQueue.push_deletion_lambda([this, oldSwapchain, oldImageViews, oldRenderSemaphores]() {
+		for (VkSemaphore semaphore : oldRenderSemaphores) {
+			vkDestroySemaphore(device, semaphore, vkAllocator);
+		}
+		for (VkImageView imageView : oldImageViews) {
+			vkDestroyImageView(device, imageView, vkAllocator);
+		}
+		vkDestroySwapchainKHR(device, oldSwapchain, vkAllocator);
+	});
+
+	bool drawTargetsChanged = create_offscreen_resources();
+
+	renderer->resize_framebuffers(drawTargetsChanged);
+}
+
+bool VulkanEngine::create_swapchain(uint32_t width, uint32_t height, VkSwapchainKHR oldSwapchain) {
 
 	VkBool32 res;
 	vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, graphicsQueueFamily, surface, &res);
@@ -349,20 +611,26 @@ void VulkanEngine::create_swapchain(uint32_t width, uint32_t height) {
 
 	auto result = swapchainBuilder
 		.set_desired_format(VkSurfaceFormatKHR{ .format = swapchainImageFormat, .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR })
-		.set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
+		.set_desired_present_mode(presentMode)
+		// fifo is the only mode the spec guarantees
+		.add_fallback_present_mode(VK_PRESENT_MODE_FIFO_KHR)
 		.set_desired_extent(width, height)
-		.add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+		.set_old_swapchain(oldSwapchain)
 		.build();
 
 	if (!result) {
 		fmt::print("failed to create swapchain {}\n", result.error().message());
-		return;
+		return false;
 	}
 
 	vkb::Swapchain vkbSwapchain = result.value();
 
 	swapchainExtent = vkbSwapchain.extent;
 	swapchain = vkbSwapchain.swapchain;
+	activePresentMode = vkbSwapchain.present_mode;
+	if (activePresentMode != presentMode) {
+		fmt::print("present mode {} is not available, using {}\n", string_VkPresentModeKHR(presentMode), string_VkPresentModeKHR(activePresentMode));
+	}
 	swapchainImages = vkbSwapchain.get_images().value();
 	swapchainImageViews = vkbSwapchain.get_image_views().value();
 	swapchainImageCount = swapchainImages.size();
@@ -377,16 +645,48 @@ void VulkanEngine::create_swapchain(uint32_t width, uint32_t height) {
 	if (FRAME_OVERLAP > swapchainImageCount) {
 		fmt::print("Warning: FRAME_OVERLAP is greater than swapchain image count!\n");
 	}
+
+	return true;
 }
 
-void VulkanEngine::create_offscreen_resources() {
+bool VulkanEngine::create_offscreen_resources() {
+
+	// the render targets only grow, and in steps of a size class, so dragging a window edge doesnt reallocate every frame
+	constexpr uint32_t sizeClass = 256;
+
+	uint32_t requiredWidth = std::max(windowExtent.width, swapchainExtent.width);
+	uint32_t requiredHeight = std::max(windowExtent.height, swapchainExtent.height);
+
+	if (drawImage.image != VK_NULL_HANDLE) {
+		if (requiredWidth <= drawImage.imageExtent.width && requiredHeight <= drawImage.imageExtent.height) {
+			return false;
+		}
+
+		requiredWidth = std::max(requiredWidth, drawImage.imageExtent.width);
+		requiredHeight = std::max(requiredHeight, drawImage.imageExtent.height);
+
+		// the last submitted frame might still be rendering into the old targets
+		AllocatedImage oldDrawImage = drawImage;
+		AllocatedImage oldDepthImage = depthImage;
+		mainDeletionQueue.release_offscreen_image(oldDrawImage);
+		mainDeletionQueue.release_offscreen_image(oldDepthImage);
+
+		get_last_frame().deletionQueue.push_deletion_lambda([this, oldDrawImage, oldDepthImage]() {
+			vkDestroyImageView(device, oldDrawImage.imageView, vkAllocator);
+			vmaDestroyImage(vmaAllocator, oldDrawImage.image, oldDrawImage.allocation);
+			vkDestroyImageView(device, oldDepthImage.imageView, vkAllocator);
+			vmaDestroyImage(vmaAllocator, oldDepthImage.image, oldDepthImage.allocation);
+		});
+	}
 
 	VkExtent3D drawImageExtent = {
-		windowExtent.width,
-		windowExtent.height,
+		(requiredWidth + sizeClass - 1) / sizeClass * sizeClass,
+		(requiredHeight + sizeClass - 1) / sizeClass * sizeClass,
 		1
 	};
 
+	fmt::print("render targets resized to {}x{}\n", drawImageExtent.width, drawImageExtent.height);
+
 	drawImage.imageFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
 	drawImage.imageExtent = drawImageExtent;
 
@@ -399,6 +699,8 @@ void VulkanEngine::create_offscreen_resources() {
 	drawImageUsages |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 	drawImageUsages |= VK_IMAGE_USAGE_STORAGE_BIT;
 	drawImageUsages |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	// the composite pass samples it straight into the swapchain
+	drawImageUsages |= VK_IMAGE_USAGE_SAMPLED_BIT;
 
 	VkImageCreateInfo rimg_info = vkinit::image_create_info(drawImage.imageFormat, drawImageUsages, drawImageExtent);
 
@@ -413,6 +715,8 @@ void VulkanEngine::create_offscreen_resources() {
 	depthImage.imageExtent = drawImageExtent;
 	VkImageUsageFlags depthImageUsages{};
 	depthImageUsages |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	// read back into the depth pyramid for occlusion culling
+	depthImageUsages |= VK_IMAGE_USAGE_SAMPLED_BIT;
 
 	VkImageCreateInfo dimg_info = vkinit::image_create_info(depthImage.imageFormat, depthImageUsages, drawImageExtent);
 
@@ -429,6 +733,7 @@ void VulkanEngine::create_offscreen_resources() {
 	mainDeletionQueue.push_offscreen_image(drawImage);
 	mainDeletionQueue.push_offscreen_image(depthImage);
 
+	return true;
 }
 
 AllocatedBuffer VulkanEngine::create_buffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage) {
@@ -449,6 +754,22 @@ AllocatedBuffer VulkanEngine::create_buffer(size_t allocSize, VkBufferUsageFlags
 	return newBuffer;
 }
 
+void VulkanEngine::set_frames_in_flight(uint32_t count) {
+
+	if (count == framesInFlight) {
+		return;
+	}
+
+	// slots above the new count would never be waited on or flushed again, and the last frame is found with the new modulus
+	vkDeviceWaitIdle(device);
+	for (int i = 0; i < FRAME_OVERLAP; i++) {
+		frames[i].deletionQueue.flushFrameResources(vmaAllocator);
+		frames[i].frameDescriptors->clear_pools(device);
+	}
+
+	framesInFlight = count;
+}
+
 void VulkanEngine::immediateCommandSubmit(std::function<void(VkCommandBuffer cmd)>&& function)
 {
 	VK_CHECK(vkResetFences(device, 1, &immediateFence));
@@ -500,56 +821,315 @@ void VulkanEngine::destroy_swapchain() {
 }
 
 
-GPUMeshBuffers VulkanEngine::uploadMesh(std::span<uint32_t> indices, std::span<Vertex> vertices) {
-	//> mesh_create_1
-	const size_t vertexBufferSize = vertices.size() * sizeof(Vertex);
-	const size_t indexBufferSize = indices.size() * sizeof(uint32_t);
+GPUMeshBuffers VulkanEngine::uploadMesh(std::span<uint32_t> indices, std::span<Vertex> vertices, std::span<GPUMeshlet> meshlets, bool positionStream) {
+
+	// tightly packed xyz, a quarter of what the depth passes would fetch from the full vertices
+	std::vector<float> positions;
+	if (positionStream) {
+		positions.reserve(vertices.size() * 3);
+		for (const Vertex& vtx : vertices) {
+			positions.insert(positions.end(), { vtx.position.x, vtx.position.y, vtx.position.z });
+		}
+	}
+
+	return uploadMeshData(std::as_bytes(indices), VK_INDEX_TYPE_UINT32, std::as_bytes(vertices), meshlets, std::as_bytes(std::span(positions)));
+}
+
+GPUMeshBuffers VulkanEngine::uploadMeshData(std::span<const std::byte> indexData, VkIndexType indexType, std::span<const std::byte> vertexData, std::span<GPUMeshlet> meshlets,
+	std::span<const std::byte> positionData) {
+
+	MeshUpload upload;
+	upload.indexData = indexData;
+	upload.vertexData = vertexData;
+	upload.positionData = positionData;
+	upload.indexType = indexType;
+	upload.meshlets = meshlets;
 
-	GPUMeshBuffers newSurface;
+	return uploadMeshes(std::span(&upload, 1))[0];
+}
 
-	//create vertex buffer
-	newSurface.vertexBuffer = create_buffer(vertexBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-		VMA_MEMORY_USAGE_GPU_ONLY);
+GPUMeshBuffers VulkanEngine::uploadMeshCompressed(meshcodec::StreamView indices, VkIndexType indexType, meshcodec::StreamView vertices, uint32_t vertexSize,
+	std::span<GPUMeshlet> meshlets, uint32_t positionSize) {
 
-	//find the adress of the vertex buffer
-	VkBufferDeviceAddressInfo deviceAdressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,.buffer = newSurface.vertexBuffer.buffer };
-	newSurface.vertexBufferAddress = vkGetBufferDeviceAddress(device, &deviceAdressInfo);
+	MeshUpload upload;
+	upload.encoded = true;
+	upload.encodedIndices = indices;
+	upload.encodedVertices = vertices;
+	upload.vertexSize = vertexSize;
+	upload.positionSize = positionSize;
+	upload.indexType = indexType;
+	upload.meshlets = meshlets;
 
-	//create index buffer
-	newSurface.indexBuffer = create_buffer(indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VMA_MEMORY_USAGE_GPU_ONLY);
+	return uploadMeshes(std::span(&upload, 1))[0];
+}
 
-	//< mesh_create_1
-	// 
-	//> mesh_create_2
-	AllocatedBuffer staging = create_buffer(vertexBufferSize + indexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+std::vector<GPUMeshBuffers> VulkanEngine::uploadMeshes(std::span<const MeshUpload> uploads) {
+
+	// where every part of a mesh sits in the staging buffer, and for compressed meshes in the compressed buffer
+	struct UploadLayout {
+		// compressed meshes have their streams here instead of the vertices
+		size_t vertex = 0;
+		size_t index = 0;
+		size_t position = 0;
+		size_t meshlet = 0;
+		size_t compressed = 0;
+		size_t indexData = 0;
+		size_t vertexBlocks = 0;
+		size_t vertexData = 0;
+		size_t meshletBlocks = 0;
+		size_t meshletData = 0;
+	};
 
-	void* data = staging.allocation->GetMappedData();
+	// a batch is submitted once its staging gets this big, a large scene doesnt need all of it in host memory at once
+	constexpr size_t stagingBudget = 256ull * 1024 * 1024;
+
+	auto align = [](size_t offset) { return (offset + 15) & ~(size_t)15; };
+
+	std::vector<GPUMeshBuffers> results(uploads.size());
+	std::vector<UploadLayout> layouts(uploads.size());
+
+	VkPipelineLayout decodeLayout = renderer->managePipeline.get_layout(renderer->meshDecodePipelineLayoutID);
+	VkPipeline decodePipeline = renderer->managePipeline.get_pipeline(renderer->meshDecodePipelineID);
+
+	size_t first = 0;
+	while (first < uploads.size()) {
+
+		// lay out meshes until the budget runs out, a single mesh bigger than it still goes up alone
+		size_t last = first;
+		size_t stagingSize = 0;
+		size_t compressedSize = 0;
+		while (last < uploads.size()) {
+			const MeshUpload& upload = uploads[last];
+			UploadLayout layout;
+			size_t offset = stagingSize;
+			size_t compressedOffset = compressedSize;
+
+			if (upload.encoded) {
+				// block offsets and data of all streams back to back, every part is a whole number of words
+				layout.compressed = compressedOffset;
+				layout.indexData = upload.encodedIndices.blockOffsets.size() * sizeof(uint32_t);
+				layout.vertexBlocks = layout.indexData + upload.encodedIndices.bytes.size();
+				layout.vertexData = layout.vertexBlocks + upload.encodedVertices.blockOffsets.size() * sizeof(uint32_t);
+				layout.meshletBlocks = layout.vertexData + upload.encodedVertices.bytes.size();
+				layout.meshletData = layout.meshletBlocks + upload.encodedMeshlets.blockOffsets.size() * sizeof(uint32_t);
+				size_t size = layout.meshletData + upload.encodedMeshlets.bytes.size();
+
+				layout.vertex = offset;
+				offset = align(offset + size);
+				compressedOffset = align(compressedOffset + size);
+			}
+			else {
+				layout.vertex = offset;
+				layout.index = offset = align(offset + upload.vertexData.size());
+				layout.position = offset = align(offset + upload.indexData.size());
+				offset = align(offset + upload.positionData.size());
+			}
+			layout.meshlet = offset;
+			offset = align(offset + upload.meshlets.size_bytes());
 
-	// copy vertex buffer
-	memcpy(data, vertices.data(), vertexBufferSize);
-	// copy index buffer
-	memcpy((char*)data + vertexBufferSize, indices.data(), indexBufferSize);
+			if (last > first && offset > stagingBudget) {
+				break;
+			}
+			layouts[last] = layout;
+			stagingSize = offset;
+			compressedSize = compressedOffset;
+			last++;
+		}
 
-	immediateCommandSubmit([&](VkCommandBuffer cmd) {
-		VkBufferCopy vertexCopy{ 0 };
-		vertexCopy.dstOffset = 0;
-		vertexCopy.srcOffset = 0;
-		vertexCopy.size = vertexBufferSize;
+		AllocatedBuffer staging = create_buffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+		char* data = (char*)staging.allocation->GetMappedData();
 
-		vkCmdCopyBuffer(cmd, staging.buffer, newSurface.vertexBuffer.buffer, 1, &vertexCopy);
+		AllocatedBuffer compressed{};
+		VkDeviceAddress compressedAddress = 0;
+		if (compressedSize > 0) {
+			compressed = create_buffer(compressedSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+				VMA_MEMORY_USAGE_GPU_ONLY);
+			VkBufferDeviceAddressInfo compressedAdressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,.buffer = compressed.buffer };
+			compressedAddress = vkGetBufferDeviceAddress(device, &compressedAdressInfo);
+		}
 
-		VkBufferCopy indexCopy{ 0 };
-		indexCopy.dstOffset = 0;
-		indexCopy.srcOffset = vertexBufferSize;
-		indexCopy.size = indexBufferSize;
+		std::vector<MeshDecodePushConstants> decodes;
 
-		vkCmdCopyBuffer(cmd, staging.buffer, newSurface.indexBuffer.buffer, 1, &indexCopy);
-		});
+		for (size_t m = first; m < last; m++) {
+			const MeshUpload& upload = uploads[m];
+			const UploadLayout& layout = layouts[m];
+			GPUMeshBuffers& newSurface = results[m];
+
+			bool encoded = upload.encoded;
+			// the decode shader writes whole words, an odd number of 16 bit indices gets half a word of padding
+			bool shortIndices = upload.indexType == VK_INDEX_TYPE_UINT16;
+			size_t indexBufferSize = encoded ? (shortIndices ? (upload.encodedIndices.count + 1) / 2 : upload.encodedIndices.count) * sizeof(uint32_t)
+				: upload.indexData.size();
+			size_t vertexBufferSize = encoded ? (size_t)upload.encodedVertices.count * upload.vertexSize : upload.vertexData.size();
+			size_t positionBufferSize = encoded ? (size_t)upload.encodedVertices.count * upload.positionSize : upload.positionData.size();
+			size_t meshletBufferSize = upload.meshlets.size_bytes() + (size_t)upload.encodedMeshlets.count * sizeof(GPUMeshlet);
+
+			newSurface.indexType = upload.indexType;
+
+			// filled by a copy or by the decode shader through their addresses
+			newSurface.vertexBuffer = create_buffer(vertexBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+				VMA_MEMORY_USAGE_GPU_ONLY);
+			// whole words, the mesh shaders read 16 bit indices two at a time
+			newSurface.indexBuffer = create_buffer((indexBufferSize + 3) & ~(size_t)3, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+				| VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+
+			VkBufferDeviceAddressInfo deviceAdressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,.buffer = newSurface.vertexBuffer.buffer };
+			newSurface.vertexBufferAddress = vkGetBufferDeviceAddress(device, &deviceAdressInfo);
+
+			// the mesh shaders read the meshlet indices through its address
+			VkBufferDeviceAddressInfo indexAdressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,.buffer = newSurface.indexBuffer.buffer };
+			newSurface.indexBufferAddress = vkGetBufferDeviceAddress(device, &indexAdressInfo);
+
+			// read by the culling shader through its address
+			if (meshletBufferSize > 0) {
+				newSurface.meshletBuffer = create_buffer(meshletBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+					VMA_MEMORY_USAGE_GPU_ONLY);
+
+				VkBufferDeviceAddressInfo meshletAdressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,.buffer = newSurface.meshletBuffer.buffer };
+				newSurface.meshletBufferAddress = vkGetBufferDeviceAddress(device, &meshletAdressInfo);
+
+				if (!upload.meshlets.empty()) {
+					memcpy(data + layout.meshlet, upload.meshlets.data(), meshletBufferSize);
+				}
+			}
 
-	vmaDestroyBuffer(vmaAllocator, staging.buffer, staging.allocation);
+			// read by the depth only passes through its address
+			if (positionBufferSize > 0) {
+				newSurface.positionBuffer = create_buffer(positionBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+					VMA_MEMORY_USAGE_GPU_ONLY);
+
+				VkBufferDeviceAddressInfo positionAdressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,.buffer = newSurface.positionBuffer.buffer };
+				newSurface.positionBufferAddress = vkGetBufferDeviceAddress(device, &positionAdressInfo);
+			}
+
+			if (!encoded) {
+				memcpy(data + layout.vertex, upload.vertexData.data(), vertexBufferSize);
+				memcpy(data + layout.index, upload.indexData.data(), indexBufferSize);
+				if (positionBufferSize > 0) {
+					memcpy(data + layout.position, upload.positionData.data(), positionBufferSize);
+				}
+				continue;
+			}
+
+			const meshcodec::StreamView& indices = upload.encodedIndices;
+			const meshcodec::StreamView& vertices = upload.encodedVertices;
+			memcpy(data + layout.vertex, indices.blockOffsets.data(), layout.indexData);
+			memcpy(data + layout.vertex + layout.indexData, indices.bytes.data(), indices.bytes.size());
+			memcpy(data + layout.vertex + layout.vertexBlocks, vertices.blockOffsets.data(), layout.vertexData - layout.vertexBlocks);
+			memcpy(data + layout.vertex + layout.vertexData, vertices.bytes.data(), vertices.bytes.size());
+			memcpy(data + layout.vertex + layout.meshletBlocks, upload.encodedMeshlets.blockOffsets.data(), layout.meshletData - layout.meshletBlocks);
+			memcpy(data + layout.vertex + layout.meshletData, upload.encodedMeshlets.bytes.data(), upload.encodedMeshlets.bytes.size());
+
+			MeshDecodePushConstants pushConstants{};
+			pushConstants.indexBlocks = compressedAddress + layout.compressed;
+			pushConstants.indexData = compressedAddress + layout.compressed + layout.indexData;
+			pushConstants.vertexBlocks = compressedAddress + layout.compressed + layout.vertexBlocks;
+			pushConstants.vertexData = compressedAddress + layout.compressed + layout.vertexData;
+			pushConstants.indexBuffer = newSurface.indexBufferAddress;
+			pushConstants.vertexBuffer = newSurface.vertexBufferAddress;
+			pushConstants.positionBuffer = newSurface.positionBufferAddress;
+			pushConstants.indexCount = indices.count;
+			pushConstants.indexBlockCount = indices.block_count();
+			pushConstants.vertexCount = vertices.count;
+			pushConstants.vertexBlockCount = vertices.block_count();
+			pushConstants.shortIndices = shortIndices ? 1 : 0;
+			pushConstants.vertexChannels = upload.vertexSize / sizeof(uint16_t);
+			pushConstants.positionWords = upload.positionSize / sizeof(uint32_t);
+			decodes.push_back(pushConstants);
+
+			// meshlets go through the vertex path of the shader as 24 channels, with no indices or positions
+			if (upload.encodedMeshlets.count > 0) {
+				MeshDecodePushConstants meshletConstants{};
+				meshletConstants.vertexBlocks = compressedAddress + layout.compressed + layout.meshletBlocks;
+				meshletConstants.vertexData = compressedAddress + layout.compressed + layout.meshletData;
+				meshletConstants.vertexBuffer = newSurface.meshletBufferAddress;
+				meshletConstants.vertexCount = upload.encodedMeshlets.count;
+				meshletConstants.vertexBlockCount = upload.encodedMeshlets.block_count();
+				meshletConstants.vertexChannels = sizeof(GPUMeshlet) / sizeof(uint16_t);
+				decodes.push_back(meshletConstants);
+			}
+		}
+
+		// every copy of the batch, then every decode, in a single submit
+		immediateCommandSubmit([&](VkCommandBuffer cmd) {
+			for (size_t m = first; m < last; m++) {
+				const MeshUpload& upload = uploads[m];
+				const UploadLayout& layout = layouts[m];
+				const GPUMeshBuffers& newSurface = results[m];
+
+				if (upload.encoded) {
+					VkBufferCopy compressedCopy{ 0 };
+					compressedCopy.srcOffset = layout.vertex;
+					compressedCopy.dstOffset = layout.compressed;
+					compressedCopy.size = layout.meshletData + upload.encodedMeshlets.bytes.size();
+					vkCmdCopyBuffer(cmd, staging.buffer, compressed.buffer, 1, &compressedCopy);
+				}
+				else {
+					VkBufferCopy vertexCopy{ 0 };
+					vertexCopy.srcOffset = layout.vertex;
+					vertexCopy.size = upload.vertexData.size();
+					vkCmdCopyBuffer(cmd, staging.buffer, newSurface.vertexBuffer.buffer, 1, &vertexCopy);
+
+					VkBufferCopy indexCopy{ 0 };
+					indexCopy.srcOffset = layout.index;
+					indexCopy.size = upload.indexData.size();
+					vkCmdCopyBuffer(cmd, staging.buffer, newSurface.indexBuffer.buffer, 1, &indexCopy);
+
+					if (!upload.positionData.empty()) {
+						VkBufferCopy positionCopy{ 0 };
+						positionCopy.srcOffset = layout.position;
+						positionCopy.size = upload.positionData.size();
+						vkCmdCopyBuffer(cmd, staging.buffer, newSurface.positionBuffer.buffer, 1, &positionCopy);
+					}
+				}
+
+				if (!upload.meshlets.empty()) {
+					VkBufferCopy meshletCopy{ 0 };
+					meshletCopy.srcOffset = layout.meshlet;
+					meshletCopy.size = upload.meshlets.size_bytes();
+					vkCmdCopyBuffer(cmd, staging.buffer, newSurface.meshletBuffer.buffer, 1, &meshletCopy);
+				}
+			}
+
+			VkMemoryBarrier2 barrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+			VkDependencyInfo depInfo{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+			depInfo.memoryBarrierCount = 1;
+			depInfo.pMemoryBarriers = &barrier;
+
+			if (!decodes.empty()) {
+				barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+				barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+				barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+				barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+				vkCmdPipelineBarrier2(cmd, &depInfo);
+
+				vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, decodePipeline);
+				for (const MeshDecodePushConstants& pushConstants : decodes) {
+					vkCmdPushConstants(cmd, decodeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(MeshDecodePushConstants), &pushConstants);
+
+					// one invocation per block, 64 to a group
+					uint32_t blocks = pushConstants.indexBlockCount + pushConstants.vertexBlockCount;
+					vkCmdDispatch(cmd, (blocks + 63) / 64, 1, 1);
+				}
+			}
+
+			// whatever draws or culls with the meshes later reads what the copies and the shader wrote
+			barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+			barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+			barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+			barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+			vkCmdPipelineBarrier2(cmd, &depInfo);
+			});
+
+		vmaDestroyBuffer(vmaAllocator, staging.buffer, staging.allocation);
+		if (compressedSize > 0) {
+			vmaDestroyBuffer(vmaAllocator, compressed.buffer, compressed.allocation);
+		}
+
+		first = last;
+	}
 
-	return newSurface;
+	return results;
 }
 
 
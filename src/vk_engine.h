@@ -4,12 +4,32 @@
 #include "vk_renderer.h"
 #include "vkbootstrap/VkBootstrap.h"
 #include "vk_util.h"
+#include "vk_codec.h"
+#include "frame_scheduler.h"
 
 
 
 
 class Renderer;
 
+// one mesh of a batched upload, either the raw buffer contents or the compressed streams for the decode shader
+struct MeshUpload {
+	std::span<const std::byte> indexData;
+	std::span<const std::byte> vertexData;
+	std::span<const std::byte> positionData;
+	// used instead of the data above when encoded is set. vertices are vertexSize bytes of 16 bit channels, the first positionSize bytes
+	// of each also go to the position stream
+	bool encoded = false;
+	meshcodec::StreamView encodedIndices;
+	meshcodec::StreamView encodedVertices;
+	// GPUMeshlet records as 16 bit channels, decoded like the vertices. raw ones in meshlets can be given instead
+	meshcodec::StreamView encodedMeshlets;
+	uint32_t vertexSize = 0;
+	uint32_t positionSize = 0;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+	std::span<const GPUMeshlet> meshlets;
+};
+
 
 class VulkanEngine {
 public:
@@ -41,7 +61,31 @@ public:
 	//frame handles header
 
 	FrameData frames[FRAME_OVERLAP];
-	FrameData& get_current_frame() { return frames[frameNumber % FRAME_OVERLAP]; };
+	// FRAME_OVERLAP is the most frames that can be in flight, framesInFlight limits it at runtime
+	uint32_t framesInFlight = FRAME_OVERLAP;
+	FrameData& get_current_frame() { return frames[frameNumber % framesInFlight]; };
+	// the most recently submitted frame, its fence covers everything submitted so far
+	FrameData& get_last_frame() { return frames[(frameNumber + framesInFlight - 1) % framesInFlight]; };
+	// changing the count moves every frame to another slot, so it waits for the gpu and empties all of them first
+	void set_frames_in_flight(uint32_t count);
+
+	// presentation and frame pacing
+	// presentMode is what was requested, activePresentMode is what the swapchain ended up with
+	VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	VkPresentModeKHR activePresentMode = VK_PRESENT_MODE_FIFO_KHR;
+	std::vector<VkPresentModeKHR> supportedPresentModes;
+	// acquires the swapchain image after the offscreen work is submitted and defaults to one frame in flight
+	bool lowLatencyMode = false;
+
+	// VK_EXT_conditional_rendering is optional, the entry points are loaded when the device has it
+	bool conditionalRenderingSupported = false;
+	PFN_vkCmdBeginConditionalRenderingEXT cmdBeginConditionalRendering = nullptr;
+	PFN_vkCmdEndConditionalRenderingEXT cmdEndConditionalRendering = nullptr;
+	// VK_EXT_mesh_shader is optional too, without it meshlets are always drawn through indirect index ranges
+	bool meshShaderSupported = false;
+	PFN_vkCmdDrawMeshTasksIndirectCountEXT cmdDrawMeshTasksIndirectCount = nullptr;
+	LatencyStats latency;
+	FrameScheduler scheduler;
 
 	
 
@@ -64,9 +108,10 @@ public:
 	std::vector<VkSemaphore> swapchainImageRenderSemaphores;
 
 
-	// first image we draw into which gets blited into swapchain
-	AllocatedImage drawImage;
-	AllocatedImage depthImage;
+	// first image we draw into which gets composited into swapchain
+	// these only grow, a smaller window renders into the top left corner through the renderers drawExtent
+	AllocatedImage drawImage{};
+	AllocatedImage depthImage{};
 
 
 	Renderer* renderer{ nullptr };
@@ -90,7 +135,16 @@ public:
 
 	void immediateCommandSubmit(std::function<void(VkCommandBuffer cmd)>&& function);
 	AllocatedBuffer create_buffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage);
-	GPUMeshBuffers uploadMesh(std::span<uint32_t> indices, std::span<Vertex> vertices);
+	GPUMeshBuffers uploadMesh(std::span<uint32_t> indices, std::span<Vertex> vertices, std::span<GPUMeshlet> meshlets = {}, bool positionStream = false);
+	// raw index and vertex bytes, for meshes in the compact formats
+	GPUMeshBuffers uploadMeshData(std::span<const std::byte> indexData, VkIndexType indexType, std::span<const std::byte> vertexData, std::span<GPUMeshlet> meshlets = {},
+		std::span<const std::byte> positionData = {});
+	// the same buffers from compressed streams, only the compressed bytes cross the bus and a compute pass decodes them.
+	// vertices are vertexSize bytes of 16 bit channels, the first positionSize bytes of each also go to the position stream
+	GPUMeshBuffers uploadMeshCompressed(meshcodec::StreamView indices, VkIndexType indexType, meshcodec::StreamView vertices, uint32_t vertexSize,
+		std::span<GPUMeshlet> meshlets = {}, uint32_t positionSize = 0);
+	// all of them through one staging buffer and one submit, split into a few when the staging would get too big
+	std::vector<GPUMeshBuffers> uploadMeshes(std::span<const MeshUpload> uploads);
 
 
 
@@ -101,9 +155,12 @@ private:
 	void init_swapchain_resources();
 	void init_commands();
 	void init_sync_structures();
-	void create_swapchain(uint32_t width, uint32_t height);
-	void create_offscreen_resources();
+	bool create_swapchain(uint32_t width, uint32_t height, VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
+	bool create_offscreen_resources();
+	void resize_swapchain(uint32_t width, uint32_t height);
 	void destroy_swapchain();
+	void query_present_modes();
+	void build_ui();
 
 };
 
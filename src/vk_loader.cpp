@@ -7,31 +7,549 @@
 
 #include "vk_initializers.h"
 #include <glm/gtx/quaternion.hpp>
+#include <glm/gtc/packing.hpp>
 #include "vk_engine.h"
+#include "vk_meshlets.h"
+#include "vk_simplify.h"
+#include "vk_meshorder.h"
+#include "vk_codec.h"
+#include "mapped_file.h"
+#include <atomic>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <immintrin.h>
+#include <cfloat>
 
 #include "fastgltf/core.hpp"
 #include <fastgltf/glm_element_traits.hpp>
 #include <fastgltf/tools.hpp>
 
 
-std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(VulkanEngine* engine, std::filesystem::path filePath) {
+// a mesh between parsing and upload, nothing in it is shared so every mesh can be processed on its own thread
+struct LoadedMesh {
+	MeshAsset asset;
+	std::vector<uint32_t> indices;
+	std::vector<Vertex> vertices;
+	std::vector<GPUMeshlet> meshlets;
+	// encoded instead of being uploaded as Vertex and 32 bit indices when the compact formats are asked for
+	bool compact = false;
+	glm::vec3 positionOffset{ 0.f };
+	glm::vec3 positionScale{ 1.f };
+	// the compact buffers compressed, what the mesh cache stores and what gets uploaded
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+	meshcodec::Stream encodedIndices;
+	meshcodec::Stream encodedVertices;
+	meshcodec::Stream encodedMeshlets;
+	// what gets cached and uploaded, the streams above or the same data in the mapped mesh cache
+	meshcodec::StreamView indexStream;
+	meshcodec::StreamView vertexStream;
+	meshcodec::StreamView meshletStream;
+	// of the full detail surfaces, before and after the reordering
+	float acmrBefore = 0.f;
+	float acmrAfter = 0.f;
+	uint32_t triangles = 0;
+};
+
+// the arrays a mesh only needs while it is processed, every worker keeps one so they are allocated once per thread
+// instead of once per mesh
+struct MeshScratch {
+	std::vector<uint32_t> indices;
+	std::vector<Vertex> vertices;
+	std::vector<CompactVertex> compactVertices;
+	std::vector<uint16_t> shortIndices;
+	// the attributes of one primitive as they come out of the accessors, before they are interleaved into Vertex
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec4> colors;
+};
+
+// the attribute arrays of the scratch into Vertex with sse. position and normal are loaded as four floats, the fourth
+// being the first one of the next vertex, and a pair of shuffles puts a uv half into that lane
+static void interleave_vertices(const MeshScratch& scratch, size_t count, Vertex* vertices) {
+
+	const float* positions = (const float*)scratch.positions.data();
+	const float* normals = (const float*)scratch.normals.data();
+	const float* uvs = (const float*)scratch.uvs.data();
+	const float* colors = (const float*)scratch.colors.data();
+	float* out = (float*)vertices;
+
+	for (size_t v = 0; v < count; v++) {
+		__m128 position = _mm_loadu_ps(positions + v * 3);
+		__m128 normal = _mm_loadu_ps(normals + v * 3);
+		__m128 uv = _mm_castpd_ps(_mm_load_sd((const double*)(uvs + v * 2)));
+
+		// (z, z, u, u) and (z, z, v, v), then the xy of the attribute in front of them
+		__m128 positionHigh = _mm_shuffle_ps(position, uv, _MM_SHUFFLE(0, 0, 2, 2));
+		__m128 normalHigh = _mm_shuffle_ps(normal, uv, _MM_SHUFFLE(1, 1, 2, 2));
+
+		_mm_storeu_ps(out + v * 12, _mm_shuffle_ps(position, positionHigh, _MM_SHUFFLE(2, 0, 1, 0)));
+		_mm_storeu_ps(out + v * 12 + 4, _mm_shuffle_ps(normal, normalHigh, _MM_SHUFFLE(2, 0, 1, 0)));
+		_mm_storeu_ps(out + v * 12 + 8, _mm_loadu_ps(colors + v * 4));
+	}
+}
 
-	std::cout << "Loading GLTF: " << filePath << std::endl;
+// unit normal folded onto the octahedron and flattened, two snorm8
+static uint16_t encode_octahedral(glm::vec3 n) {
+	float length = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (length <= 0.f) {
+		return glm::packSnorm2x8(glm::vec2(0.f));
+	}
+	n /= length;
+
+	glm::vec2 e(n.x, n.y);
+	if (n.z < 0.f) {
+		e = (1.f - glm::abs(glm::vec2(n.y, n.x))) * glm::vec2(n.x >= 0.f ? 1.f : -1.f, n.y >= 0.f ? 1.f : -1.f);
+	}
+	return glm::packSnorm2x8(e);
+}
+
+// CompactVertex for every vertex into the scratch, and 16 bit indices relative to each surface if all of them span few enough vertices
+static void compact_mesh(LoadedMesh& mesh, MeshScratch& scratch) {
+
+	// no short indices left in the scratch means 32 bit ones
+	scratch.compactVertices.clear();
+	scratch.shortIndices.clear();
+
+	if (mesh.vertices.empty()) {
+		return;
+	}
+
+	glm::vec3 minpos = mesh.vertices[0].position;
+	glm::vec3 maxpos = mesh.vertices[0].position;
+	for (const Vertex& vtx : mesh.vertices) {
+		minpos = glm::min(minpos, vtx.position);
+		maxpos = glm::max(maxpos, vtx.position);
+	}
+
+	// a flat axis still needs something to divide by, every position on it decodes to the offset
+	mesh.positionOffset = minpos;
+	mesh.positionScale = glm::max(maxpos - minpos, glm::vec3(1e-20f));
+
+	scratch.compactVertices.resize(mesh.vertices.size());
+	for (size_t v = 0; v < mesh.vertices.size(); v++) {
+		const Vertex& vtx = mesh.vertices[v];
+		CompactVertex& compact = scratch.compactVertices[v];
+
+		glm::vec3 unorm = (vtx.position - mesh.positionOffset) / mesh.positionScale;
+		uint32_t xy = glm::packUnorm2x16(glm::vec2(unorm.x, unorm.y));
+		compact.position[0] = (uint16_t)(xy & 0xFFFF);
+		compact.position[1] = (uint16_t)(xy >> 16);
+		compact.position[2] = (uint16_t)glm::packUnorm2x16(glm::vec2(unorm.z, 0.f));
+		compact.normal = encode_octahedral(vtx.normal);
+		compact.uv = glm::packHalf2x16(glm::vec2(vtx.uv_x, vtx.uv_y));
+		compact.color = glm::packUnorm4x8(vtx.color);
+	}
+
+	// the levels of a surface only use its vertices, so they share its base
+	std::vector<uint32_t> bases(mesh.asset.surfaces.size(), 0);
+	for (size_t s = 0; s < mesh.asset.surfaces.size(); s++) {
+		const GeoSurface& surface = mesh.asset.surfaces[s];
+		if (surface.count == 0) {
+			continue;
+		}
+
+		const uint32_t* first = mesh.indices.data() + surface.startIndex;
+		uint32_t minVertex = *std::min_element(first, first + surface.count);
+		uint32_t maxVertex = *std::max_element(first, first + surface.count);
+		if (maxVertex - minVertex > UINT16_MAX) {
+			return;
+		}
+		bases[s] = minVertex;
+	}
+
+	scratch.shortIndices.resize(mesh.indices.size());
+	auto rebase = [&](GeoSurface& range, uint32_t base) {
+		range.vertexOffset = base;
+		for (uint32_t i = range.startIndex; i < range.startIndex + range.count; i++) {
+			scratch.shortIndices[i] = (uint16_t)(mesh.indices[i] - base);
+		}
+	};
+	for (size_t s = 0; s < mesh.asset.surfaces.size(); s++) {
+		GeoSurface& surface = mesh.asset.surfaces[s];
+		rebase(surface, bases[s]);
+		for (uint32_t l = surface.firstLod; l < surface.firstLod + surface.lodCount; l++) {
+			rebase(mesh.asset.lods[l], bases[s]);
+		}
+	}
+}
+
+// triangle weighted acmr of the full detail surfaces
+static float surfaces_acmr(const LoadedMesh& mesh) {
+	float misses = 0.f;
+	for (const GeoSurface& surface : mesh.asset.surfaces) {
+		misses += meshorder::acmr(mesh.indices.data() + surface.startIndex, surface.count) * (surface.count / 3);
+	}
+	return mesh.triangles > 0 ? misses / mesh.triangles : 0.f;
+}
+
+static void process_mesh(LoadedMesh& mesh, MeshScratch& scratch) {
+
+	for (const GeoSurface& surface : mesh.asset.surfaces) {
+		mesh.triangles += surface.count / 3;
+	}
+	mesh.acmrBefore = surfaces_acmr(mesh);
+
+	// display the vertex normals
+	constexpr bool OverrideColors = true;
+	if (OverrideColors) {
+		for (Vertex& vtx : mesh.vertices) {
+			vtx.color = glm::vec4(vtx.normal, 1.f);
+		}
+	}
+
+	// the simplifier and the meshlet builder only need the positions, they are worked on in the scratch and only
+	// copied into the asset for occluders and for full meshes, whose position stream is uploaded from them
+	std::vector<glm::vec3>& positions = scratch.positions;
+	positions.clear();
+	positions.reserve(mesh.vertices.size());
+	for (const Vertex& vtx : mesh.vertices) {
+		positions.push_back(vtx.position);
+	}
+
+	// every level halves the triangles of the one before and is appended to the index buffer. the first MinLods
+	// levels are forced when the error budget or locked borders stall the simplifier, with no error limit and
+	// free borders. the lod error still records how far they stray so they are only picked when that is small on screen
+	constexpr uint32_t MinLods = 3;
+	constexpr uint32_t MaxLods = 4;
+	for (GeoSurface& surface : mesh.asset.surfaces) {
+		surface.firstLod = (uint32_t)mesh.asset.lods.size();
+
+		GeoSurface lod = surface;
+		lod.firstLod = 0;
+		for (uint32_t level = 0; level < MaxLods; level++) {
+			// errors add up since every level is simplified from the last, anything as large as the surface is useless
+			float errorBudget = surface.bounds.sphereRadius - lod.lodError;
+
+			size_t start = mesh.indices.size();
+			float error = 0.f;
+			uint32_t count = 0;
+			if (errorBudget > 0.f) {
+				error = simplify::edge_collapse(positions, mesh.indices.data() + lod.startIndex, lod.count, lod.count / 6 * 3,
+					errorBudget, mesh.indices);
+				count = (uint32_t)(mesh.indices.size() - start);
+			}
+
+			// mostly locked borders left, a level this close to the last isnt worth the memory
+			if (count == 0 || count > lod.count * 3 / 4) {
+				mesh.indices.resize(start);
+				if (level >= MinLods) {
+					break;
+				}
+
+				error = simplify::edge_collapse(positions, mesh.indices.data() + lod.startIndex, lod.count, lod.count / 6 * 3,
+					FLT_MAX, mesh.indices, false);
+				count = (uint32_t)(mesh.indices.size() - start);
+
+				// a handful of triangles that cant lose any, the surface keeps the levels it has
+				if (count == 0 || count >= lod.count) {
+					mesh.indices.resize(start);
+					break;
+				}
+			}
+
+			lod.startIndex = (uint32_t)start;
+			lod.count = count;
+			lod.lodError += error;
+			mesh.asset.lods.push_back(lod);
+		}
+
+		surface.lodCount = (uint32_t)mesh.asset.lods.size() - surface.firstLod;
+	}
+
+	// cache order first, then the pieces of it sorted for overdraw. the meshlet builder seeds from this order,
+	// its clusters get their own cache order after, which is also what whole surface draws end up with
+	auto build_meshlets = [&](GeoSurface& surface) {
+		meshorder::optimize_vertex_cache(mesh.indices.data() + surface.startIndex, surface.count);
+		meshorder::optimize_overdraw(positions, mesh.indices.data() + surface.startIndex, surface.count);
+
+		surface.firstMeshlet = (uint32_t)mesh.meshlets.size();
+		meshlets::build(positions, mesh.indices.data() + surface.startIndex, surface.count, surface.startIndex, mesh.meshlets);
+		surface.meshletCount = (uint32_t)mesh.meshlets.size() - surface.firstMeshlet;
+
+		for (uint32_t m = surface.firstMeshlet; m < surface.firstMeshlet + surface.meshletCount; m++) {
+			meshorder::optimize_vertex_cache(mesh.indices.data() + mesh.meshlets[m].firstIndex, mesh.meshlets[m].indexCount);
+			if (surface.doubleSided) {
+				mesh.meshlets[m].cone.w = 1.f;
+			}
+		}
+	};
+	for (GeoSurface& surface : mesh.asset.surfaces) {
+		build_meshlets(surface);
+	}
+	for (GeoSurface& lod : mesh.asset.lods) {
+		build_meshlets(lod);
+	}
+
+	// the vertex shader pulls vertices by index, in first use order neighbouring invocations read neighbouring memory.
+	// bounds and meshlets only hold positions and index ranges, the renumbering doesnt touch them
+	meshorder::optimize_vertex_fetch(mesh.indices, mesh.vertices);
+	for (size_t v = 0; v < mesh.vertices.size(); v++) {
+		positions[v] = mesh.vertices[v].position;
+	}
+
+	mesh.acmrAfter = surfaces_acmr(mesh);
+	if (mesh.asset.occluder || !mesh.compact) {
+		mesh.asset.cpuPositions = positions;
+	}
+	// the rasterizer takes 32 bit indices into the whole mesh
+	if (mesh.asset.occluder) {
+		mesh.asset.cpuIndices = mesh.indices;
+	}
+
+	if (mesh.compact) {
+		compact_mesh(mesh, scratch);
+
+		mesh.indexType = scratch.shortIndices.empty() ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16;
+		mesh.encodedIndices = scratch.shortIndices.empty() ? meshcodec::encode_indices(mesh.indices.data(), (uint32_t)mesh.indices.size())
+			: meshcodec::encode_indices(scratch.shortIndices.data(), (uint32_t)scratch.shortIndices.size());
+		mesh.encodedVertices = meshcodec::encode_vertices((const uint16_t*)scratch.compactVertices.data(), (uint32_t)scratch.compactVertices.size(),
+			sizeof(CompactVertex) / sizeof(uint16_t));
+		// neighbouring meshlets have close bounds and consecutive index ranges, they delta like vertices do
+		mesh.encodedMeshlets = meshcodec::encode_vertices((const uint16_t*)mesh.meshlets.data(), (uint32_t)mesh.meshlets.size(),
+			sizeof(GPUMeshlet) / sizeof(uint16_t));
+		mesh.indexStream = mesh.encodedIndices;
+		mesh.vertexStream = mesh.encodedVertices;
+		mesh.meshletStream = mesh.encodedMeshlets;
+		mesh.meshlets = {};
+
+		// the streams and the cpu copies are all that is left of it, the full buffers go back for the next mesh
+		scratch.vertices = std::move(mesh.vertices);
+		scratch.indices = std::move(mesh.indices);
+		mesh.vertices = {};
+		mesh.indices = {};
+	}
+}
+
+// reads the accessors of every primitive into one index and vertex buffer, the asset is only read so any number of
+// meshes can be parsed at once
+static void parse_mesh(const fastgltf::Asset& gltf, const fastgltf::Mesh& mesh, LoadedMesh& loaded, MeshScratch& scratch) {
+
+	MeshAsset& newmesh = loaded.asset;
+	std::vector<uint32_t>& indices = loaded.indices;
+	std::vector<Vertex>& vertices = loaded.vertices;
+
+	newmesh.name = mesh.name;
+
+	for (auto&& p : mesh.primitives) {
+		GeoSurface newSurface;
+		newSurface.startIndex = (uint32_t)indices.size();
+		newSurface.count = (uint32_t)gltf.accessors[p.indicesAccessor.value()].count;
+
+		size_t initial_vtx = vertices.size();
+
+		// load indexes, straight into the index buffer and moved past the vertices of the primitives before
+		{
+			const fastgltf::Accessor& indexaccessor = gltf.accessors[p.indicesAccessor.value()];
+			size_t firstIndex = indices.size();
+			indices.resize(firstIndex + indexaccessor.count);
+
+			fastgltf::copyFromAccessor<std::uint32_t>(gltf, indexaccessor, indices.data() + firstIndex);
+			for (size_t i = firstIndex; i < indices.size(); i++) {
+				indices[i] += (uint32_t)initial_vtx;
+			}
+		}
+
+		// every attribute is copied whole into its own array of the scratch. copyFromAccessor converts normalized
+		// integers and applies sparse substitutions, tightly packed floats are a plain memcpy.
+		// positions and normals get one element more so the interleave can always read whole vectors
+		const fastgltf::Accessor& posAccessor = gltf.accessors[p.findAttribute("POSITION")->accessorIndex];
+		size_t count = posAccessor.count;
+
+		scratch.positions.resize(count + 1);
+		fastgltf::copyFromAccessor<glm::vec3>(gltf, posAccessor, scratch.positions.data());
+
+		// load vertex normals
+		scratch.normals.resize(count + 1);
+		auto normals = p.findAttribute("NORMAL");
+		if (normals != p.attributes.end()) {
+			fastgltf::copyFromAccessor<glm::vec3>(gltf, gltf.accessors[(*normals).accessorIndex], scratch.normals.data());
+		}
+		else {
+			std::fill_n(scratch.normals.begin(), count, glm::vec3(1.f, 0.f, 0.f));
+		}
+
+		// load UVs
+		scratch.uvs.resize(count);
+		auto uv = p.findAttribute("TEXCOORD_0");
+		if (uv != p.attributes.end()) {
+			fastgltf::copyFromAccessor<glm::vec2>(gltf, gltf.accessors[(*uv).accessorIndex], scratch.uvs.data());
+		}
+		else {
+			std::fill_n(scratch.uvs.begin(), count, glm::vec2(0.f));
+		}
+
+		// load vertex colors, rgb ones keep the alpha of the fill
+		scratch.colors.resize(count);
+		std::fill_n(scratch.colors.begin(), count, glm::vec4(1.f));
+		auto colors = p.findAttribute("COLOR_0");
+		if (colors != p.attributes.end()) {
+			const fastgltf::Accessor& colorAccessor = gltf.accessors[(*colors).accessorIndex];
+			if (colorAccessor.type == fastgltf::AccessorType::Vec3) {
+				fastgltf::copyFromAccessor<glm::vec3, sizeof(glm::vec4)>(gltf, colorAccessor, scratch.colors.data());
+			}
+			else {
+				fastgltf::copyFromAccessor<glm::vec4>(gltf, colorAccessor, scratch.colors.data());
+			}
+		}
+
+		vertices.resize(initial_vtx + count);
+		interleave_vertices(scratch, count, vertices.data() + initial_vtx);
 
-	auto result = fastgltf::GltfDataBuffer::FromPath(filePath);
-	
-	if (!result) {
-		fmt::print("Failed to read GLB: {}\n", fastgltf::to_underlying(result.error()));
+		// bounds of the surface from its own vertices
+		glm::vec3 minpos = vertices[initial_vtx].position;
+		glm::vec3 maxpos = vertices[initial_vtx].position;
+		for (size_t i = initial_vtx; i < vertices.size(); i++) {
+			minpos = glm::min(minpos, vertices[i].position);
+			maxpos = glm::max(maxpos, vertices[i].position);
+		}
+
+		newSurface.bounds.origin = (maxpos + minpos) / 2.f;
+		newSurface.bounds.extents = (maxpos - minpos) / 2.f;
+		newSurface.bounds.sphereRadius = glm::length(newSurface.bounds.extents);
+
+		// both sides are drawn, the normal cone of a double sided surface must never cull it
+		newSurface.doubleSided = p.materialIndex.has_value() && gltf.materials[p.materialIndex.value()].doubleSided;
+
+		newmesh.surfaces.push_back(newSurface);
+	}
+}
+
+// runs work(index, scratch) for every index on all cores, each thread takes the next index left and keeps its own scratch.
+// returns how many threads it used
+template<typename F>
+static size_t parallel_for(size_t count, F&& work) {
+
+	std::atomic<size_t> next = 0;
+	auto run = [&]() {
+		MeshScratch scratch;
+		for (size_t i = next++; i < count; i = next++) {
+			work(i, scratch);
+		}
+	};
+
+	size_t threadCount = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), std::max<size_t>(count, 1));
+	std::vector<std::thread> workers;
+	for (size_t t = 1; t < threadCount; t++) {
+		workers.emplace_back(run);
+	}
+	run();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	return threadCount;
+}
+
+static VertexFormat mesh_format(const MeshFormatSelector& selectFormat, std::string_view meshName) {
+	return selectFormat ? selectFormat(meshName) : VertexFormat::Compact;
+}
+
+// hands fastgltf a glb that is already mapped. the bin chunk is read into the mapping itself, which costs nothing,
+// so the accessors are decoded straight from the page cache instead of from a copy fastgltf allocates
+class MappedGlbData final : public fastgltf::GltfDataGetter {
+public:
+	explicit MappedGlbData(const MappedFile& file) : file(file) {}
+
+	void read(void* ptr, std::size_t count) override {
+		count = std::min(count, file.size() - cursor);
+		const uint8_t* source = file.data() + cursor;
+		if (ptr != source) {
+			memcpy(ptr, source, count);
+		}
+		cursor += count;
+	}
+
+	// only the json is read this way, simdjson wants padding after it that the mapping doesnt have
+	fastgltf::span<std::byte> read(std::size_t count, std::size_t padding) override {
+		count = std::min(count, file.size() - cursor);
+		json.resize(count + padding);
+		memcpy(json.data(), file.data() + cursor, count);
+		cursor += count;
+		return fastgltf::span<std::byte>(json.data(), count);
+	}
+
+	void reset() override { cursor = 0; }
+	std::size_t bytesRead() override { return cursor; }
+	std::size_t totalSize() override { return file.size(); }
+
+private:
+	const MappedFile& file;
+	size_t cursor = 0;
+	std::vector<std::byte> json;
+};
+
+// where fastgltf puts buffer data. the glb bin chunk stays in the mapping, external and base64 buffers get memory of their own
+struct GltfBufferMemory {
+	const uint8_t* bin = nullptr;
+	size_t binSize = 0;
+	bool binMapped = false;
+	std::vector<std::vector<std::byte>> owned;
+};
+constexpr fastgltf::CustomBufferId mappedBinId = UINT64_MAX;
+
+static fastgltf::BufferInfo map_gltf_buffer(uint64_t bufferSize, void* userPointer) {
+	GltfBufferMemory& memory = *(GltfBufferMemory*)userPointer;
+	// the glb chunk is always the first buffer fastgltf asks for
+	if (memory.bin != nullptr && !memory.binMapped && bufferSize == memory.binSize) {
+		memory.binMapped = true;
+		return { const_cast<uint8_t*>(memory.bin), mappedBinId };
+	}
+	memory.owned.emplace_back(bufferSize);
+	return { memory.owned.back().data(), memory.owned.size() - 1 };
+}
+
+// the bin chunk of a glb, the second chunk right after the json one. empty if there is none
+static std::span<const uint8_t> glb_bin_chunk(const MappedFile& file) {
+	auto word = [&](size_t offset) {
+		uint32_t value = 0;
+		if (offset + sizeof(value) <= file.size()) {
+			memcpy(&value, file.data() + offset, sizeof(value));
+		}
+		return value;
+	};
+
+	constexpr uint32_t glbMagic = 0x46546C67; // glTF
+	constexpr uint32_t binChunk = 0x004E4942; // BIN
+	if (word(0) != glbMagic) {
 		return {};
 	}
+	size_t binHeader = 12 + 8 + (size_t)word(12);
+	size_t binStart = binHeader + 8;
+	size_t binLength = word(binHeader);
+	if (word(binHeader + 4) != binChunk || binStart > file.size() || binLength > file.size() - binStart) {
+		return {};
+	}
+	return { file.data() + binStart, binLength };
+}
+
+// parses the file and processes every mesh, nothing is uploaded yet
+static bool load_gltf_file(const std::filesystem::path& filePath, const MeshFormatSelector& selectFormat, const OccluderSelector& selectOccluder,
+	std::vector<LoadedMesh>& loaded) {
+
+	std::cout << "Loading GLTF: " << filePath << std::endl;
+
+	// mapped so the file isnt read into a heap buffer of its own first. only the json is copied, the meshes are
+	// decoded from the bin chunk where it lies in the mapping
+	MappedFile file;
+	if (!file.open(filePath)) {
+		fmt::print("Failed to read GLB: {}\n", filePath.string());
+		return false;
+	}
+	MappedGlbData data(file);
 
-	fastgltf::GltfDataBuffer data = std::move(result.get());
-	
+	GltfBufferMemory bufferMemory;
+	std::span<const uint8_t> bin = glb_bin_chunk(file);
+	bufferMemory.bin = bin.data();
+	bufferMemory.binSize = bin.size();
 
 	constexpr auto gltfOptions = fastgltf::Options::LoadExternalBuffers;
 
 	fastgltf::Asset gltf;
-	fastgltf::Parser parser{};
+	// quantized attributes come out of the accessor helpers as floats like any other
+	fastgltf::Parser parser{ fastgltf::Extensions::KHR_mesh_quantization };
+	parser.setUserPointer(&bufferMemory);
+	parser.setBufferAllocationCallback(map_gltf_buffer);
 
 	auto load = parser.loadGltfBinary(data, filePath.parent_path(), gltfOptions);
 	if (load) {
@@ -39,114 +557,384 @@ std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(VulkanEngi
 	}
 	else {
 		fmt::print("Failed to load glTF: {} \n", fastgltf::to_underlying(load.error()));
-		return {};
+		return false;
 	}
 
+	// custom buffers are opaque to the accessor helpers, they read the same memory as plain byte views
+	for (fastgltf::Buffer& buffer : gltf.buffers) {
+		if (auto* custom = std::get_if<fastgltf::sources::CustomBuffer>(&buffer.data)) {
+			fastgltf::span<const std::byte> bytes = custom->id == mappedBinId
+				? fastgltf::span<const std::byte>((const std::byte*)bufferMemory.bin, bufferMemory.binSize)
+				: fastgltf::span<const std::byte>(bufferMemory.owned[custom->id].data(), bufferMemory.owned[custom->id].size());
+			buffer.data = fastgltf::sources::ByteView{ bytes, custom->mimeType };
+		}
+	}
 
-	std::vector<std::shared_ptr<MeshAsset>> meshes;
 
-	// use the same vectors for all meshes so that the memory doesnt reallocate as
-	// often
-	std::vector<uint32_t> indices;
-	std::vector<Vertex> vertices;
+	auto processStart = std::chrono::high_resolution_clock::now();
+
+	// the format is picked up front so the selectors never run on the workers
+	loaded.resize(gltf.meshes.size());
+	for (size_t m = 0; m < loaded.size(); m++) {
+		loaded[m].compact = mesh_format(selectFormat, gltf.meshes[m].name) == VertexFormat::Compact;
+		loaded[m].asset.occluder = selectOccluder && selectOccluder(gltf.meshes[m].name);
+	}
+
+	// the meshes dont share anything until they are uploaded, every worker parses and processes the next one left
+	size_t threadCount = parallel_for(loaded.size(), [&](size_t m, MeshScratch& scratch) {
+		// compact meshes only keep their encoded streams, their full buffers are the last mesh's ones reused
+		if (loaded[m].compact) {
+			loaded[m].vertices = std::move(scratch.vertices);
+			loaded[m].indices = std::move(scratch.indices);
+			loaded[m].vertices.clear();
+			loaded[m].indices.clear();
+		}
+
+		parse_mesh(gltf, gltf.meshes[m], loaded[m], scratch);
+		process_mesh(loaded[m], scratch);
+	});
+
+	float processMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - processStart).count();
+
+	uint64_t triangles = 0;
+	double missesBefore = 0.0;
+	double missesAfter = 0.0;
+	size_t fullBytes = 0;
+	size_t uploadBytes = 0;
+	for (const LoadedMesh& mesh : loaded) {
+		triangles += mesh.triangles;
+		missesBefore += (double)mesh.acmrBefore * mesh.triangles;
+		missesAfter += (double)mesh.acmrAfter * mesh.triangles;
+
+		size_t vertexCount = mesh.compact ? mesh.vertexStream.count : mesh.vertices.size();
+		size_t indexCount = mesh.compact ? mesh.indexStream.count : mesh.indices.size();
+		fullBytes += vertexCount * sizeof(Vertex) + indexCount * sizeof(uint32_t);
+		// compact meshes go up compressed and get their position stream on the gpu
+		if (mesh.compact) {
+			uploadBytes += mesh.indexStream.size_bytes() + mesh.vertexStream.size_bytes() + mesh.meshletStream.size_bytes();
+		}
+		else {
+			uploadBytes += vertexCount * (sizeof(Vertex) + sizeof(glm::vec3)) + indexCount * sizeof(uint32_t);
+		}
+	}
+	if (triangles > 0) {
+		fmt::print("Parsed and processed {} meshes on {} threads in {:.1f} ms, acmr {:.3f} -> {:.3f} over {} triangles\n", loaded.size(), threadCount, processMs,
+			missesBefore / triangles, missesAfter / triangles, triangles);
+		fmt::print("Vertex and index data: {:.1f} KB, {:.1f} KB uploaded\n", fullBytes / 1024.0, uploadBytes / 1024.0);
+	}
+
+	return true;
+}
+
+// bumped whenever the format or anything in process_mesh changes, older caches are rebuilt from the gltf
+constexpr uint32_t MeshCacheMagic = 0x48534D47;
+constexpr uint32_t MeshCacheVersion = 4;
+
+// what identifies the source file, a cache written for anything else is ignored
+static std::pair<uint64_t, int64_t> source_stamp(const std::filesystem::path& filePath) {
+	std::error_code error;
+	uint64_t size = std::filesystem::file_size(filePath, error);
+	int64_t time = std::filesystem::last_write_time(filePath, error).time_since_epoch().count();
+	return { size, time };
+}
+
+// the compact meshes as they are uploaded, compressed streams plus what the cpu needs to rebuild the asset
+static void write_mesh_cache(const std::filesystem::path& cachePath, const std::filesystem::path& filePath, const std::vector<LoadedMesh>& loaded) {
+
+	std::vector<uint8_t> file;
+	auto write = [&](const void* data, size_t size) {
+		file.insert(file.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+	};
+	auto write_u32 = [&](uint32_t v) { write(&v, sizeof(v)); };
+	// every array starts on 4 bytes, so the streams can be used in place from the mapped file
+	auto write_vector = [&](const auto& v) {
+		write_u32((uint32_t)v.size());
+		write(v.data(), v.size() * sizeof(v[0]));
+		file.resize((file.size() + 3) & ~(size_t)3, 0);
+	};
+	auto write_stream = [&](const meshcodec::StreamView& stream) {
+		write_u32(stream.count);
+		write_vector(stream.blockOffsets);
+		write_vector(stream.bytes);
+	};
+
+	static_assert(std::is_trivially_copyable_v<GeoSurface> && std::is_trivially_copyable_v<GPUMeshlet>);
+
+	auto [sourceSize, sourceTime] = source_stamp(filePath);
+	write_u32(MeshCacheMagic);
+	write_u32(MeshCacheVersion);
+	write(&sourceSize, sizeof(sourceSize));
+	write(&sourceTime, sizeof(sourceTime));
+	write_u32((uint32_t)loaded.size());
+
+	for (const LoadedMesh& mesh : loaded) {
+		write_vector(mesh.asset.name);
+		write_u32((uint32_t)mesh.indexType);
+		write(&mesh.positionOffset, sizeof(mesh.positionOffset));
+		write(&mesh.positionScale, sizeof(mesh.positionScale));
+		write_vector(mesh.asset.surfaces);
+		write_vector(mesh.asset.lods);
+		write_stream(mesh.indexStream);
+		write_stream(mesh.vertexStream);
+		write_stream(mesh.meshletStream);
+	}
 
+	std::ofstream out(cachePath, std::ios::binary | std::ios::trunc);
+	out.write((const char*)file.data(), file.size());
+	if (!out) {
+		fmt::print("Failed to write mesh cache {}\n", cachePath.string());
+	}
+}
 
-	for (fastgltf::Mesh& mesh : gltf.meshes) {
-		MeshAsset newmesh;
+// everything a cached mesh says about its streams is checked before any of it is used, the cpu rebase and decode
+// and the gpu decode and cull would otherwise go out of bounds on a corrupt file
+static bool cached_mesh_consistent(const LoadedMesh& mesh) {
 
-		newmesh.name = mesh.name;
+	if (mesh.indexType != VK_INDEX_TYPE_UINT16 && mesh.indexType != VK_INDEX_TYPE_UINT32) {
+		return false;
+	}
+	if (!meshcodec::is_consistent(mesh.indexStream, meshcodec::indexBlockSize)
+		|| !meshcodec::is_consistent(mesh.vertexStream, meshcodec::vertexBlockSize)
+		|| !meshcodec::is_consistent(mesh.meshletStream, meshcodec::vertexBlockSize)) {
+		return false;
+	}
 
-		// clear the mesh arrays each mesh, we dont want to merge them by error
-		indices.clear();
-		vertices.clear();
+	auto range_valid = [&](const GeoSurface& range) {
+		return (uint64_t)range.startIndex + range.count <= mesh.indexStream.count
+			&& (uint64_t)range.firstMeshlet + range.meshletCount <= mesh.meshletStream.count;
+	};
+	for (const GeoSurface& surface : mesh.asset.surfaces) {
+		if (!range_valid(surface) || (uint64_t)surface.firstLod + surface.lodCount > mesh.asset.lods.size()) {
+			return false;
+		}
+	}
+	return std::all_of(mesh.asset.lods.begin(), mesh.asset.lods.end(), range_valid);
+}
 
-		for (auto&& p : mesh.primitives) {
-			GeoSurface newSurface;
-			newSurface.startIndex = (uint32_t)indices.size();
-			newSurface.count = (uint32_t)gltf.accessors[p.indicesAccessor.value()].count;
+// false if there is no cache for this exact source or it cant be read, the gltf is loaded instead.
+// the streams of the meshes point into the mapped file, it has to stay open until they are uploaded
+static bool read_mesh_cache(const std::filesystem::path& cachePath, const std::filesystem::path& filePath, const MeshFormatSelector& selectFormat,
+	const OccluderSelector& selectOccluder, MappedFile& file, std::vector<LoadedMesh>& loaded) {
 
-			size_t initial_vtx = vertices.size();
+	if (!file.open(cachePath)) {
+		return false;
+	}
 
-			// load indexes
-			{
-				fastgltf::Accessor& indexaccessor = gltf.accessors[p.indicesAccessor.value()];
-				indices.reserve(indices.size() + indexaccessor.count);
+	size_t cursor = 0;
+	bool valid = true;
+	auto read = [&](void* data, size_t size) {
+		valid = valid && size <= file.size() - cursor;
+		// an empty vector has no data pointer to copy to
+		if (valid && size > 0) {
+			memcpy(data, file.data() + cursor, size);
+			cursor += size;
+		}
+	};
+	auto skip_padding = [&]() {
+		cursor = std::min((cursor + 3) & ~(size_t)3, file.size());
+	};
+	auto read_u32 = [&]() {
+		uint32_t v = 0;
+		read(&v, sizeof(v));
+		return v;
+	};
+	auto read_vector = [&](auto& v) {
+		uint32_t count = read_u32();
+		// a count larger than the rest of the file is corruption, not something to allocate
+		valid = valid && (size_t)count * sizeof(v[0]) <= file.size() - cursor;
+		if (valid) {
+			v.resize(count);
+			read(v.data(), count * sizeof(v[0]));
+			skip_padding();
+		}
+	};
+	// the same checks, but the array is used where it is in the file
+	auto read_span = [&]<typename T>(std::span<const T>& v) {
+		uint32_t count = read_u32();
+		valid = valid && (size_t)count * sizeof(T) <= file.size() - cursor;
+		if (valid) {
+			v = std::span((const T*)(file.data() + cursor), count);
+			cursor += count * sizeof(T);
+			skip_padding();
+		}
+	};
+	auto read_stream = [&](meshcodec::StreamView& stream) {
+		stream.count = read_u32();
+		read_span(stream.blockOffsets);
+		read_span(stream.bytes);
+	};
+
+	auto [sourceSize, sourceTime] = source_stamp(filePath);
+	uint64_t cachedSize = 0;
+	int64_t cachedTime = 0;
+	// a stale cache is rewritten right after, which the mapping would block on windows
+	if (read_u32() != MeshCacheMagic || read_u32() != MeshCacheVersion) {
+		file.close();
+		return false;
+	}
+	read(&cachedSize, sizeof(cachedSize));
+	read(&cachedTime, sizeof(cachedTime));
+	if (!valid || cachedSize != sourceSize || cachedTime != sourceTime) {
+		file.close();
+		return false;
+	}
 
-				fastgltf::iterateAccessor<std::uint32_t>(gltf, indexaccessor,
-					[&](std::uint32_t idx) {
-						indices.push_back(idx + initial_vtx);
-					});
-			}
+	// every mesh takes at least its counts and position range, a count that cant fit in the rest of the file is corruption
+	constexpr size_t MinMeshBytes = 13 * sizeof(uint32_t) + 2 * sizeof(glm::vec3);
+	uint32_t meshCount = read_u32();
+	valid = valid && meshCount <= (file.size() - cursor) / MinMeshBytes;
+	if (!valid) {
+		file.close();
+		return false;
+	}
+	loaded.resize(meshCount);
+	for (LoadedMesh& mesh : loaded) {
+		mesh.compact = true;
+		read_vector(mesh.asset.name);
+		mesh.indexType = (VkIndexType)read_u32();
+		read(&mesh.positionOffset, sizeof(mesh.positionOffset));
+		read(&mesh.positionScale, sizeof(mesh.positionScale));
+		read_vector(mesh.asset.surfaces);
+		read_vector(mesh.asset.lods);
+		read_stream(mesh.indexStream);
+		read_stream(mesh.vertexStream);
+		read_stream(mesh.meshletStream);
+	}
+	// a mesh asked for in the full format isnt in the cache, the whole file is loaded again
+	valid = valid && std::all_of(loaded.begin(), loaded.end(), [&](const LoadedMesh& mesh) {
+		return cached_mesh_consistent(mesh) && mesh_format(selectFormat, mesh.asset.name) == VertexFormat::Compact;
+	});
+	if (!valid) {
+		loaded.clear();
+		file.close();
+		return false;
+	}
 
-			// load vertex positions
-			{
-				fastgltf::Accessor& posAccessor = gltf.accessors[p.findAttribute("POSITION")->accessorIndex];
-				vertices.resize(vertices.size() + posAccessor.count);
-
-				fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf, posAccessor,
-					[&](glm::vec3 v, size_t index) {
-						Vertex newvtx;
-						newvtx.position = v;
-						newvtx.normal = { 1, 0, 0 };
-						newvtx.color = glm::vec4{ 1.f };
-						newvtx.uv_x = 0;
-						newvtx.uv_y = 0;
-						vertices[initial_vtx + index] = newvtx;
-					});
-			}
+	// the cpu copies of the occluders come from decoding their streams, indices back to 32 bits into the whole mesh
+	// and positions dequantized. every index belongs to exactly one surface or level. the rest is only decoded on the gpu
+	std::vector<CompactVertex> compactVertices;
+	for (LoadedMesh& mesh : loaded) {
+		mesh.asset.occluder = selectOccluder && selectOccluder(mesh.asset.name);
+		if (!mesh.asset.occluder) {
+			continue;
+		}
 
-			// load vertex normals
-			auto normals = p.findAttribute("NORMAL");
-			if (normals != p.attributes.end()) {
+		mesh.asset.cpuIndices.resize(mesh.indexStream.count);
+		meshcodec::decode_indices(mesh.indexStream, mesh.asset.cpuIndices.data());
 
-				fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf, gltf.accessors[(*normals).accessorIndex],
-					[&](glm::vec3 v, size_t index) {
-						vertices[initial_vtx + index].normal = v;
-					});
+		auto rebase = [&](const GeoSurface& range) {
+			for (uint32_t i = range.startIndex; i < range.startIndex + range.count; i++) {
+				mesh.asset.cpuIndices[i] += range.vertexOffset;
 			}
+		};
+		for (const GeoSurface& surface : mesh.asset.surfaces) {
+			rebase(surface);
+		}
+		for (const GeoSurface& lod : mesh.asset.lods) {
+			rebase(lod);
+		}
 
-			// load UVs
-			auto uv = p.findAttribute("TEXCOORD_0");
-			if (uv != p.attributes.end()) {
+		compactVertices.resize(mesh.vertexStream.count);
+		meshcodec::decode_vertices(mesh.vertexStream, sizeof(CompactVertex) / sizeof(uint16_t), (uint16_t*)compactVertices.data());
 
-				fastgltf::iterateAccessorWithIndex<glm::vec2>(gltf, gltf.accessors[(*uv).accessorIndex],
-					[&](glm::vec2 v, size_t index) {
-						vertices[initial_vtx + index].uv_x = v.x;
-						vertices[initial_vtx + index].uv_y = v.y;
-					});
-			}
+		mesh.asset.cpuPositions.resize(compactVertices.size());
+		for (size_t v = 0; v < compactVertices.size(); v++) {
+			const uint16_t* position = compactVertices[v].position;
+			glm::vec3 unorm(position[0] / 65535.f, position[1] / 65535.f, position[2] / 65535.f);
+			mesh.asset.cpuPositions[v] = mesh.positionOffset + unorm * mesh.positionScale;
+		}
 
-			// load vertex colors
-			auto colors = p.findAttribute("COLOR_0");
-			if (colors != p.attributes.end()) {
+		// the rasterizer looks the positions up by these
+		size_t vertexCount = mesh.asset.cpuPositions.size();
+		if (std::any_of(mesh.asset.cpuIndices.begin(), mesh.asset.cpuIndices.end(), [&](uint32_t index) { return index >= vertexCount; })) {
+			loaded.clear();
+			file.close();
+			return false;
+		}
+	}
 
-				fastgltf::iterateAccessorWithIndex<glm::vec4>(gltf, gltf.accessors[(*colors).accessorIndex],
-					[&](glm::vec4 v, size_t index) {
-						vertices[initial_vtx + index].color = v;
-					});
-			}
-			newmesh.surfaces.push_back(newSurface);
+	return true;
+}
+
+std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(VulkanEngine* engine, std::filesystem::path filePath,
+	const MeshFormatSelector& selectFormat, const OccluderSelector& selectOccluder) {
+
+	// compact meshes are cooked once into a cache next to the file, later loads skip the parsing and processing
+	std::filesystem::path cachePath = filePath;
+	cachePath += ".meshcache";
+
+	std::vector<LoadedMesh> loaded;
+	// holds the streams of cached meshes until the upload below has copied them to staging
+	MappedFile cacheFile;
+
+	auto cacheStart = std::chrono::high_resolution_clock::now();
+	if (read_mesh_cache(cachePath, filePath, selectFormat, selectOccluder, cacheFile, loaded)) {
+		size_t compressedBytes = 0;
+		for (const LoadedMesh& mesh : loaded) {
+			compressedBytes += mesh.indexStream.size_bytes() + mesh.vertexStream.size_bytes() + mesh.meshletStream.size_bytes();
+		}
+		float cacheMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - cacheStart).count();
+		fmt::print("Loaded {} meshes from {} in {:.1f} ms, {:.1f} KB compressed\n", loaded.size(), cachePath.string(), cacheMs, compressedBytes / 1024.0);
+	}
+	else {
+		if (!load_gltf_file(filePath, selectFormat, selectOccluder, loaded)) {
+			return {};
+		}
+		if (std::all_of(loaded.begin(), loaded.end(), [](const LoadedMesh& mesh) { return mesh.compact; })) {
+			write_mesh_cache(cachePath, filePath, loaded);
 		}
+	}
 
-		// display the vertex normals
-		constexpr bool OverrideColors = true;
-		if (OverrideColors) {
-			for (Vertex& vtx : vertices) {
-				vtx.color = glm::vec4(vtx.normal, 1.f);
-			}
+	// every mesh goes up in the same batch, full ones with the cpu positions as their position stream
+	std::vector<MeshUpload> uploads(loaded.size());
+	for (size_t m = 0; m < loaded.size(); m++) {
+		LoadedMesh& mesh = loaded[m];
+		MeshUpload& upload = uploads[m];
+		upload.meshlets = mesh.meshlets;
+
+		if (!mesh.compact) {
+			upload.indexData = std::as_bytes(std::span(mesh.indices));
+			upload.vertexData = std::as_bytes(std::span(mesh.vertices));
+			upload.positionData = std::as_bytes(std::span(mesh.asset.cpuPositions));
 		}
+		else {
+			// the first two words of every vertex are the position stream
+			upload.encoded = true;
+			upload.encodedIndices = mesh.indexStream;
+			upload.encodedVertices = mesh.vertexStream;
+			upload.encodedMeshlets = mesh.meshletStream;
+			upload.vertexSize = sizeof(CompactVertex);
+			upload.positionSize = 2 * sizeof(uint32_t);
+			upload.indexType = mesh.indexType;
+		}
+	}
 
+	auto uploadStart = std::chrono::high_resolution_clock::now();
+	std::vector<GPUMeshBuffers> buffers = engine->uploadMeshes(uploads);
+	float uploadMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - uploadStart).count();
+	fmt::print("Uploaded {} meshes in {:.1f} ms\n", loaded.size(), uploadMs);
 
-		newmesh.meshBuffers = engine->uploadMesh(indices, vertices);
+	std::vector<std::shared_ptr<MeshAsset>> meshes;
+	for (size_t m = 0; m < loaded.size(); m++) {
+		LoadedMesh& mesh = loaded[m];
+		mesh.asset.meshBuffers = buffers[m];
+		// full meshes kept their positions for the upload
+		if (!mesh.asset.occluder) {
+			mesh.asset.cpuPositions = {};
+		}
+		if (mesh.compact) {
+			mesh.asset.meshBuffers.vertexFormat = VertexFormat::Compact;
+			mesh.asset.meshBuffers.positionOffset = glm::vec4(mesh.positionOffset, 0.f);
+			mesh.asset.meshBuffers.positionScale = glm::vec4(mesh.positionScale, 0.f);
+		}
 
-		meshes.emplace_back(std::make_shared<MeshAsset>(std::move(newmesh)));
+		meshes.emplace_back(std::make_shared<MeshAsset>(std::move(mesh.asset)));
 
 		auto& meshPtr = meshes.back();
 
 		engine->mainDeletionQueue.push_mesh_buffer_deletion(meshPtr);
-		
 	}
 
 	return meshes;
 
-}
\ No newline at end of file
+}
@@ -7,6 +7,18 @@ class VulkanEngine;
 struct GeoSurface {
 	uint32_t startIndex;
 	uint32_t count;
+	Bounds bounds;
+	// range of the mesh meshlet buffer covering the surface
+	uint32_t firstMeshlet = 0;
+	uint32_t meshletCount = 0;
+	// added to every index, nonzero when the mesh has 16 bit indices relative to the surface
+	uint32_t vertexOffset = 0;
+	bool doubleSided = false;
+	// simplified versions in MeshAsset::lods, each coarser than the one before
+	uint32_t firstLod = 0;
+	uint32_t lodCount = 0;
+	// how far the range strays from the full surface, in object space. 0 for the full surface
+	float lodError = 0.f;
 };
 
 
@@ -14,8 +26,26 @@ struct MeshAsset {
 	std::string name;
 
 	std::vector<GeoSurface> surfaces;
+	// levels of detail of the surfaces, extra ranges of the same index buffer
+	std::vector<GeoSurface> lods;
 	GPUMeshBuffers meshBuffers;
+
+	// positions and indices kept on the cpu for the software occlusion rasterizer, empty unless the mesh is an occluder
+	std::vector<glm::vec3> cpuPositions;
+	std::vector<uint32_t> cpuIndices;
+	// drawn into the occlusion depth buffer, meant for large closed meshes. picked when the mesh is loaded
+	bool occluder = false;
 };
 
 
-std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(VulkanEngine* engine, std::filesystem::path filePath);
\ No newline at end of file
+// picks the vertex format of a mesh by its name, called once per mesh on the loading thread
+using MeshFormatSelector = std::function<VertexFormat(std::string_view meshName)>;
+// picks the meshes the software occlusion rasterizes, only those keep their positions and indices on the cpu
+using OccluderSelector = std::function<bool(std::string_view meshName)>;
+
+// compact meshes upload CompactVertex and, where every surface spans less than 65536 vertices, 16 bit indices.
+// they are compressed, cached next to the file as <file>.meshcache and decoded on the gpu at upload. the cache
+// only holds compact meshes, it is skipped while selectFormat asks for any full one.
+// without a selector every mesh is compact, and none is an occluder
+std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(VulkanEngine* engine, std::filesystem::path filePath,
+	const MeshFormatSelector& selectFormat = {}, const OccluderSelector& selectOccluder = {});
\ No newline at end of file
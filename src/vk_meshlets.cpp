@@ -0,0 +1,182 @@
+#include "vk_meshlets.h"
+#include <algorithm>
+#include <cmath>
+
+
+// bounds and cone of the triangles in indices, which already hold the meshlet in its final order
+static GPUMeshlet finish_meshlet(const std::vector<glm::vec3>& positions, const uint32_t* indices, uint32_t indexCount, uint32_t firstIndex, uint32_t vertexCount) {
+
+	GPUMeshlet meshlet{};
+	meshlet.firstIndex = firstIndex;
+	meshlet.indexCount = indexCount;
+	meshlet.vertexCount = vertexCount;
+
+	glm::vec3 minpos = positions[indices[0]];
+	glm::vec3 maxpos = positions[indices[0]];
+	for (uint32_t i = 1; i < indexCount; i++) {
+		minpos = glm::min(minpos, positions[indices[i]]);
+		maxpos = glm::max(maxpos, positions[indices[i]]);
+	}
+
+	glm::vec3 center = (minpos + maxpos) / 2.f;
+	float radius = 0.f;
+	for (uint32_t i = 0; i < indexCount; i++) {
+		radius = std::max(radius, glm::length(positions[indices[i]] - center));
+	}
+	meshlet.sphere = glm::vec4(center, radius);
+
+	// the axis is the average facing, the cone has to open wide enough for the normal furthest from it
+	glm::vec3 normals[meshlets::maxTriangles];
+	uint32_t normalCount = 0;
+	glm::vec3 axis{ 0.f };
+	for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+		glm::vec3 a = positions[indices[i]];
+		glm::vec3 b = positions[indices[i + 1]];
+		glm::vec3 c = positions[indices[i + 2]];
+
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		float area = glm::length(normal);
+		if (area <= 0.f) {
+			continue;
+		}
+
+		normals[normalCount] = normal / area;
+		axis += normals[normalCount];
+		normalCount++;
+	}
+
+	// facing every way, or no facing at all, nothing can be culled by the cone
+	meshlet.cone = glm::vec4(0.f, 0.f, 1.f, 1.f);
+
+	float axisLength = glm::length(axis);
+	if (normalCount == 0 || axisLength <= 0.f) {
+		return meshlet;
+	}
+	axis /= axisLength;
+
+	float minDot = 1.f;
+	for (uint32_t n = 0; n < normalCount; n++) {
+		minDot = std::min(minDot, glm::dot(axis, normals[n]));
+	}
+
+	// a cone of half angle a hides every triangle once the view direction is within 90 - a of the axis,
+	// the shader compares the cosine of that against sin(a)
+	if (minDot > 0.f) {
+		meshlet.cone = glm::vec4(axis, std::sqrt(1.f - minDot * minDot));
+	}
+	return meshlet;
+}
+
+void meshlets::build(const std::vector<glm::vec3>& positions, uint32_t* indices, uint32_t indexCount, uint32_t firstIndex, std::vector<GPUMeshlet>& meshlets) {
+
+	uint32_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// the surface only uses a range of the vertices, the tables below are indexed relative to it
+	uint32_t minVertex = *std::min_element(indices, indices + triangleCount * 3);
+	uint32_t maxVertex = *std::max_element(indices, indices + triangleCount * 3);
+	uint32_t vertexRange = maxVertex - minVertex + 1;
+
+	// triangles around every vertex, as offsets into one flat list
+	std::vector<uint32_t> adjacencyOffsets(vertexRange + 1, 0);
+	for (uint32_t i = 0; i < triangleCount * 3; i++) {
+		adjacencyOffsets[indices[i] - minVertex + 1]++;
+	}
+	for (uint32_t v = 0; v < vertexRange; v++) {
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	}
+
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	std::vector<uint32_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (uint32_t i = 0; i < triangleCount * 3; i++) {
+		adjacency[adjacencyFill[indices[i] - minVertex]++] = i / 3;
+	}
+
+	std::vector<bool> emitted(triangleCount, false);
+	// the meshlet a vertex was last added to, numbered from 1 so 0 is none
+	std::vector<uint32_t> vertexMeshlet(vertexRange, 0);
+	std::vector<uint32_t> reordered;
+	reordered.reserve(triangleCount * 3);
+
+	uint32_t meshletId = 1;
+	uint32_t meshletStart = 0;
+	uint32_t meshletTriangles = 0;
+	std::vector<uint32_t> meshletVertices;
+	meshletVertices.reserve(maxVertices);
+	uint32_t scan = 0;
+
+	// vertices the triangle would add to the current meshlet
+	auto new_vertices = [&](uint32_t triangle) {
+		uint32_t count = 0;
+		for (uint32_t k = 0; k < 3; k++) {
+			uint32_t v = indices[triangle * 3 + k];
+			bool repeated = (k > 0 && v == indices[triangle * 3]) || (k > 1 && v == indices[triangle * 3 + 1]);
+			if (!repeated && vertexMeshlet[v - minVertex] != meshletId) {
+				count++;
+			}
+		}
+		return count;
+	};
+
+	auto flush = [&]() {
+		uint32_t count = (uint32_t)reordered.size() - meshletStart;
+		if (count > 0) {
+			meshlets.push_back(finish_meshlet(positions, reordered.data() + meshletStart, count, firstIndex + meshletStart, (uint32_t)meshletVertices.size()));
+		}
+		meshletStart = (uint32_t)reordered.size();
+		meshletTriangles = 0;
+		meshletVertices.clear();
+		meshletId++;
+	};
+
+	for (uint32_t added = 0; added < triangleCount; added++) {
+
+		// grow through shared vertices, the neighbour adding the fewest new vertices keeps the cluster compact
+		uint32_t best = UINT32_MAX;
+		uint32_t bestCost = UINT32_MAX;
+		for (uint32_t v : meshletVertices) {
+			for (uint32_t a = adjacencyOffsets[v - minVertex]; a < adjacencyOffsets[v - minVertex + 1] && bestCost > 0; a++) {
+				uint32_t triangle = adjacency[a];
+				if (emitted[triangle]) {
+					continue;
+				}
+
+				uint32_t cost = new_vertices(triangle);
+				if (cost < bestCost) {
+					best = triangle;
+					bestCost = cost;
+				}
+			}
+		}
+
+		// nothing connected left, the next triangle in the original order starts over
+		if (best == UINT32_MAX) {
+			while (emitted[scan]) {
+				scan++;
+			}
+			best = scan;
+			bestCost = new_vertices(best);
+		}
+
+		if (meshletVertices.size() + bestCost > maxVertices || meshletTriangles + 1 > maxTriangles) {
+			flush();
+		}
+
+		for (uint32_t k = 0; k < 3; k++) {
+			uint32_t v = indices[best * 3 + k];
+			reordered.push_back(v);
+			if (vertexMeshlet[v - minVertex] != meshletId) {
+				vertexMeshlet[v - minVertex] = meshletId;
+				meshletVertices.push_back(v);
+			}
+		}
+		meshletTriangles++;
+		emitted[best] = true;
+	}
+
+	flush();
+
+	std::copy(reordered.begin(), reordered.end(), indices);
+}
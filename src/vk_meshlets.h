@@ -0,0 +1,15 @@
+#pragma once
+#include "vk_types.h"
+
+// small clusters of a surface that can be culled on their own. the builder reorders the triangles of the surface
+// so every meshlet is one contiguous range of the index buffer and can be drawn with a plain indexed draw
+namespace meshlets {
+
+	// the usual mesh shader limits, the clusters fit one workgroup if a mesh shader path ever draws them
+	inline constexpr uint32_t maxVertices = 64;
+	inline constexpr uint32_t maxTriangles = 124;
+
+	// indices is the range of one surface and firstIndex where that range starts in the mesh index buffer.
+	// the meshlets are appended with object space bounds and normal cones
+	void build(const std::vector<glm::vec3>& positions, uint32_t* indices, uint32_t indexCount, uint32_t firstIndex, std::vector<GPUMeshlet>& meshlets);
+}
@@ -0,0 +1,254 @@
+#include "vk_meshorder.h"
+#include <algorithm>
+
+
+void meshorder::optimize_vertex_cache(uint32_t* indices, uint32_t indexCount) {
+
+	uint32_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// the tables are indexed relative to the vertex range the triangles use
+	uint32_t minVertex = *std::min_element(indices, indices + triangleCount * 3);
+	uint32_t maxVertex = *std::max_element(indices, indices + triangleCount * 3);
+	uint32_t vertexRange = maxVertex - minVertex + 1;
+
+	// triangles around every vertex, live counts the ones not emitted yet
+	std::vector<uint32_t> adjacencyOffsets(vertexRange + 1, 0);
+	for (uint32_t i = 0; i < triangleCount * 3; i++) {
+		adjacencyOffsets[indices[i] - minVertex + 1]++;
+	}
+	for (uint32_t v = 0; v < vertexRange; v++) {
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	}
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	std::vector<uint32_t> live(vertexRange);
+	{
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (uint32_t i = 0; i < triangleCount * 3; i++) {
+			adjacency[fill[indices[i] - minVertex]++] = i / 3;
+		}
+	}
+	for (uint32_t v = 0; v < vertexRange; v++) {
+		live[v] = adjacencyOffsets[v + 1] - adjacencyOffsets[v];
+	}
+
+	std::vector<uint32_t> cacheTime(vertexRange, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> result;
+	result.reserve(triangleCount * 3);
+
+	uint32_t timestamp = cacheSize + 1;
+	uint32_t scan = 0;
+	uint32_t fanning = indices[0] - minVertex;
+
+	while (fanning != UINT32_MAX) {
+
+		// every triangle left around the fanning vertex, their vertices are the candidates for the next one
+		candidates.clear();
+		for (uint32_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++) {
+			uint32_t triangle = adjacency[a];
+			if (emitted[triangle]) {
+				continue;
+			}
+
+			for (uint32_t k = 0; k < 3; k++) {
+				uint32_t v = indices[triangle * 3 + k] - minVertex;
+				result.push_back(v + minVertex);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+
+				// not in the cache anymore, loading it pushes it to the front
+				if (timestamp - cacheTime[v] > cacheSize) {
+					cacheTime[v] = timestamp++;
+				}
+			}
+			emitted[triangle] = true;
+		}
+
+		// the candidate that is still in the cache when all its triangles would be emitted, oldest first so
+		// it is used before it drops out
+		uint32_t best = UINT32_MAX;
+		int bestPriority = -1;
+		for (uint32_t v : candidates) {
+			if (live[v] == 0) {
+				continue;
+			}
+
+			int priority = 0;
+			if (timestamp - cacheTime[v] + 2 * live[v] <= cacheSize) {
+				priority = (int)(timestamp - cacheTime[v]);
+			}
+			if (priority > bestPriority) {
+				best = v;
+				bestPriority = priority;
+			}
+		}
+
+		// nothing around, go back through the recently used vertices and then through everything in order
+		while (best == UINT32_MAX && !deadEnd.empty()) {
+			uint32_t v = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[v] > 0) {
+				best = v;
+			}
+		}
+		while (best == UINT32_MAX && scan < vertexRange) {
+			if (live[scan] > 0) {
+				best = scan;
+			}
+			scan++;
+		}
+
+		fanning = best;
+	}
+
+	std::copy(result.begin(), result.end(), indices);
+}
+
+void meshorder::optimize_overdraw(const std::vector<glm::vec3>& positions, uint32_t* indices, uint32_t indexCount) {
+
+	uint32_t triangleCount = indexCount / 3;
+	if (triangleCount < 2) {
+		return;
+	}
+
+	struct Cluster {
+		uint32_t firstTriangle;
+		uint32_t triangleCount;
+		float sortKey;
+	};
+
+	// a triangle missing the cache with all three vertices is where the order jumped to somewhere new,
+	// pieces split there can move around without costing the cache much
+	std::vector<Cluster> clusters;
+	{
+		std::vector<uint32_t> fifo(cacheSize, UINT32_MAX);
+		uint32_t fifoHead = 0;
+
+		for (uint32_t t = 0; t < triangleCount; t++) {
+			uint32_t misses = 0;
+			for (uint32_t k = 0; k < 3; k++) {
+				uint32_t v = indices[t * 3 + k];
+				if (std::find(fifo.begin(), fifo.end(), v) == fifo.end()) {
+					fifo[fifoHead] = v;
+					fifoHead = (fifoHead + 1) % cacheSize;
+					misses++;
+				}
+			}
+
+			if (t == 0 || misses == 3) {
+				clusters.push_back({ t, 0, 0.f });
+			}
+			clusters.back().triangleCount++;
+		}
+	}
+
+	if (clusters.size() < 2) {
+		return;
+	}
+
+	// area weighted centroid of the whole range and of every cluster
+	glm::vec3 meshCentroid{ 0.f };
+	float meshArea = 0.f;
+	std::vector<glm::vec3> clusterCentroids(clusters.size(), glm::vec3{ 0.f });
+	std::vector<glm::vec3> clusterNormals(clusters.size(), glm::vec3{ 0.f });
+	std::vector<float> clusterAreas(clusters.size(), 0.f);
+
+	for (size_t c = 0; c < clusters.size(); c++) {
+		for (uint32_t t = clusters[c].firstTriangle; t < clusters[c].firstTriangle + clusters[c].triangleCount; t++) {
+			glm::vec3 a = positions[indices[t * 3]];
+			glm::vec3 b = positions[indices[t * 3 + 1]];
+			glm::vec3 d = positions[indices[t * 3 + 2]];
+
+			glm::vec3 normal = glm::cross(b - a, d - a);
+			float area = glm::length(normal);
+			glm::vec3 centroid = (a + b + d) / 3.f;
+
+			clusterCentroids[c] += centroid * area;
+			clusterNormals[c] += normal;
+			clusterAreas[c] += area;
+		}
+
+		meshCentroid += clusterCentroids[c];
+		meshArea += clusterAreas[c];
+	}
+
+	if (meshArea <= 0.f) {
+		return;
+	}
+	meshCentroid /= meshArea;
+
+	for (size_t c = 0; c < clusters.size(); c++) {
+		if (clusterAreas[c] <= 0.f) {
+			continue;
+		}
+
+		glm::vec3 centroid = clusterCentroids[c] / clusterAreas[c];
+		float normalLength = glm::length(clusterNormals[c]);
+		if (normalLength > 0.f) {
+			clusters[c].sortKey = glm::dot(centroid - meshCentroid, clusterNormals[c] / normalLength);
+		}
+	}
+
+	// outermost first, ties keep the cache order
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& l, const Cluster& r) { return l.sortKey > r.sortKey; });
+
+	std::vector<uint32_t> result;
+	result.reserve(triangleCount * 3);
+	for (const Cluster& cluster : clusters) {
+		result.insert(result.end(), indices + cluster.firstTriangle * 3, indices + (cluster.firstTriangle + cluster.triangleCount) * 3);
+	}
+
+	std::copy(result.begin(), result.end(), indices);
+}
+
+void meshorder::optimize_vertex_fetch(std::vector<uint32_t>& indices, std::vector<Vertex>& vertices) {
+
+	std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+
+	for (uint32_t& index : indices) {
+		if (remap[index] == UINT32_MAX) {
+			remap[index] = (uint32_t)reordered.size();
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	// nothing draws them, kept so the vertex count stays what the file had
+	for (size_t v = 0; v < vertices.size(); v++) {
+		if (remap[v] == UINT32_MAX) {
+			reordered.push_back(vertices[v]);
+		}
+	}
+
+	vertices = std::move(reordered);
+}
+
+float meshorder::acmr(const uint32_t* indices, uint32_t indexCount) {
+
+	uint32_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) {
+		return 0.f;
+	}
+
+	std::vector<uint32_t> fifo(cacheSize, UINT32_MAX);
+	uint32_t fifoHead = 0;
+	uint32_t misses = 0;
+
+	for (uint32_t i = 0; i < triangleCount * 3; i++) {
+		if (std::find(fifo.begin(), fifo.end(), indices[i]) == fifo.end()) {
+			fifo[fifoHead] = indices[i];
+			fifoHead = (fifoHead + 1) % cacheSize;
+			misses++;
+		}
+	}
+
+	return (float)misses / triangleCount;
+}
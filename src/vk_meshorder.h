@@ -0,0 +1,23 @@
+#pragma once
+#include "vk_types.h"
+
+// load time reordering of the index and vertex buffers. triangles are ordered for the post transform cache and
+// then for overdraw, vertices are renumbered in the order the triangles first use them so fetches stay local
+namespace meshorder {
+
+	// the fifo size the orders are tuned for and the acmr is measured with, about what current gpus reuse
+	inline constexpr uint32_t cacheSize = 16;
+
+	// tipsify, reorders the triangles of the range in place
+	void optimize_vertex_cache(uint32_t* indices, uint32_t indexCount);
+
+	// splits a cache optimized range where the order jumps and sorts the pieces so the ones facing away from
+	// the middle of the mesh go first, they tend to hide the rest
+	void optimize_overdraw(const std::vector<glm::vec3>& positions, uint32_t* indices, uint32_t indexCount);
+
+	// renumbers the vertices in the order the indices first reference them, unreferenced ones go last
+	void optimize_vertex_fetch(std::vector<uint32_t>& indices, std::vector<Vertex>& vertices);
+
+	// average cache misses per triangle with a fifo of cacheSize, 0.5 is the best a regular grid can get
+	float acmr(const uint32_t* indices, uint32_t indexCount);
+}
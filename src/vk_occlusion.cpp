@@ -0,0 +1,273 @@
+#include "vk_occlusion.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <immintrin.h>
+
+// points closer than this to the camera plane dont project to anything useful
+static constexpr float minW = 1e-5f;
+
+
+SoftwareOcclusion::SoftwareOcclusion() {
+	worker = std::thread(&SoftwareOcclusion::worker_loop, this);
+}
+
+SoftwareOcclusion::~SoftwareOcclusion() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	startCondition.notify_one();
+	worker.join();
+}
+
+void SoftwareOcclusion::resize(uint32_t newWidth, uint32_t newHeight) {
+
+	newWidth = std::clamp((newWidth + 3) & ~3u, 4u, maxWidth);
+	newHeight = std::clamp(newHeight, 1u, maxHeight);
+
+	if (newWidth == width && newHeight == height) {
+		return;
+	}
+
+	// the worker might still be writing the old buffer
+	wait();
+
+	width = newWidth;
+	height = newHeight;
+	depth.assign((size_t)width * height, 0.f);
+}
+
+void SoftwareOcclusion::start(const glm::mat4& newViewproj, std::vector<Occluder>&& newOccluders, std::vector<Candidate>&& newCandidates) {
+
+	wait();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		viewproj = newViewproj;
+		occluders = std::move(newOccluders);
+		candidates = std::move(newCandidates);
+		pending = true;
+		done = false;
+	}
+	startCondition.notify_one();
+}
+
+const std::vector<uint32_t>& SoftwareOcclusion::wait() {
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [this]() { return done; });
+	return visible;
+}
+
+void SoftwareOcclusion::worker_loop() {
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			startCondition.wait(lock, [this]() { return pending || quit; });
+			if (quit) {
+				return;
+			}
+			pending = false;
+		}
+
+		run();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done = true;
+		}
+		doneCondition.notify_all();
+	}
+}
+
+void SoftwareOcclusion::run() {
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// cleared to the far plane, reverse z
+	std::fill(depth.begin(), depth.end(), 0.f);
+
+	stats = {};
+	for (const Occluder& occluder : occluders) {
+		rasterize(occluder);
+		stats.occluderTriangles += occluder.indexCount / 3;
+	}
+
+	auto rasterized = std::chrono::high_resolution_clock::now();
+
+	visible.clear();
+	for (const Candidate& candidate : candidates) {
+		if (is_visible(candidate)) {
+			visible.push_back(candidate.id);
+		}
+	}
+
+	auto tested = std::chrono::high_resolution_clock::now();
+
+	stats.tested = (uint32_t)candidates.size();
+	stats.occluded = stats.tested - (uint32_t)visible.size();
+	stats.rasterMs = std::chrono::duration<float, std::milli>(rasterized - start).count();
+	stats.testMs = std::chrono::duration<float, std::milli>(tested - rasterized).count();
+}
+
+void SoftwareOcclusion::rasterize(const Occluder& occluder) {
+
+	glm::mat4 mvp = viewproj * occluder.transform;
+
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (uint32_t t = 0; t + 2 < occluder.indexCount; t += 3) {
+
+		glm::vec3 screen[3];
+		bool clipped = false;
+		for (int k = 0; k < 3; k++) {
+			glm::vec4 clip = mvp * glm::vec4(occluder.positions[occluder.indices[t + k]], 1.f);
+
+			// no near clipping, a triangle reaching past the near plane is left out which only makes the occluder smaller
+			if (clip.w <= minW || clip.z > clip.w) {
+				clipped = true;
+				break;
+			}
+
+			screen[k] = glm::vec3((clip.x / clip.w * 0.5f + 0.5f) * width, (clip.y / clip.w * 0.5f + 0.5f) * height, clip.z / clip.w);
+		}
+		if (clipped) {
+			continue;
+		}
+
+		// both windings are drawn, the front faces of a closed mesh win the max anyway
+		float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[1].y - screen[0].y) * (screen[2].x - screen[0].x);
+		if (std::abs(area) < 1e-8f) {
+			continue;
+		}
+		if (area < 0.f) {
+			std::swap(screen[1], screen[2]);
+			area = -area;
+		}
+
+		float minX = std::min({ screen[0].x, screen[1].x, screen[2].x });
+		float maxX = std::max({ screen[0].x, screen[1].x, screen[2].x });
+		float minY = std::min({ screen[0].y, screen[1].y, screen[2].y });
+		float maxY = std::max({ screen[0].y, screen[1].y, screen[2].y });
+
+		int x0 = std::max((int)std::floor(minX), 0) & ~3;
+		int x1 = std::min((int)std::ceil(maxX), (int)width - 1);
+		int y0 = std::max((int)std::floor(minY), 0);
+		int y1 = std::min((int)std::ceil(maxY), (int)height - 1);
+		if (x0 > x1 || y0 > y1) {
+			continue;
+		}
+
+		// edge k goes from vertex k to the next one, a*x + b*y + c is positive on the inside. pixels are sampled at
+		// their center, requiring full coverage would open cracks along every edge shared inside the mesh
+		float a[3], b[3], c[3];
+		for (int k = 0; k < 3; k++) {
+			const glm::vec3& from = screen[k];
+			const glm::vec3& to = screen[(k + 1) % 3];
+			a[k] = -(to.y - from.y);
+			b[k] = to.x - from.x;
+			c[k] = -(a[k] * from.x + b[k] * from.y);
+		}
+
+		// the edge opposite a vertex weights it, z is a plane in screen space
+		float dzdx = (a[1] * screen[0].z + a[2] * screen[1].z + a[0] * screen[2].z) / area;
+		float dzdy = (b[1] * screen[0].z + b[2] * screen[1].z + b[0] * screen[2].z) / area;
+		float z0 = screen[0].z - dzdx * screen[0].x - dzdy * screen[0].y;
+		// the farthest depth inside the pixel, so the occluder never reaches nearer than it really is
+		z0 -= 0.5f * (std::abs(dzdx) + std::abs(dzdy));
+
+		__m128 edgeA[3] = { _mm_set1_ps(a[0]), _mm_set1_ps(a[1]), _mm_set1_ps(a[2]) };
+		__m128 depthX = _mm_set1_ps(dzdx);
+
+		for (int y = y0; y <= y1; y++) {
+			float py = y + 0.5f;
+
+			__m128 edgeRow[3];
+			for (int k = 0; k < 3; k++) {
+				edgeRow[k] = _mm_set1_ps(b[k] * py + c[k]);
+			}
+			__m128 depthRow = _mm_set1_ps(dzdy * py + z0);
+
+			float* row = &depth[(size_t)y * width];
+
+			// the rows are a whole number of registers, lanes past x1 are outside the triangle
+			for (int x = x0; x <= x1; x += 4) {
+				__m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], px), edgeRow[0]), zero);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], px), edgeRow[1]), zero));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], px), edgeRow[2]), zero));
+
+				if (_mm_movemask_ps(inside) == 0) {
+					continue;
+				}
+
+				__m128 z = _mm_add_ps(_mm_mul_ps(depthX, px), depthRow);
+				__m128 old = _mm_loadu_ps(row + x);
+				__m128 nearest = _mm_max_ps(old, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+			}
+		}
+	}
+}
+
+bool SoftwareOcclusion::is_visible(const Candidate& candidate) const {
+
+	glm::mat4 mvp = viewproj * candidate.transform;
+
+	float minX = FLT_MAX, minY = FLT_MAX;
+	float maxX = -FLT_MAX, maxY = -FLT_MAX;
+	float nearest = 0.f;
+
+	for (int i = 0; i < 8; i++) {
+		glm::vec3 corner = candidate.bounds.origin + candidate.bounds.extents * glm::vec3((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : -1.f);
+		glm::vec4 clip = mvp * glm::vec4(corner, 1.f);
+
+		// reaches the camera, nothing to compare against
+		if (clip.w <= minW || clip.z > clip.w) {
+			return true;
+		}
+
+		float x = (clip.x / clip.w * 0.5f + 0.5f) * width;
+		float y = (clip.y / clip.w * 0.5f + 0.5f) * height;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		nearest = std::max(nearest, clip.z / clip.w);
+	}
+
+	int x0 = std::max((int)std::floor(minX), 0);
+	int x1 = std::min((int)std::ceil(maxX), (int)width - 1);
+	int y0 = std::max((int)std::floor(minY), 0);
+	int y1 = std::min((int)std::ceil(maxY), (int)height - 1);
+
+	// off screen, the frustum test decides those
+	if (x0 > x1 || y0 > y1) {
+		return true;
+	}
+
+	const __m128 laneOffsets = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+	const __m128 first = _mm_set1_ps((float)x0);
+	const __m128 last = _mm_set1_ps((float)x1);
+	const __m128 boxDepth = _mm_set1_ps(nearest);
+
+	for (int y = y0; y <= y1; y++) {
+		const float* row = &depth[(size_t)y * width];
+
+		for (int x = x0 & ~3; x <= x1; x += 4) {
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+			__m128 inRange = _mm_and_ps(_mm_cmpge_ps(px, first), _mm_cmple_ps(px, last));
+
+			// any pixel where nothing drawn is nearer than the box lets it through
+			__m128 open = _mm_and_ps(inRange, _mm_cmple_ps(_mm_loadu_ps(row + x), boxDepth));
+			if (_mm_movemask_ps(open) != 0) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
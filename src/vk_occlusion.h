@@ -0,0 +1,82 @@
+#pragma once
+#include "vk_types.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// low resolution depth buffer rasterized on the cpu from a few large occluders, boxes that end up fully behind it
+// are dropped before their draws are recorded. reverse z like the gpu, the buffer keeps the nearest (largest) depth.
+// the work runs on its own thread, start() hands it a frame and wait() collects the result
+class SoftwareOcclusion {
+public:
+
+	static constexpr uint32_t maxWidth = 512;
+	static constexpr uint32_t maxHeight = 512;
+
+	// a range of an indexed triangle list, the indices point into positions
+	struct Occluder {
+		const glm::vec3* positions;
+		const uint32_t* indices;
+		uint32_t indexCount;
+		glm::mat4 transform;
+	};
+
+	// object space box, id is handed back if the box is visible
+	struct Candidate {
+		uint32_t id;
+		Bounds bounds;
+		glm::mat4 transform;
+	};
+
+	struct Stats {
+		uint32_t occluderTriangles = 0;
+		uint32_t tested = 0;
+		uint32_t occluded = 0;
+		float rasterMs = 0.f;
+		float testMs = 0.f;
+	};
+
+	SoftwareOcclusion();
+	~SoftwareOcclusion();
+
+	SoftwareOcclusion(const SoftwareOcclusion&) = delete;
+	SoftwareOcclusion& operator=(const SoftwareOcclusion&) = delete;
+
+	// the width is rounded up to a multiple of 4 so a row is whole sse registers
+	void resize(uint32_t width, uint32_t height);
+
+	// the occluders point at mesh data that has to outlive the job
+	void start(const glm::mat4& viewproj, std::vector<Occluder>&& occluders, std::vector<Candidate>&& candidates);
+	// ids of the visible candidates in the order they were given, valid until the next start
+	const std::vector<uint32_t>& wait();
+
+	// only meaningful after wait
+	const std::vector<float>& get_depth() const { return depth; }
+	uint32_t get_width() const { return width; }
+	uint32_t get_height() const { return height; }
+	const Stats& get_stats() const { return stats; }
+
+private:
+	void worker_loop();
+	void run();
+	void rasterize(const Occluder& occluder);
+	bool is_visible(const Candidate& candidate) const;
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<float> depth;
+
+	glm::mat4 viewproj{ 1.f };
+	std::vector<Occluder> occluders;
+	std::vector<Candidate> candidates;
+	std::vector<uint32_t> visible;
+	Stats stats;
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable startCondition;
+	std::condition_variable doneCondition;
+	bool pending = false;
+	bool done = true;
+	bool quit = false;
+};
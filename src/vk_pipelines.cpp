@@ -71,15 +71,13 @@ VkPipeline PipelineBuilder::build_pipeline(VkDevice device, RenderMode mode, Pip
 	graphicsResourceConfig->renderMode = mode;
 	
 	if (graphicsResourceConfig->renderMode == RenderMode::Dynamic) {
+		// the render pass stays in the config so the pipeline can be rebuilt for classic rendering later
 		pipelineInfo.renderPass = VK_NULL_HANDLE;
 		pipelineInfo.subpass = 0;
-		graphicsResourceConfig->renderPass = VK_NULL_HANDLE;
 
 		//later implement a more dynamic way to attach formats if for example you need to use only color formats or depth formats using the dynamic render option
 		//it could be a std::optional so the pipline builder doesnt need so many parameters if not neccessary
-		//make sure this works correctly, reminder once you want to add dynamic rendering to sync with classic renderpass
-		//make sure you figure out how to pass depth information correctly from dynamic render pass -> to classic render pass
-		if (graphicsResourceConfig->renderInfo.pColorAttachmentFormats || graphicsResourceConfig->renderInfo.depthAttachmentFormat == VK_FORMAT_UNDEFINED) {
+		if (graphicsResourceConfig->renderInfo.colorAttachmentCount == 0 && graphicsResourceConfig->renderInfo.depthAttachmentFormat == VK_FORMAT_UNDEFINED) {
 			fmt::print("must set the attachments\n");
 		}
 		
@@ -120,8 +118,13 @@ VkPipeline PipelineBuilder::build_pipeline(VkDevice device, RenderMode mode, Pip
 			storeResource->getGraphicsConfig()->dynamicStates = graphicsResourceConfig->dynamicStates;
 			storeResource->getGraphicsConfig()->dynamicStateInfo = graphicsResourceConfig->dynamicStateInfo;
 			storeResource->getGraphicsConfig()->dynamicStateInfo.pDynamicStates = storeResource->getGraphicsConfig()->dynamicStates.data();
+			storeResource->getGraphicsConfig()->colorAttachmentformat = graphicsResourceConfig->colorAttachmentformat;
 			storeResource->getGraphicsConfig()->renderInfo = graphicsResourceConfig->renderInfo;
+			if (graphicsResourceConfig->renderInfo.colorAttachmentCount > 0) {
+				storeResource->getGraphicsConfig()->renderInfo.pColorAttachmentFormats = &storeResource->getGraphicsConfig()->colorAttachmentformat;
+			}
 			storeResource->getGraphicsConfig()->renderPass = graphicsResourceConfig->renderPass;
+			storeResource->getGraphicsConfig()->renderMode = graphicsResourceConfig->renderMode;
 			storeResource->pipelineLayout.layout = res->pipelineLayout.layout;
 			storeResource->pipeline = res->pipeline;
 	}
@@ -141,6 +144,21 @@ void PipelineBuilder::set_shaders(VkShaderModule vertexShader, VkShaderModule fr
 		vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader));
 }
 
+void PipelineBuilder::set_mesh_shaders(VkShaderModule taskShader, VkShaderModule meshShader, VkShaderModule fragmentShader) {
+	auto* graphicsResourceConfig = res->getGraphicsConfig();
+
+	graphicsResourceConfig->shaderStages.clear();
+
+	graphicsResourceConfig->shaderStages.push_back(
+		vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_TASK_BIT_EXT, taskShader));
+
+	graphicsResourceConfig->shaderStages.push_back(
+		vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_MESH_BIT_EXT, meshShader));
+
+	graphicsResourceConfig->shaderStages.push_back(
+		vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader));
+}
+
 void PipelineBuilder::set_renderpass(VkRenderPass renderpass) {
 	auto* graphicsResourceConfig = res->getGraphicsConfig();
 
@@ -193,6 +211,13 @@ void PipelineBuilder::disable_blending() {
 	graphicsResourceConfig->colorBlendAttachment.blendEnable = VK_FALSE;
 }
 
+void PipelineBuilder::disable_color_writes() {
+	auto* graphicsResourceConfig = res->getGraphicsConfig();
+
+	graphicsResourceConfig->colorBlendAttachment.colorWriteMask = 0;
+	graphicsResourceConfig->colorBlendAttachment.blendEnable = VK_FALSE;
+}
+
 void PipelineBuilder::set_color_attachment_format(VkFormat format)
 {
 	auto* graphicsResourceConfig = res->getGraphicsConfig();
@@ -16,10 +16,14 @@ public:
 	VkPipeline build_pipeline(VkDevice device, RenderMode mode,  PipelineResource* storeRes = nullptr);
 
 	void set_shaders(VkShaderModule vertexShader, VkShaderModule fragmentShader);
+	// mesh shading pipelines, the vertex input and input assembly states are ignored for them
+	void set_mesh_shaders(VkShaderModule taskShader, VkShaderModule meshShader, VkShaderModule fragmentShader);
 	void set_polygon_mode(VkPolygonMode mode);
 	void set_cull_mode(VkCullModeFlags cullMode, VkFrontFace frontFace);
 	void set_multisampling_none();
 	void disable_blending();
+	// depth only passes, the attachment stays bound but nothing is written to it
+	void disable_color_writes();
 	void set_color_attachment_format(VkFormat format);
 	void set_depth_format(VkFormat format);
 	void disable_depthtest();
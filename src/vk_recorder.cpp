@@ -0,0 +1,151 @@
+#include "vk_recorder.h"
+#include <cstring>
+
+
+CommandRecorder::CommandRecorder(VkCommandBuffer cmd, Stats* stats) : cmd(cmd), stats(stats) {}
+
+void CommandRecorder::count(bool recorded) {
+	if (!stats) {
+		return;
+	}
+	if (recorded) {
+		stats->recorded++;
+	}
+	else {
+		stats->elided++;
+	}
+}
+
+void CommandRecorder::invalidate() {
+	graphics = {};
+	compute = {};
+	indexBuffer = VK_NULL_HANDLE;
+	viewportValid = false;
+	scissorValid = false;
+	pushLayout = VK_NULL_HANDLE;
+}
+
+void CommandRecorder::bind_pipeline(VkPipelineBindPoint bindPoint, VkPipeline pipeline) {
+	BindState& state = bind_state(bindPoint);
+	if (state.pipeline == pipeline) {
+		count(false);
+		return;
+	}
+
+	vkCmdBindPipeline(cmd, bindPoint, pipeline);
+	state.pipeline = pipeline;
+	count(true);
+}
+
+void CommandRecorder::bind_descriptor_sets(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t firstSet, uint32_t setCount, const VkDescriptorSet* sets) {
+	BindState& state = bind_state(bindPoint);
+
+	bool redundant = firstSet + setCount <= maxSets;
+	for (uint32_t i = 0; redundant && i < setCount; i++) {
+		// sets bound with a different layout only stay valid if the layouts are compatible, so never trust them
+		redundant = state.sets[firstSet + i] == sets[i] && state.setLayouts[firstSet + i] == layout;
+	}
+
+	if (redundant) {
+		count(false);
+		return;
+	}
+
+	vkCmdBindDescriptorSets(cmd, bindPoint, layout, firstSet, setCount, sets, 0, nullptr);
+
+	// sets bound with another layout can get disturbed, only layout compatibility would say and that isnt tracked
+	for (uint32_t i = 0; i < maxSets; i++) {
+		if (i >= firstSet && i < firstSet + setCount) {
+			state.sets[i] = sets[i - firstSet];
+			state.setLayouts[i] = layout;
+		}
+		else if (state.setLayouts[i] != layout) {
+			state.sets[i] = VK_NULL_HANDLE;
+			state.setLayouts[i] = VK_NULL_HANDLE;
+		}
+	}
+	count(true);
+}
+
+void CommandRecorder::bind_index_buffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType type) {
+	if (indexBuffer == buffer && indexOffset == offset && indexType == type) {
+		count(false);
+		return;
+	}
+
+	vkCmdBindIndexBuffer(cmd, buffer, offset, type);
+	indexBuffer = buffer;
+	indexOffset = offset;
+	indexType = type;
+	count(true);
+}
+
+void CommandRecorder::set_viewport(const VkViewport& newViewport) {
+	if (viewportValid && std::memcmp(&viewport, &newViewport, sizeof(VkViewport)) == 0) {
+		count(false);
+		return;
+	}
+
+	vkCmdSetViewport(cmd, 0, 1, &newViewport);
+	viewport = newViewport;
+	viewportValid = true;
+	count(true);
+}
+
+void CommandRecorder::set_scissor(const VkRect2D& newScissor) {
+	if (scissorValid && std::memcmp(&scissor, &newScissor, sizeof(VkRect2D)) == 0) {
+		count(false);
+		return;
+	}
+
+	vkCmdSetScissor(cmd, 0, 1, &newScissor);
+	scissor = newScissor;
+	scissorValid = true;
+	count(true);
+}
+
+void CommandRecorder::push_constants(VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size, const void* data) {
+	// only the last push is remembered, thats the common case of one range per layout
+	bool redundant = pushLayout == layout && pushStages == stages && pushOffset == offset && pushSize == size
+		&& std::memcmp(pushData, data, size) == 0;
+
+	if (redundant) {
+		count(false);
+		return;
+	}
+
+	vkCmdPushConstants(cmd, layout, stages, offset, size, data);
+
+	if (size <= maxPushConstantBytes) {
+		pushLayout = layout;
+		pushStages = stages;
+		pushOffset = offset;
+		pushSize = size;
+		std::memcpy(pushData, data, size);
+	}
+	else {
+		pushLayout = VK_NULL_HANDLE;
+	}
+	count(true);
+}
+
+void CommandRecorder::draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) {
+	vkCmdDraw(cmd, vertexCount, instanceCount, firstVertex, firstInstance);
+	count(true);
+}
+
+void CommandRecorder::draw_indexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance) {
+	vkCmdDrawIndexed(cmd, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+	count(true);
+}
+
+void CommandRecorder::draw_indexed_indirect_count(VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countOffset, uint32_t maxDrawCount, uint32_t stride) {
+	vkCmdDrawIndexedIndirectCount(cmd, buffer, offset, countBuffer, countOffset, maxDrawCount, stride);
+	count(true);
+}
+
+void CommandRecorder::draw_mesh_tasks_indirect_count(PFN_vkCmdDrawMeshTasksIndirectCountEXT drawMeshTasks, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer,
+	VkDeviceSize countOffset, uint32_t maxDrawCount, uint32_t stride) {
+	drawMeshTasks(cmd, buffer, offset, countBuffer, countOffset, maxDrawCount, stride);
+	count(true);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "vk_types.h"
+
+// thin wrapper over a command buffer that remembers what is bound and drops calls that wouldnt change anything.
+// vulkan keeps state for the whole command buffer, so one recorder per command buffer (or per pass) is enough
+class CommandRecorder {
+public:
+
+	struct Stats {
+		uint32_t recorded = 0;
+		uint32_t elided = 0;
+
+		Stats& operator+=(const Stats& other) {
+			recorded += other.recorded;
+			elided += other.elided;
+			return *this;
+		}
+	};
+
+	// stats is optional, the counts are added to it as commands come in
+	CommandRecorder(VkCommandBuffer cmd, Stats* stats = nullptr);
+
+	VkCommandBuffer get() const { return cmd; }
+
+	void bind_pipeline(VkPipelineBindPoint bindPoint, VkPipeline pipeline);
+	void bind_descriptor_sets(VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t firstSet, uint32_t setCount, const VkDescriptorSet* sets);
+	void bind_index_buffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType);
+	void set_viewport(const VkViewport& viewport);
+	void set_scissor(const VkRect2D& scissor);
+	void push_constants(VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size, const void* data);
+
+	// draws are never redundant, they only go through here so everything is recorded in order
+	void draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance);
+	void draw_indexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance);
+	void draw_indexed_indirect_count(VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countOffset, uint32_t maxDrawCount, uint32_t stride);
+	// VK_EXT_mesh_shader is an extension, the caller hands in the entry point it loaded
+	void draw_mesh_tasks_indirect_count(PFN_vkCmdDrawMeshTasksIndirectCountEXT drawMeshTasks, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countOffset,
+		uint32_t maxDrawCount, uint32_t stride);
+
+	// for anything recorded around the recorder that could have changed the tracked state
+	void invalidate();
+
+private:
+	static constexpr uint32_t maxSets = 4;
+	static constexpr uint32_t maxPushConstantBytes = 128;
+
+	// graphics and compute have separate binding state
+	struct BindState {
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkPipelineLayout setLayouts[maxSets] = {};
+		VkDescriptorSet sets[maxSets] = {};
+	};
+
+	BindState& bind_state(VkPipelineBindPoint bindPoint) { return bindPoint == VK_PIPELINE_BIND_POINT_COMPUTE ? compute : graphics; }
+	void count(bool recorded);
+
+	VkCommandBuffer cmd;
+	Stats* stats;
+
+	BindState graphics;
+	BindState compute;
+
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	VkDeviceSize indexOffset = 0;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+
+	bool viewportValid = false;
+	VkViewport viewport{};
+	bool scissorValid = false;
+	VkRect2D scissor{};
+
+	VkPipelineLayout pushLayout = VK_NULL_HANDLE;
+	VkShaderStageFlags pushStages = 0;
+	uint32_t pushOffset = 0;
+	uint32_t pushSize = 0;
+	uint8_t pushData[maxPushConstantBytes] = {};
+};
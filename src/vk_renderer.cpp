@@ -10,6 +10,11 @@
 #include "SDL3/SDL_vulkan.h"
 #include "glm/glm.hpp"
 #include "glm/gtx/transform.hpp"
+#include <map>
+#include <tuple>
+#include <bit>
+#include <algorithm>
+#include <cmath>
 
 
 
@@ -23,9 +28,18 @@ Renderer::~Renderer() {
 void Renderer::init_renderer() {
 	glslang::InitializeProcess();
 	PipelineManager::init_PipelineCache();
+
+	// retired transients go out with the frame being recorded, its fence covers every earlier frame too
+	renderGraph.init(engine.device, engine.vmaAllocator, engine.vkAllocator, [this](std::function<void()>&& deletor) {
+		engine.get_current_frame().deletionQueue.push_deletion_lambda(std::move(deletor));
+	});
+	engine.mainDeletionQueue.push_deletion_lambda([this]() { renderGraph.destroy(); });
+
 	create_draw_image_renderpass();
 	create_swapchain_renderpass();
-	init_framebuffers();
+	if (renderMode == RenderMode::Classic) {
+		init_framebuffers();
+	}
 	init_descriptors();
 	init_pipelines();
 	init_imgui();
@@ -35,37 +49,56 @@ void Renderer::init_renderer() {
 void Renderer::init_pipelines() {
 	init_backgound_pipelines();
 	init_mesh_pipeline();
+	init_composite_pipeline();
+	init_cull_pipeline();
+	init_depth_reduce_pipeline();
+	init_mesh_decode_pipeline();
+	init_occlusion_proxy_pipeline();
+	init_depth_prepass_pipeline();
 	metalRoughMaterial.build_pipelines(&engine, this);
 }
 
 void Renderer::render_frame() {
 
+	FrameData& frame = engine.get_current_frame();
 
-	VK_CHECK(vkWaitForFences(engine.device, 1, &engine.get_current_frame().renderFence, true, 1000000000));
-
-	engine.get_current_frame().deletionQueue.flushFrameResources(engine.vmaAllocator);
-	engine.get_current_frame().frameDescriptors->clear_pools(engine.device);
+	VK_CHECK(vkWaitForFences(engine.device, 1, &frame.renderFence, true, 1000000000));
 
-	VK_CHECK(vkResetFences(engine.device, 1, &engine.get_current_frame().renderFence));
+	frame.deletionQueue.flushFrameResources(engine.vmaAllocator);
+	frame.frameDescriptors->clear_pools(engine.device);
 
 	uint32_t swapchainImageIndex = 0;
 
+	drawExtent.width = std::min(engine.swapchainExtent.width, engine.drawImage.imageExtent.width);
+	drawExtent.height = std::min(engine.swapchainExtent.height, engine.drawImage.imageExtent.height);
 
-	VkResult result = vkAcquireNextImageKHR(engine.device, engine.swapchain, 1000000000, engine.get_current_frame().swapchainSemaphore, nullptr, &swapchainImageIndex);
-	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-		engine.resize_requested = true;
-		return;
+	update_scene();
+
+	// the sort depends on the camera, so the list only has to be rebuilt when either moved
+	if (dirtyFlags & (DIRTY_SCENE | DIRTY_CAMERA)) {
+		build_draw_list();
 	}
 
-	
+	// this slot's fence was waited above, so the gpu is done reading its copy
+	*(GPUSceneData*)frame.sceneDataBuffer.info.pMappedData = sceneData;
 
-	VkSemaphore currentRenderSemaphore = engine.swapchainImageRenderSemaphores[swapchainImageIndex];
+	lastRecordStats = recordStats;
+	recordStats = {};
 
-	drawExtent.width = std::min(engine.swapchainExtent.width, engine.drawImage.imageExtent.width);
-	drawExtent.height = std::min(engine.swapchainExtent.height, engine.drawImage.imageExtent.height);
+	bool drawScene = !renderOnDemand || dirtyFlags != DIRTY_NONE;
 
+	// in low latency mode the image is acquired right before the first write to it, so the offscreen work
+	// is already recorded and running on the gpu while we wait for the presentation engine
+	if (!engine.lowLatencyMode) {
+		VkResult result = vkAcquireNextImageKHR(engine.device, engine.swapchain, 1000000000, frame.swapchainSemaphore, nullptr, &swapchainImageIndex);
+		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+			// the fence is still signaled since nothing was submitted, so the next frame doesnt deadlock on it
+			engine.resize_requested = true;
+			return;
+		}
+	}
 
-	VkCommandBuffer cmd = engine.get_current_frame().mainCommandBuffer;
+	VkCommandBuffer cmd = frame.mainCommandBuffer;
 
 	VK_CHECK(vkResetCommandBuffer(cmd, 0));
 
@@ -73,33 +106,179 @@ void Renderer::render_frame() {
 
 	VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
 
-	vkutil::transition_image(cmd, engine.drawImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	// passes declare what they touch and the graph places the barriers between them
+	renderGraph.begin_frame();
+
+	RGImage drawTarget = renderGraph.import_image("draw image", engine.drawImage.image, VK_IMAGE_ASPECT_COLOR_BIT, drawImageState);
+	RGImage depthTarget = renderGraph.import_image("depth image", engine.depthImage.image, VK_IMAGE_ASPECT_DEPTH_BIT, depthImageState);
+
+	if (drawScene) {
+		hizActive = gpuDrivenDraws && occlusionCulling && !indirectBatches.empty();
+		queriesActive = occlusionQueries && engine.conditionalRenderingSupported;
+
+		// the results of the last use of this slot are done, so are the queries themselves
+		if (queriesActive) {
+			collect_occlusion_queries(frame);
+		}
+
+		write_draw_data(frame);
+
+		if (queriesActive && frame.drawDataCapacity > 0) {
+			vkResetQueryPool(engine.device, frame.occlusionQueryPool, 0, (uint32_t)frame.drawDataCapacity);
+		}
+
+		bool split = hizActive || queriesActive;
+		RGImage pyramidTarget = renderGraph.import_image("depth pyramid", depthPyramid.image, VK_IMAGE_ASPECT_COLOR_BIT, depthPyramidState);
+
+		// the graph tracks the pyramid, the barriers for the buffers are recorded inside the pass
+		if (gpuDrivenDraws && !indirectBatches.empty()) {
+			renderGraph.add_pass("cull", [this](VkCommandBuffer cmd) { render_cull(cmd, 0); })
+				.read(pyramidTarget, rgusage::SampledComputeGeneral);
+		}
+
+		// the background covers the whole draw extent so the previous contents never matter
+		renderGraph.add_pass("background", [this](VkCommandBuffer cmd) { render_background(cmd); })
+			.discard_write(drawTarget, rgusage::ComputeStorageWrite);
+
+		renderGraph.add_pass("geometry", [this, split](VkCommandBuffer cmd) {
+			GeometryPass pass = split ? GeometryPass::Early : GeometryPass::All;
+			if (renderMode == RenderMode::Classic) {
+				init_draw_image_renderpass(cmd, pass);
+			}
+			else {
+				render_dynamic_geometry(cmd, pass);
+			}
+		})
+			.write(drawTarget, rgusage::ColorAttachment)
+			.discard_write(depthTarget, rgusage::DepthAttachment);
+
+		if (hizActive) {
+			// built from the depth of the early pass only, what the early pass missed is either hidden or gets
+			// picked up by the late cull against it
+			renderGraph.add_pass("depth pyramid", [this](VkCommandBuffer cmd) { render_depth_pyramid(cmd); })
+				.read(depthTarget, rgusage::SampledCompute)
+				.write(pyramidTarget, rgusage::ComputeStorageWrite);
+
+			renderGraph.add_pass("cull late", [this](VkCommandBuffer cmd) { render_cull(cmd, 1); })
+				.read(pyramidTarget, rgusage::SampledComputeGeneral);
+		}
+
+		if (queriesActive) {
+			// only buffers, the barrier to the conditional reads is recorded inside
+			renderGraph.add_pass("occlusion query results", [this](VkCommandBuffer cmd) { render_occlusion_query_results(cmd); });
+		}
+
+		if (split) {
+			// the disoccluded and queried draws and the transparent ones on top of the early depth
+			renderGraph.add_pass("geometry late", [this](VkCommandBuffer cmd) {
+				if (renderMode == RenderMode::Classic) {
+					init_draw_image_renderpass(cmd, GeometryPass::Late);
+				}
+				else {
+					render_dynamic_geometry(cmd, GeometryPass::Late);
+				}
+			})
+				.write(drawTarget, rgusage::ColorAttachment)
+				.write(depthTarget, rgusage::DepthAttachment);
+		}
+
+		if (hizActive) {
+			depthPyramidViewProj = sceneData.viewproj;
+			depthPyramidValid = true;
+		}
+
+		sceneRedraws++;
+	}
+	else {
+		// the draw image still holds the last scene, its tracked state lets the composite read it without a barrier
+		sceneSkips++;
+	}
+
+	if (engine.lowLatencyMode) {
+		renderGraph.execute(cmd);
 
-	render_background(cmd);
+		VK_CHECK(vkEndCommandBuffer(cmd));
 
-	vkutil::transition_image(cmd, engine.drawImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		// the offscreen work doesnt touch the swapchain so it can go to the queue before the acquire
+		VkCommandBufferSubmitInfo offscreenInfo = vkinit::command_buffer_submit_info(cmd);
+		VkSubmitInfo2 offscreenSubmit = vkinit::submit_info(&offscreenInfo, nullptr, nullptr);
+		VK_CHECK(vkQueueSubmit2(engine.graphicsQueue, 1, &offscreenSubmit, VK_NULL_HANDLE));
 
+		VkResult result = vkAcquireNextImageKHR(engine.device, engine.swapchain, 1000000000, frame.swapchainSemaphore, nullptr, &swapchainImageIndex);
+		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+			// an empty submit still signals the fence once the offscreen work is done, so the command buffer
+			// isnt reset while the gpu is using it
+			VK_CHECK(vkResetFences(engine.device, 1, &frame.renderFence));
+			VK_CHECK(vkQueueSubmit2(engine.graphicsQueue, 0, nullptr, frame.renderFence));
+			engine.resize_requested = true;
+			return;
+		}
+
+		cmd = frame.presentCommandBuffer;
+		VK_CHECK(vkResetCommandBuffer(cmd, 0));
+		VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
+	}
 
+	// the acquire semaphore is waited at color attachment output, starting the swapchain image from that stage
+	// chains the first barrier onto the wait
+	ImageState swapchainState{ VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED };
+	RGImage swapchainTarget = renderGraph.import_image("swapchain", engine.swapchainImages[swapchainImageIndex], VK_IMAGE_ASPECT_COLOR_BIT, swapchainState);
+
+	// the debug image is rewritten every frame the ui shows it, even when the scene isnt redrawn, so nothing of it
+	// has to survive the frame and its memory goes back to the graph once the view is closed
+	bool occlusionDebug = occlusion_debug_shown();
+	RGImage occlusionDebugTarget = 0;
+	if (occlusionDebug) {
+		occlusionDebugTarget = renderGraph.create_transient("occlusion debug", TransientImageDesc{ VK_FORMAT_R8G8B8A8_UNORM,
+			VkExtent2D{ SoftwareOcclusion::maxWidth, SoftwareOcclusion::maxHeight }, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_IMAGE_ASPECT_COLOR_BIT });
+
+		renderGraph.add_pass("occlusion debug", [this, occlusionDebugTarget](VkCommandBuffer cmd) { render_occlusion_debug(cmd, occlusionDebugTarget); })
+			.discard_write(occlusionDebugTarget, rgusage::CopyDestination);
+	}
 
-	init_draw_image_renderpass(cmd);
+	// the draw image is sampled straight into the swapchain image and the ui goes on top in the same pass,
+	// the swapchain image is written once and never loaded
+	RenderGraph::PassBuilder composite = renderGraph.add_pass("composite", [this, swapchainImageIndex](VkCommandBuffer cmd) {
+		if (renderMode == RenderMode::Classic) {
+			init_swapchain_renderpass(cmd, swapchainImageIndex);
+		}
+		else {
+			render_dynamic_composite(cmd, engine.swapchainImageViews[swapchainImageIndex]);
+		}
+	})
+		.read(drawTarget, rgusage::SampledFragment)
+		.discard_write(swapchainTarget, rgusage::ColorAttachment);
 
-	vkutil::transition_image(cmd, engine.swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	vkutil::copy_image_to_image(cmd, engine.drawImage.image, engine.swapchainImages[swapchainImageIndex], drawExtent, engine.swapchainExtent);
-	vkutil::transition_image(cmd, engine.swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	if (occlusionDebug) {
+		composite.read(occlusionDebugTarget, rgusage::SampledFragment);
+	}
 
+	renderGraph.add_pass("present", nullptr)
+		.read(swapchainTarget, rgusage::Present);
 
-	init_swapchain_renderpass(cmd, swapchainImageIndex);
+	renderGraph.execute(cmd);
 
 	VK_CHECK(vkEndCommandBuffer(cmd));
 
+	VkSemaphore currentRenderSemaphore = engine.swapchainImageRenderSemaphores[swapchainImageIndex];
+
 	VkCommandBufferSubmitInfo cmdinfo = vkinit::command_buffer_submit_info(cmd);
 
-	VkSemaphoreSubmitInfo waitInfo = vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, engine.get_current_frame().swapchainSemaphore);
+	VkSemaphoreSubmitInfo waitInfo = vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, frame.swapchainSemaphore);
 	VkSemaphoreSubmitInfo signalInfo = vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, currentRenderSemaphore);
 
 	VkSubmitInfo2 submit = vkinit::submit_info(&cmdinfo, &signalInfo, &waitInfo);
 
-	VK_CHECK(vkQueueSubmit2(engine.graphicsQueue, 1, &submit, engine.get_current_frame().renderFence));
+	// only reset the fence once we know a submit will signal it again
+	VK_CHECK(vkResetFences(engine.device, 1, &frame.renderFence));
+
+	VK_CHECK(vkQueueSubmit2(engine.graphicsQueue, 1, &submit, frame.renderFence));
+
+	// the draw image is shared by every frame in flight, so one redraw is enough to bring it up to date
+	dirtyFlags = DIRTY_NONE;
+	if (uiFramesPending > 0) {
+		uiFramesPending--;
+	}
 
 	// as its necessary that drawing commands have finished before the image is displayed to the user
 	VkPresentInfoKHR presentInfo = {};
@@ -114,13 +293,15 @@ void Renderer::render_frame() {
 	presentInfo.pImageIndices = &swapchainImageIndex;
 
 	VkResult presentResult = vkQueuePresentKHR(engine.graphicsQueue, &presentInfo);
-	if (presentResult == VK_ERROR_OUT_OF_DATE_KHR) {
-		engine.resize_requested = true;
-		return;
-	}
+
+	engine.latency.record_present(SDL_GetTicksNS());
 
 	//increase the number of frames drawn
 	engine.frameNumber++;
+
+	if (presentResult == VK_ERROR_OUT_OF_DATE_KHR) {
+		engine.resize_requested = true;
+	}
 }
 
 void Renderer::init_renderer_cleanup() {
@@ -144,9 +325,6 @@ void Renderer::init_swapchain_renderpass(VkCommandBuffer cmd, uint32_t imageInde
 		throw std::runtime_error("Cannot initialize render pass: invalid swapchain image format");
 	}
 
-	VkClearValue clearValue{};
-	clearValue = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-
 	VkRenderPassBeginInfo renderPassBeginInfo{};
 	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 	renderPassBeginInfo.renderPass = swapchainRenderPass;
@@ -154,13 +332,15 @@ void Renderer::init_swapchain_renderpass(VkCommandBuffer cmd, uint32_t imageInde
 	renderPassBeginInfo.renderArea.extent = { engine.swapchainExtent.width, engine.swapchainExtent.height };
 	renderPassBeginInfo.renderArea.offset = { 0,0 };
 
-	renderPassBeginInfo.clearValueCount = 1;
-	renderPassBeginInfo.pClearValues = &clearValue;
+	// nothing to clear, the composite covers every pixel
+	renderPassBeginInfo.clearValueCount = 0;
+	renderPassBeginInfo.pClearValues = nullptr;
 
 
 	//start rendering 
 	vkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
+	render_composite(cmd);
 	render_imgui(cmd);
 
 	vkCmdEndRenderPass(cmd);
@@ -168,7 +348,7 @@ void Renderer::init_swapchain_renderpass(VkCommandBuffer cmd, uint32_t imageInde
 
 }
 
-void Renderer::init_draw_image_renderpass(VkCommandBuffer cmd) {
+void Renderer::init_draw_image_renderpass(VkCommandBuffer cmd, GeometryPass pass) {
 	if (engine.device == VK_NULL_HANDLE) {
 		throw std::runtime_error("Cannot initialize render pass: invalid device");
 	}
@@ -182,11 +362,12 @@ void Renderer::init_draw_image_renderpass(VkCommandBuffer cmd) {
 
 	std::array<VkClearValue, 2> clearValues{};
 	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f }; // color attachment
-	clearValues[1].depthStencil = { 1.0f, 0 };
+	clearValues[1].depthStencil = { 0.0f, 0 }; // reverse z, far is 0
 
 	VkRenderPassBeginInfo renderPassBeginInfo{};
 	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassBeginInfo.renderPass = drawImageRenderPass;
+	// both passes are compatible with the framebuffer and the pipelines, only the depth load differs
+	renderPassBeginInfo.renderPass = pass == GeometryPass::Late ? drawImageLoadRenderPass : drawImageRenderPass;
 	renderPassBeginInfo.framebuffer = drawImageFrameBuffer;
 	renderPassBeginInfo.renderArea.extent = { drawExtent.width, drawExtent.height };
 	renderPassBeginInfo.renderArea.offset = { 0,0 };
@@ -196,9 +377,17 @@ void Renderer::init_draw_image_renderpass(VkCommandBuffer cmd) {
 
 
 	//start rendering 
-	vkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// there is one cached recording per frame slot, the split occlusion passes are recorded inline
+	if (cacheGeometryCommands && gpuDrivenDraws && pass == GeometryPass::All) {
+		VkCommandBuffer geometry[] = { get_geometry_commands(), get_direct_geometry_commands() };
 
-	render_pass_geometry(cmd);
+		vkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		vkCmdExecuteCommands(cmd, 2, geometry);
+	}
+	else {
+		vkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		render_pass_geometry(cmd, pass);
+	}
 
 	vkCmdEndRenderPass(cmd);
 }
@@ -208,6 +397,133 @@ void Renderer::init_framebuffers() {
 	create_swapchain_framebuffer();
 }
 
+void Renderer::resize_framebuffers(bool drawTargetsChanged) {
+
+	std::vector<VkFramebuffer> retired = swapchainFrameBuffers;
+	if (drawTargetsChanged && drawImageFrameBuffer != VK_NULL_HANDLE) {
+		retired.push_back(drawImageFrameBuffer);
+		drawImageFrameBuffer = VK_NULL_HANDLE;
+	}
+	swapchainFrameBuffers.clear();
+
+	// the old framebuffers go out with the last submitted frame, same as the swapchain they point at
+	for (VkFramebuffer fb : retired) {
+		engine.mainDeletionQueue.release_framebuffer(fb);
+	}
+	engine.get_last_frame().deletionQueue.push_deletion_lambda([device = engine.device, retired]() {
+		for (VkFramebuffer fb : retired) {
+			vkDestroyFramebuffer(device, fb, nullptr);
+		}
+	});
+
+	if (drawTargetsChanged) {
+		reset_draw_target_descriptors();
+		write_draw_image_descriptors();
+		create_depth_pyramid();
+		// fresh images start out undefined
+		drawImageState = {};
+		depthImageState = {};
+		depthPyramidState = {};
+		depthPyramidValid = false;
+	}
+
+	// dynamic rendering takes the image views directly
+	if (renderMode == RenderMode::Dynamic) {
+		return;
+	}
+
+	create_swapchain_framebuffer();
+
+	if (drawImageFrameBuffer == VK_NULL_HANDLE) {
+		create_draw_image_framebuffer();
+	}
+}
+
+void Renderer::destroy_framebuffers() {
+	// only called with the device idle
+	for (VkFramebuffer fb : swapchainFrameBuffers) {
+		engine.mainDeletionQueue.release_framebuffer(fb);
+		vkDestroyFramebuffer(engine.device, fb, nullptr);
+	}
+	swapchainFrameBuffers.clear();
+
+	if (drawImageFrameBuffer != VK_NULL_HANDLE) {
+		engine.mainDeletionQueue.release_framebuffer(drawImageFrameBuffer);
+		vkDestroyFramebuffer(engine.device, drawImageFrameBuffer, nullptr);
+		drawImageFrameBuffer = VK_NULL_HANDLE;
+	}
+}
+
+void Renderer::set_render_mode(RenderMode mode) {
+	if (mode == renderMode) {
+		return;
+	}
+
+	// this is a benchmarking switch so a full wait is fine, every graphics pipeline gets rebuilt below
+	vkDeviceWaitIdle(engine.device);
+
+	renderMode = mode;
+	requestedRenderMode = mode;
+
+	// every graphics pipeline that can be rebuilt is registered for hot reloading
+	std::set<PipelineResource*> graphicsPipelines;
+	for (auto& [file, resources] : PipelineManager::get_shaderMap()) {
+		for (auto* r : resources) {
+			if (r->type == PipelineType::Graphics) {
+				graphicsPipelines.insert(r);
+			}
+		}
+	}
+
+	for (auto* r : graphicsPipelines) {
+		r->getGraphicsConfig()->renderMode = mode;
+		rebuild(engine.device, *r);
+		managePipeline.manage_pipeline(*r, TrackShader::No);
+	}
+
+	// the imgui pipeline is baked against either the swapchain render pass or the swapchain format
+	ImGui_ImplVulkan_Shutdown();
+	init_imgui_backend();
+
+	if (mode == RenderMode::Classic) {
+		init_framebuffers();
+	}
+	else {
+		destroy_framebuffers();
+	}
+
+	mark_dirty(DIRTY_PIPELINES);
+
+	fmt::print("render mode switched to {}\n", mode == RenderMode::Classic ? "classic" : "dynamic");
+}
+
+void Renderer::reset_draw_target_descriptors() {
+	// frames in flight still have the old sets bound, their pools go out with the last submitted frame
+	drawTargetDescriptorAllocator.defer_pool_deletion(engine.get_last_frame().deletionQueue);
+
+	std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> sizes =
+	{
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }
+	};
+	// draw image, composite, cull and one reduce set per pyramid level
+	drawTargetDescriptorAllocator.init(engine.device, 20, sizes);
+}
+
+void Renderer::write_draw_image_descriptors() {
+	// fresh sets instead of updating the old ones, frames in flight still have them bound
+	drawImageDescriptors = drawTargetDescriptorAllocator.allocate(engine.device, drawImageDescriptorLayout);
+	compositeDescriptors = drawTargetDescriptorAllocator.allocate(engine.device, singleImageDescriptorLayout);
+
+	DescriptorWriter writer;
+	writer.write_image(0, engine.drawImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+	writer.update_set(engine.device, drawImageDescriptors);
+
+	writer.clear();
+	writer.write_image(0, engine.drawImage.imageView, compositeSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+	writer.update_set(engine.device, compositeDescriptors);
+}
+
 void Renderer::init_descriptors() {
 
 
@@ -224,33 +540,123 @@ void Renderer::init_descriptors() {
 		builder.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
 		drawImageDescriptorLayout = builder.build(engine.device, VK_SHADER_STAGE_COMPUTE_BIT);
 	}
-	drawImageDescriptors = globalDescriptorAllocator.allocate(engine.device, drawImageDescriptorLayout);
 
 	{
-		DescriptorWriter writer;
-		writer.write_image(0, engine.drawImage.imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-		writer.update_set(engine.device, drawImageDescriptors);
+		DescriptorLayoutBuilder builder;
+		builder.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+		// the mesh shaders take the place of the vertex shader where the device has them
+		VkShaderStageFlags stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		if (engine.meshShaderSupported) {
+			stages |= VK_SHADER_STAGE_MESH_BIT_EXT;
+		}
+		gpuSceneDataDescriptorLayout = builder.build(engine.device, stages);
 	}
 
 	{
 		DescriptorLayoutBuilder builder;
-		builder.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-		gpuSceneDataDescriptorLayout = builder.build(engine.device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+		builder.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		singleImageDescriptorLayout = builder.build(engine.device, VK_SHADER_STAGE_FRAGMENT_BIT);
 	}
 
 	{
 		DescriptorLayoutBuilder builder;
 		builder.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-		singleImageDescriptorLayout = builder.build(engine.device, VK_SHADER_STAGE_FRAGMENT_BIT);
+		builder.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		depthReduceDescriptorLayout = builder.build(engine.device, VK_SHADER_STAGE_COMPUTE_BIT);
+	}
+
+	{
+		DescriptorLayoutBuilder builder;
+		builder.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		cullDescriptorLayout = builder.build(engine.device, VK_SHADER_STAGE_COMPUTE_BIT);
+	}
+
+	{
+		// the pyramid is only ever read with texelFetch
+		VkSamplerCreateInfo samplInfo = { .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		samplInfo.magFilter = VK_FILTER_NEAREST;
+		samplInfo.minFilter = VK_FILTER_NEAREST;
+		samplInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplInfo.maxLod = VK_LOD_CLAMP_NONE;
+		VK_CHECK(vkCreateSampler(engine.device, &samplInfo, engine.vkAllocator, &depthPyramidSampler));
+		engine.mainDeletionQueue.push_sampler(depthPyramidSampler);
+	}
+
+	{
+		// clamped so the filter doesnt pull in the unused part of the draw image at the edges
+		VkSamplerCreateInfo samplInfo = { .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+		samplInfo.magFilter = VK_FILTER_LINEAR;
+		samplInfo.minFilter = VK_FILTER_LINEAR;
+		samplInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		VK_CHECK(vkCreateSampler(engine.device, &samplInfo, engine.vkAllocator, &compositeSampler));
+		engine.mainDeletionQueue.push_sampler(compositeSampler);
 	}
 
+	reset_draw_target_descriptors();
+	write_draw_image_descriptors();
+	create_depth_pyramid();
+
 
 	globalDescriptorAllocator.defer_pool_main_deletion();
+
+	// the draw data buffers get replaced as they grow, so whatever is current at shutdown is destroyed
+	engine.mainDeletionQueue.push_deletion_lambda([this]() {
+		for (int i = 0; i < FRAME_OVERLAP; i++) {
+			FrameData& frame = engine.frames[i];
+			if (frame.drawDataCapacity > 0) {
+				vmaDestroyBuffer(engine.vmaAllocator, frame.drawDataBuffer.buffer, frame.drawDataBuffer.allocation);
+				vmaDestroyBuffer(engine.vmaAllocator, frame.cullDataBuffer.buffer, frame.cullDataBuffer.allocation);
+				vmaDestroyBuffer(engine.vmaAllocator, frame.countBuffer.buffer, frame.countBuffer.allocation);
+				vmaDestroyBuffer(engine.vmaAllocator, frame.visibilityBuffer.buffer, frame.visibilityBuffer.allocation);
+				vmaDestroyBuffer(engine.vmaAllocator, frame.queryResultBuffer.buffer, frame.queryResultBuffer.allocation);
+				vkDestroyQueryPool(engine.device, frame.occlusionQueryPool, engine.vkAllocator);
+				frame.drawDataCapacity = 0;
+			}
+			if (frame.commandCapacity > 0) {
+				vmaDestroyBuffer(engine.vmaAllocator, frame.indirectBuffer.buffer, frame.indirectBuffer.allocation);
+				frame.commandCapacity = 0;
+			}
+		}
+
+		// replaced on resize like the draw data
+		drawTargetDescriptorAllocator.destroy_pools();
+		for (VkImageView view : depthPyramidMips) {
+			vkDestroyImageView(engine.device, view, engine.vkAllocator);
+		}
+		vkDestroyImageView(engine.device, depthPyramid.imageView, nullptr);
+		vmaDestroyImage(engine.vmaAllocator, depthPyramid.image, depthPyramid.allocation);
+	});
 	engine.mainDeletionQueue.push_descriptor_set_layout(drawImageDescriptorLayout);
 	engine.mainDeletionQueue.push_descriptor_set_layout(gpuSceneDataDescriptorLayout);
 	engine.mainDeletionQueue.push_descriptor_set_layout(singleImageDescriptorLayout);
+	engine.mainDeletionQueue.push_descriptor_set_layout(depthReduceDescriptorLayout);
+	engine.mainDeletionQueue.push_descriptor_set_layout(cullDescriptorLayout);
 
 	for (int i = 0; i < FRAME_OVERLAP; i++) {
+		// persistent so cached command buffers can keep the set bound, only the contents change every frame
+		engine.frames[i].sceneDataBuffer = engine.create_buffer(sizeof(GPUSceneData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		engine.mainDeletionQueue.push_allocated_buffer(engine.frames[i].sceneDataBuffer);
+
+		engine.frames[i].sceneDescriptor = globalDescriptorAllocator.allocate(engine.device, gpuSceneDataDescriptorLayout);
+
+		engine.frames[i].cullParamsBuffer = engine.create_buffer(sizeof(GPUCullParams), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		engine.mainDeletionQueue.push_allocated_buffer(engine.frames[i].cullParamsBuffer);
+
+		VkBufferDeviceAddressInfo addressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = engine.frames[i].cullParamsBuffer.buffer };
+		engine.frames[i].cullParamsAddress = vkGetBufferDeviceAddress(engine.device, &addressInfo);
+
+		engine.frames[i].occlusionDebugBuffer = engine.create_buffer(SoftwareOcclusion::maxWidth * SoftwareOcclusion::maxHeight * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		engine.mainDeletionQueue.push_allocated_buffer(engine.frames[i].occlusionDebugBuffer);
+
+		DescriptorWriter writer;
+		writer.write_buffer(0, engine.frames[i].sceneDataBuffer.buffer, sizeof(GPUSceneData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+		writer.update_set(engine.device, engine.frames[i].sceneDescriptor);
+
 		std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> frame_sizes = {
 			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3 },
 			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 },
@@ -346,6 +752,126 @@ void Renderer::init_backgound_pipelines() {
 }
 
 
+void Renderer::init_cull_pipeline() {
+
+	VkPipelineLayout cullPipelineLayout;
+
+	// buffers go through addresses, the only set is the depth pyramid
+	VkPushConstantRange pushConstant{};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(CullPushConstants);
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo layoutInfo = vkinit::pipeline_layout_create_info();
+	layoutInfo.pPushConstantRanges = &pushConstant;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pSetLayouts = &cullDescriptorLayout;
+	layoutInfo.setLayoutCount = 1;
+
+	VK_CHECK(vkCreatePipelineLayout(engine.device, &layoutInfo, nullptr, &cullPipelineLayout));
+
+	VkShaderModule cullShader = shaderUtil::compileToSPV(engine.device, "C:/Users/Alberto/source/repos/GROTESK/GROTESK/res/shaders/cull.comp", EShLangCompute);
+
+	VkPipelineShaderStageCreateInfo stageinfo{};
+	stageinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stageinfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	stageinfo.module = cullShader;
+	stageinfo.pName = "main";
+
+	VkComputePipelineCreateInfo computePipelineCreateInfo{};
+	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	computePipelineCreateInfo.layout = cullPipelineLayout;
+	computePipelineCreateInfo.stage = stageinfo;
+
+	VkPipeline cullPipeline;
+	VK_CHECK(vkCreateComputePipelines(engine.device, PipelineManager::pipelineCache, 1, &computePipelineCreateInfo, engine.vkAllocator, &cullPipeline));
+
+	vkDestroyShaderModule(engine.device, cullShader, nullptr);
+
+	cullPipelineID = managePipeline.createPipelineID();
+	cullPipelineLayoutID = managePipeline.createLayoutID();
+	managePipeline.store_pipeline(cullPipelineID, cullPipelineLayoutID, cullPipeline, cullPipelineLayout);
+}
+
+void Renderer::init_depth_reduce_pipeline() {
+
+	VkPipelineLayout reducePipelineLayout;
+
+	VkPushConstantRange pushConstant{};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(DepthReducePushConstants);
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo layoutInfo = vkinit::pipeline_layout_create_info();
+	layoutInfo.pPushConstantRanges = &pushConstant;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pSetLayouts = &depthReduceDescriptorLayout;
+	layoutInfo.setLayoutCount = 1;
+
+	VK_CHECK(vkCreatePipelineLayout(engine.device, &layoutInfo, nullptr, &reducePipelineLayout));
+
+	VkShaderModule reduceShader = shaderUtil::compileToSPV(engine.device, "C:/Users/Alberto/source/repos/GROTESK/GROTESK/res/shaders/depth_reduce.comp", EShLangCompute);
+
+	VkPipelineShaderStageCreateInfo stageinfo{};
+	stageinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stageinfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	stageinfo.module = reduceShader;
+	stageinfo.pName = "main";
+
+	VkComputePipelineCreateInfo computePipelineCreateInfo{};
+	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	computePipelineCreateInfo.layout = reducePipelineLayout;
+	computePipelineCreateInfo.stage = stageinfo;
+
+	VkPipeline reducePipeline;
+	VK_CHECK(vkCreateComputePipelines(engine.device, PipelineManager::pipelineCache, 1, &computePipelineCreateInfo, engine.vkAllocator, &reducePipeline));
+
+	vkDestroyShaderModule(engine.device, reduceShader, nullptr);
+
+	depthReducePipelineID = managePipeline.createPipelineID();
+	depthReducePipelineLayoutID = managePipeline.createLayoutID();
+	managePipeline.store_pipeline(depthReducePipelineID, depthReducePipelineLayoutID, reducePipeline, reducePipelineLayout);
+}
+
+void Renderer::init_mesh_decode_pipeline() {
+
+	VkPipelineLayout decodePipelineLayout;
+
+	// everything goes through addresses, no sets
+	VkPushConstantRange pushConstant{};
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(MeshDecodePushConstants);
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo layoutInfo = vkinit::pipeline_layout_create_info();
+	layoutInfo.pPushConstantRanges = &pushConstant;
+	layoutInfo.pushConstantRangeCount = 1;
+
+	VK_CHECK(vkCreatePipelineLayout(engine.device, &layoutInfo, nullptr, &decodePipelineLayout));
+
+	VkShaderModule decodeShader = shaderUtil::compileToSPV(engine.device, "C:/Users/Alberto/source/repos/GROTESK/GROTESK/res/shaders/mesh_decode.comp", EShLangCompute);
+
+	VkPipelineShaderStageCreateInfo stageinfo{};
+	stageinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stageinfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	stageinfo.module = decodeShader;
+	stageinfo.pName = "main";
+
+	VkComputePipelineCreateInfo computePipelineCreateInfo{};
+	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	computePipelineCreateInfo.layout = decodePipelineLayout;
+	computePipelineCreateInfo.stage = stageinfo;
+
+	VkPipeline decodePipeline;
+	VK_CHECK(vkCreateComputePipelines(engine.device, PipelineManager::pipelineCache, 1, &computePipelineCreateInfo, engine.vkAllocator, &decodePipeline));
+
+	vkDestroyShaderModule(engine.device, decodeShader, nullptr);
+
+	meshDecodePipelineID = managePipeline.createPipelineID();
+	meshDecodePipelineLayoutID = managePipeline.createLayoutID();
+	managePipeline.store_pipeline(meshDecodePipelineID, meshDecodePipelineLayoutID, decodePipeline, decodePipelineLayout);
+}
+
 void Renderer::init_mesh_pipeline() {
 
 	meshPipeline.type = PipelineType::Graphics;
@@ -369,11 +895,14 @@ void Renderer::init_mesh_pipeline() {
 	meshPipelineConfig->pushConstantRange.size = sizeof(GPUDrawPushConstants);
 	meshPipelineConfig->pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
+	// scene data first so the per frame set can stay bound, the texture second
+	VkDescriptorSetLayout meshLayouts[] = { gpuSceneDataDescriptorLayout, singleImageDescriptorLayout };
+
 	meshPipelineConfig->layoutInfo = vkinit::pipeline_layout_create_info();
 	meshPipelineConfig->layoutInfo.pPushConstantRanges = &meshPipelineConfig->pushConstantRange;
 	meshPipelineConfig->layoutInfo.pushConstantRangeCount = 1;
-	meshPipelineConfig->layoutInfo.pSetLayouts = &singleImageDescriptorLayout;
-	meshPipelineConfig->layoutInfo.setLayoutCount = 1;
+	meshPipelineConfig->layoutInfo.pSetLayouts = meshLayouts;
+	meshPipelineConfig->layoutInfo.setLayoutCount = 2;
 
 
 	VK_CHECK(vkCreatePipelineLayout(engine.device, &meshPipelineConfig->layoutInfo, nullptr, &meshPipeline.pipelineLayout.layout));
@@ -398,12 +927,12 @@ void Renderer::init_mesh_pipeline() {
 	pipelineBuilder.set_renderpass(drawImageRenderPass);
 
 	
-	//connect the image format we will draw into, from draw image
-	//pipelineBuilder.set_color_attachment_format(engine.drawImage.imageFormat);
-	//pipelineBuilder.set_depth_format(engine.depthImage.imageFormat);
+	//connect the image format we will draw into, from draw image, used when rendering dynamically
+	pipelineBuilder.set_color_attachment_format(engine.drawImage.imageFormat);
+	pipelineBuilder.set_depth_format(engine.depthImage.imageFormat);
 
 	//finally build the pipeline
-	meshPipeline.pipeline = pipelineBuilder.build_pipeline(engine.device, RenderMode::Classic, &meshPipeline);
+	meshPipeline.pipeline = pipelineBuilder.build_pipeline(engine.device, renderMode, &meshPipeline);
 
 	fmt::print("Registered vertex shader: {} lastModified: {} after meshPipeline.pipline build function\n",
 		meshPipeline.shader.vertexShader.file,
@@ -417,65 +946,226 @@ void Renderer::init_mesh_pipeline() {
 	managePipeline.manage_pipeline(meshPipeline, TrackShader::Yes);
 }
 
-void Renderer::init_imgui() {
+void Renderer::init_composite_pipeline() {
 
-	VkDescriptorPoolSize pool_sizes[] =
-	{
-		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, IMGUI_IMPL_VULKAN_MINIMUM_IMAGE_SAMPLER_POOL_SIZE },
-	};
-	VkDescriptorPoolCreateInfo pool_info = {};
-	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-	pool_info.maxSets = 0;
-	for (VkDescriptorPoolSize& pool_size : pool_sizes)
-		pool_info.maxSets += pool_size.descriptorCount;
-	pool_info.poolSizeCount = (uint32_t)IM_ARRAYSIZE(pool_sizes);
-	pool_info.pPoolSizes = pool_sizes;
+	compositePipeline.type = PipelineType::Graphics;
+	compositePipeline.shader.vertexShader.file = "C:/Users/Alberto/source/repos/GROTESK/GROTESK/res/shaders/composite.vert";
+	compositePipeline.shader.fragmentShader.file = "C:/Users/Alberto/source/repos/GROTESK/GROTESK/res/shaders/composite.frag";
 
+	compositePipeline.shader.vertexShader.lastModified = shaderUtil::getFileTimeStamp(compositePipeline.shader.vertexShader.file);
+	compositePipeline.shader.fragmentShader.lastModified = shaderUtil::getFileTimeStamp(compositePipeline.shader.fragmentShader.file);
 
+	compositePipeline.shader.vertexShader.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	compositePipeline.shader.fragmentShader.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-	VK_CHECK(vkCreateDescriptorPool(engine.device, &pool_info, nullptr, &imguiPool));
+	VkShaderModule vertexShader = shaderUtil::compileToSPV(engine.device, compositePipeline.shader.vertexShader.file, EShLangVertex);
+	VkShaderModule fragmentShader = shaderUtil::compileToSPV(engine.device, compositePipeline.shader.fragmentShader.file, EShLangFragment);
 
+	auto* compositeConfig = compositePipeline.getGraphicsConfig();
 
-	IMGUI_CHECKVERSION();
-	ImGui::CreateContext();
-	ImGuiIO& io = ImGui::GetIO(); (void)io;
-	io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;     // Enable Keyboard Controls
+	compositeConfig->pushConstantRange.offset = 0;
+	compositeConfig->pushConstantRange.size = sizeof(CompositePushConstants);
+	compositeConfig->pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
-	engine.main_scale = SDL_GetDisplayContentScale(SDL_GetPrimaryDisplay());
+	compositeConfig->layoutInfo = vkinit::pipeline_layout_create_info();
+	compositeConfig->layoutInfo.pPushConstantRanges = &compositeConfig->pushConstantRange;
+	compositeConfig->layoutInfo.pushConstantRangeCount = 1;
+	compositeConfig->layoutInfo.pSetLayouts = &singleImageDescriptorLayout;
+	compositeConfig->layoutInfo.setLayoutCount = 1;
 
-	ImGui::StyleColorsDark();
-	ImGuiStyle& style = ImGui::GetStyle();
-	style.ScaleAllSizes(engine.main_scale);        // Bake a fixed style scale. (until we have a solution for dynamic style scaling, changing this requires resetting Style + calling this again)
-	style.FontScaleDpi = engine.main_scale;
+	VK_CHECK(vkCreatePipelineLayout(engine.device, &compositeConfig->layoutInfo, nullptr, &compositePipeline.pipelineLayout.layout));
 
-	ImGui_ImplSDL3_InitForVulkan(engine.window);
-	ImGui_ImplVulkan_InitInfo init_info = {};
-	//init_info.ApiVersion = VK_API_VERSION_1_3;              // Pass in your value of VkApplicationInfo::apiVersion, otherwise will default to header version.
-	init_info.Instance = engine.instance;
-	init_info.PhysicalDevice = engine.physicalDevice;
-	init_info.Device = engine.device;
-	init_info.QueueFamily = engine.graphicsQueueFamily;
-	init_info.Queue = engine.graphicsQueue;
+	PipelineBuilder pipelineBuilder;
+	pipelineBuilder.res->pipelineLayout = compositePipeline.pipelineLayout;
+	pipelineBuilder.set_shaders(vertexShader, fragmentShader);
+	pipelineBuilder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	pipelineBuilder.set_polygon_mode(VK_POLYGON_MODE_FILL);
+	pipelineBuilder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+	pipelineBuilder.set_multisampling_none();
+	pipelineBuilder.disable_blending();
+	pipelineBuilder.disable_depthtest();
+	// drawn into the swapchain pass together with the ui
+	pipelineBuilder.set_renderpass(swapchainRenderPass);
+	pipelineBuilder.set_color_attachment_format(engine.swapchainImageFormat);
+	pipelineBuilder.set_depth_format(VK_FORMAT_UNDEFINED);
+
+	compositePipeline.pipeline = pipelineBuilder.build_pipeline(engine.device, renderMode, &compositePipeline);
+
+	vkDestroyShaderModule(engine.device, vertexShader, nullptr);
+	vkDestroyShaderModule(engine.device, fragmentShader, nullptr);
+
+	managePipeline.manage_pipeline(compositePipeline, TrackShader::Yes);
+}
+
+void Renderer::init_occlusion_proxy_pipeline() {
+
+	occlusionProxyPipeline.type = PipelineType::Graphics;
+	occlusionProxyPipeline.shader.vertexShader.file = "C:/Users/Alberto/source/repos/GROTESK/GROTESK/res/shaders/occlusion_proxy.vert";
+	occlusionProxyPipeline.shader.fragmentShader.file = "C:/Users/Alberto/source/repos/GROTESK/GROTESK/res/shaders/occlusion_proxy.frag";
+
+	occlusionProxyPipeline.shader.vertexShader.lastModified = shaderUtil::getFileTimeStamp(occlusionProxyPipeline.shader.vertexShader.file);
+	occlusionProxyPipeline.shader.fragmentShader.lastModified = shaderUtil::getFileTimeStamp(occlusionProxyPipeline.shader.fragmentShader.file);
+
+	occlusionProxyPipeline.shader.vertexShader.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	occlusionProxyPipeline.shader.fragmentShader.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkShaderModule vertexShader = shaderUtil::compileToSPV(engine.device, occlusionProxyPipeline.shader.vertexShader.file, EShLangVertex);
+	VkShaderModule fragmentShader = shaderUtil::compileToSPV(engine.device, occlusionProxyPipeline.shader.fragmentShader.file, EShLangFragment);
+
+	auto* proxyConfig = occlusionProxyPipeline.getGraphicsConfig();
+
+	proxyConfig->pushConstantRange.offset = 0;
+	proxyConfig->pushConstantRange.size = sizeof(OcclusionProxyPushConstants);
+	proxyConfig->pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	// the box matrix already has the camera in it, no sets
+	proxyConfig->layoutInfo = vkinit::pipeline_layout_create_info();
+	proxyConfig->layoutInfo.pPushConstantRanges = &proxyConfig->pushConstantRange;
+	proxyConfig->layoutInfo.pushConstantRangeCount = 1;
+
+	VK_CHECK(vkCreatePipelineLayout(engine.device, &proxyConfig->layoutInfo, nullptr, &occlusionProxyPipeline.pipelineLayout.layout));
+
+	PipelineBuilder pipelineBuilder;
+	pipelineBuilder.res->pipelineLayout = occlusionProxyPipeline.pipelineLayout;
+	pipelineBuilder.set_shaders(vertexShader, fragmentShader);
+	pipelineBuilder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP);
+	pipelineBuilder.set_polygon_mode(VK_POLYGON_MODE_FILL);
+	// both sides, the back faces still count if the front ones are hidden
+	pipelineBuilder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+	pipelineBuilder.set_multisampling_none();
+	pipelineBuilder.disable_color_writes();
+	// tested against the depth of the opaque draws, but the boxes themselves must not hide anything
+	pipelineBuilder.enable_depthtest(false, VK_COMPARE_OP_GREATER_OR_EQUAL);
+	pipelineBuilder.set_renderpass(drawImageRenderPass);
+	pipelineBuilder.set_color_attachment_format(engine.drawImage.imageFormat);
+	pipelineBuilder.set_depth_format(engine.depthImage.imageFormat);
+
+	occlusionProxyPipeline.pipeline = pipelineBuilder.build_pipeline(engine.device, renderMode, &occlusionProxyPipeline);
+
+	vkDestroyShaderModule(engine.device, vertexShader, nullptr);
+	vkDestroyShaderModule(engine.device, fragmentShader, nullptr);
+
+	managePipeline.manage_pipeline(occlusionProxyPipeline, TrackShader::Yes);
+}
+
+void Renderer::init_depth_prepass_pipeline() {
+
+	depthPrepassPipeline.type = PipelineType::Graphics;
+	depthPrepassPipeline.shader.vertexShader.file = "C:/Users/Alberto/source/repos/GROTESK/GROTESK/res/shaders/depth_prepass.vert";
+	depthPrepassPipeline.shader.fragmentShader.file = "C:/Users/Alberto/source/repos/GROTESK/GROTESK/res/shaders/depth_prepass.frag";
+
+	depthPrepassPipeline.shader.vertexShader.lastModified = shaderUtil::getFileTimeStamp(depthPrepassPipeline.shader.vertexShader.file);
+	depthPrepassPipeline.shader.fragmentShader.lastModified = shaderUtil::getFileTimeStamp(depthPrepassPipeline.shader.fragmentShader.file);
+
+	depthPrepassPipeline.shader.vertexShader.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	depthPrepassPipeline.shader.fragmentShader.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkShaderModule vertexShader = shaderUtil::compileToSPV(engine.device, depthPrepassPipeline.shader.vertexShader.file, EShLangVertex);
+	VkShaderModule fragmentShader = shaderUtil::compileToSPV(engine.device, depthPrepassPipeline.shader.fragmentShader.file, EShLangFragment);
+
+	auto* prepassConfig = depthPrepassPipeline.getGraphicsConfig();
+
+	prepassConfig->pushConstantRange.offset = 0;
+	prepassConfig->pushConstantRange.size = sizeof(GPUDrawPushConstants);
+	prepassConfig->pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	// the camera from the scene set, the draws from the draw data, no material
+	prepassConfig->layoutInfo = vkinit::pipeline_layout_create_info();
+	prepassConfig->layoutInfo.setLayoutCount = 1;
+	prepassConfig->layoutInfo.pSetLayouts = &gpuSceneDataDescriptorLayout;
+	prepassConfig->layoutInfo.pPushConstantRanges = &prepassConfig->pushConstantRange;
+	prepassConfig->layoutInfo.pushConstantRangeCount = 1;
+
+	VK_CHECK(vkCreatePipelineLayout(engine.device, &prepassConfig->layoutInfo, nullptr, &depthPrepassPipeline.pipelineLayout.layout));
+
+	PipelineBuilder pipelineBuilder;
+	pipelineBuilder.res->pipelineLayout = depthPrepassPipeline.pipelineLayout;
+	pipelineBuilder.set_shaders(vertexShader, fragmentShader);
+	pipelineBuilder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	pipelineBuilder.set_polygon_mode(VK_POLYGON_MODE_FILL);
+	// same rasterization as the opaque pipelines so the depths match
+	pipelineBuilder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+	pipelineBuilder.set_multisampling_none();
+	pipelineBuilder.disable_color_writes();
+	pipelineBuilder.enable_depthtest(true, VK_COMPARE_OP_GREATER_OR_EQUAL);
+	pipelineBuilder.set_renderpass(drawImageRenderPass);
+	pipelineBuilder.set_color_attachment_format(engine.drawImage.imageFormat);
+	pipelineBuilder.set_depth_format(engine.depthImage.imageFormat);
+
+	depthPrepassPipeline.pipeline = pipelineBuilder.build_pipeline(engine.device, renderMode, &depthPrepassPipeline);
+
+	vkDestroyShaderModule(engine.device, vertexShader, nullptr);
+	vkDestroyShaderModule(engine.device, fragmentShader, nullptr);
+
+	managePipeline.manage_pipeline(depthPrepassPipeline, TrackShader::Yes);
+}
+
+void Renderer::init_imgui() {
+
+	VkDescriptorPoolSize pool_sizes[] =
+	{
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, IMGUI_IMPL_VULKAN_MINIMUM_IMAGE_SAMPLER_POOL_SIZE },
+	};
+	VkDescriptorPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	pool_info.maxSets = 0;
+	for (VkDescriptorPoolSize& pool_size : pool_sizes)
+		pool_info.maxSets += pool_size.descriptorCount;
+	pool_info.poolSizeCount = (uint32_t)IM_ARRAYSIZE(pool_sizes);
+	pool_info.pPoolSizes = pool_sizes;
+
+
+
+	VK_CHECK(vkCreateDescriptorPool(engine.device, &pool_info, nullptr, &imguiPool));
+
+
+	IMGUI_CHECKVERSION();
+	ImGui::CreateContext();
+	ImGuiIO& io = ImGui::GetIO(); (void)io;
+	io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;     // Enable Keyboard Controls
+
+	engine.main_scale = SDL_GetDisplayContentScale(SDL_GetPrimaryDisplay());
+
+	ImGui::StyleColorsDark();
+	ImGuiStyle& style = ImGui::GetStyle();
+	style.ScaleAllSizes(engine.main_scale);        // Bake a fixed style scale. (until we have a solution for dynamic style scaling, changing this requires resetting Style + calling this again)
+	style.FontScaleDpi = engine.main_scale;
+
+	ImGui_ImplSDL3_InitForVulkan(engine.window);
+	init_imgui_backend();
+
+	engine.mainDeletionQueue.push_descriptor_pool(imguiPool);
+}
+
+void Renderer::init_imgui_backend() {
+
+	ImGui_ImplVulkan_InitInfo init_info = {};
+	//init_info.ApiVersion = VK_API_VERSION_1_3;              // Pass in your value of VkApplicationInfo::apiVersion, otherwise will default to header version.
+	init_info.Instance = engine.instance;
+	init_info.PhysicalDevice = engine.physicalDevice;
+	init_info.Device = engine.device;
+	init_info.QueueFamily = engine.graphicsQueueFamily;
+	init_info.Queue = engine.graphicsQueue;
 	init_info.DescriptorPool = imguiPool;
 	init_info.MinImageCount = engine.swapchainImageCount;
 	init_info.ImageCount = engine.swapchainImageCount;
 	init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
 	init_info.Allocator = engine.vkAllocator;
 	init_info.PipelineCache = VK_NULL_HANDLE;
-	//classic rendering
-	init_info.RenderPass = swapchainRenderPass;
-	init_info.Subpass = 0;
-
-	//dynamic rendering info below 
-	//init_info.UseDynamicRendering = true;
-	//init_info.PipelineRenderingCreateInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO };
-	//init_info.PipelineRenderingCreateInfo.colorAttachmentCount = 1;
-	//init_info.PipelineRenderingCreateInfo.pColorAttachmentFormats = &swapchainImageFormat;
+	if (renderMode == RenderMode::Classic) {
+		//classic rendering
+		init_info.RenderPass = swapchainRenderPass;
+		init_info.Subpass = 0;
+	}
+	else {
+		//dynamic rendering, imgui copies the format array
+		init_info.UseDynamicRendering = true;
+		init_info.PipelineRenderingCreateInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO };
+		init_info.PipelineRenderingCreateInfo.colorAttachmentCount = 1;
+		init_info.PipelineRenderingCreateInfo.pColorAttachmentFormats = &engine.swapchainImageFormat;
+	}
 	ImGui_ImplVulkan_Init(&init_info);
-	
-
-	engine.mainDeletionQueue.push_descriptor_pool(imguiPool);
 }
 
 void Renderer::init_default_data() {
@@ -494,166 +1184,860 @@ void Renderer::init_default_data() {
 
 	std::array<uint32_t, 6> rect_indices;
 
-	rect_indices[0] = 0;
-	rect_indices[1] = 1;
-	rect_indices[2] = 2;
+	rect_indices[0] = 0;
+	rect_indices[1] = 1;
+	rect_indices[2] = 2;
+
+	rect_indices[3] = 2;
+	rect_indices[4] = 1;
+	rect_indices[5] = 3;
+
+	rectangle = engine.uploadMesh(rect_indices, rect_vertices);
+
+	// the test meshes are small and closed, on the grid the near ones hide the rows behind them
+	testMeshes = loadGltfMeshes(&engine, "C:/Users/Alberto/source/repos/GROTESK/GROTESK/res/assets/basicmesh.glb", {},
+		[](std::string_view) { return true; }).value();
+
+	uint32_t white = glm::packUnorm4x8(glm::vec4(1, 1, 1, 1));
+	whiteImage = create_image((void*)&white, VkExtent3D{ 1, 1, 1 }, VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_USAGE_SAMPLED_BIT);
+
+	uint32_t grey = glm::packUnorm4x8(glm::vec4(0.66f, 0.66f, 0.66f, 1));
+	greyImage = create_image((void*)&grey, VkExtent3D{ 1, 1, 1 }, VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_USAGE_SAMPLED_BIT);
+
+	uint32_t black = glm::packUnorm4x8(glm::vec4(0, 0, 0, 1));
+	blackImage = create_image((void*)&black, VkExtent3D{ 1, 1, 1 }, VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_USAGE_SAMPLED_BIT);
+
+	uint32_t magenta = glm::packUnorm4x8(glm::vec4(1, 0, 1, 1));
+	std::array<uint32_t, 16 * 16 > pixels; //for 16x16 checkerboard texture
+	for (int x = 0; x < 16; x++) {
+		for (int y = 0; y < 16; y++) {
+			pixels[y * 16 + x] = ((x % 2) ^ (y % 2)) ? magenta : black;
+		}
+	}
+	errorCheckerBoardImage = create_image(pixels.data(), VkExtent3D{ 16, 16, 1 }, VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_USAGE_SAMPLED_BIT);
+
+	VkSamplerCreateInfo samplInfo = { .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	samplInfo.magFilter = VK_FILTER_NEAREST;
+	samplInfo.minFilter = VK_FILTER_NEAREST;
+
+	vkCreateSampler(engine.device, &samplInfo, engine.vkAllocator, &defaultSamplerNearest);
+
+	samplInfo.magFilter = VK_FILTER_LINEAR;
+	samplInfo.minFilter = VK_FILTER_LINEAR;
+	vkCreateSampler(engine.device, &samplInfo, engine.vkAllocator, &defaultSamplerLinear);
+
+
+	engine.mainDeletionQueue.push_sampler(defaultSamplerNearest);
+	engine.mainDeletionQueue.push_sampler(defaultSamplerLinear);
+	engine.mainDeletionQueue.push_allocated_image(whiteImage);
+	engine.mainDeletionQueue.push_allocated_image(blackImage);
+	engine.mainDeletionQueue.push_allocated_image(greyImage);
+	engine.mainDeletionQueue.push_allocated_image(errorCheckerBoardImage);
+
+	// shown through imgui, the pool they come from is destroyed with the rest of the ui. the debug image only exists
+	// while the graph records a frame, until then the sets point at the white image
+	for (int i = 0; i < FRAME_OVERLAP; i++) {
+		engine.frames[i].occlusionDebugTexture = ImGui_ImplVulkan_AddTexture(defaultSamplerNearest, whiteImage.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
+	engine.mainDeletionQueue.push_mesh_buffer_deletion(rectangle);
+
+
+	GLTFMetallic_Roughness::MaterialResources materialResources;
+	materialResources.colorImage = whiteImage;
+	materialResources.colorSampler = defaultSamplerLinear;
+	materialResources.metalRoughImage = whiteImage;
+	materialResources.metalRoughSampler = defaultSamplerLinear;
+
+	AllocatedBuffer materialConstants = engine.create_buffer(sizeof(GLTFMetallic_Roughness::MaterialConstants), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+	void* data;
+
+	vmaMapMemory(engine.vmaAllocator, materialConstants.allocation, &data);
+
+	GLTFMetallic_Roughness::MaterialConstants* sceneUniformData = reinterpret_cast<GLTFMetallic_Roughness::MaterialConstants*>(data);
+
+	sceneUniformData->colorFactors = glm::vec4{ 1,1,1,1 };
+	sceneUniformData->metal_rough_factors = glm::vec4{ 1,0.5,0,0 };
+
+	engine.mainDeletionQueue.push_allocated_buffer(materialConstants);
+
+	materialResources.dataBuffer = materialConstants.buffer;
+	materialResources.dataBufferOffset = 0;
+
+	defaultData = metalRoughMaterial.write_material(engine.device, MaterialPass::MainColor, materialResources, globalDescriptorAllocator);
+
+	defaultTransparentData = metalRoughMaterial.write_material(engine.device, MaterialPass::Transparent, materialResources, globalDescriptorAllocator);
+
+	// the test mesh texture never changes, allocated once so cached commands can keep it bound
+	meshImageDescriptors = globalDescriptorAllocator.allocate(engine.device, singleImageDescriptorLayout);
+	{
+		DescriptorWriter writer;
+		writer.write_image(0, errorCheckerBoardImage.imageView, defaultSamplerNearest, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		writer.update_set(engine.device, meshImageDescriptors);
+	}
+
+	testMaterial.pipeline = &meshPipeline;
+	testMaterial.materialSet = meshImageDescriptors;
+	testMaterial.passType = MaterialPass::MainColor;
+
+	batchVersion++;
+	mark_dirty(DIRTY_SCENE);
+
+
+}
+
+void Renderer::update_scene() {
+
+	glm::mat4 view = glm::translate(glm::vec3{ 0,0,-5 });
+	// camera projection
+	// reverse z, near and far are swapped so depth precision goes to the distance
+	glm::mat4 projection = glm::perspective(glm::radians(70.f), (float)drawExtent.width / (float)drawExtent.height, 10000.0f, 0.1f);
+
+	projection[1][1] *= -1;
+
+	glm::mat4 viewproj = projection * view;
+
+	// a camera that moved since the last redraw invalidates the retained image
+	if (viewproj != sceneData.viewproj) {
+		mark_dirty(DIRTY_CAMERA);
+	}
+
+	sceneData.view = view;
+	sceneData.proj = projection;
+	sceneData.viewproj = viewproj;
+
+	// some default lighting parameters
+	sceneData.ambientColor = glm::vec4(.1f);
+	sceneData.sunlightColor = glm::vec4(1.f);
+	sceneData.sunlightDirection = glm::vec4(0, 1, 0.5, 1.f);
+}
+
+void Renderer::build_draw_list() {
+
+	drawList.clear();
+	drawListVersion++;
+
+	int grid = std::max(objectGridSize, 1);
+
+	// an object space error of 1 at distance d covers this many pixels divided by d
+	glm::vec3 cameraPosition = glm::inverse(sceneData.view)[3];
+	float pixelsPerUnit = std::abs(sceneData.proj[1][1]) * drawExtent.height * 0.5f;
+	float lodThreshold = lodPixelError * std::exp2(lodBias);
+	lodTriangles = 0;
+	fullTriangles = 0;
+
+	for (int x = 0; x < grid; x++) {
+		for (int z = 0; z < grid; z++) {
+			int i = x * grid + z;
+
+			// a grid of one is the old single test mesh
+			std::shared_ptr<MeshAsset>& mesh = testMeshes[(2 + x + z) % testMeshes.size()];
+
+			// centered on x, going away from the camera
+			glm::mat4 transform = glm::translate(glm::vec3{ (x - (grid - 1) * 0.5f) * 3.f, 0.f, -z * 3.f });
+
+			MaterialInstance* material = (x + z) % 2 == 0 ? &testMaterial : &defaultData;
+			if (i % 4 == 3) {
+				material = &defaultTransparentData;
+			}
+
+			for (const GeoSurface& surface : mesh->surfaces) {
+				const GeoSurface* range = &surface;
+
+				if (meshLods && surface.lodCount > 0) {
+					glm::vec3 center = transform * glm::vec4(surface.bounds.origin, 1.f);
+					float scale = std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])) });
+					// nearest point of the bounds, inside them the full surface is always drawn
+					float distance = glm::length(center - cameraPosition) - surface.bounds.sphereRadius * scale;
+
+					for (uint32_t l = 0; l < surface.lodCount && distance > 0.f; l++) {
+						const GeoSurface& lod = mesh->lods[surface.firstLod + l];
+						if (lod.lodError * scale * pixelsPerUnit / distance > lodThreshold) {
+							break;
+						}
+						range = &lod;
+					}
+				}
+
+				lodTriangles += range->count / 3;
+				fullTriangles += surface.count / 3;
+
+				RenderObject object;
+				object.indexCount = range->count;
+				object.firstIndex = range->startIndex;
+				object.vertexOffset = (int32_t)range->vertexOffset;
+				object.indexBuffer = mesh->meshBuffers.indexBuffer.buffer;
+				object.indexType = mesh->meshBuffers.indexType;
+				object.indexBufferAddress = mesh->meshBuffers.indexBufferAddress;
+				object.material = material;
+				object.transform = transform;
+				object.bounds = surface.bounds;
+				object.vertexBufferAddress = mesh->meshBuffers.vertexBufferAddress;
+				object.meshlets = mesh->meshBuffers.meshletBufferAddress + range->firstMeshlet * sizeof(GPUMeshlet);
+				object.meshletCount = range->meshletCount;
+				object.mesh = mesh.get();
+
+				drawList.objects.push_back(object);
+			}
+		}
+	}
+
+	drawList.sort(sceneData.view);
+
+	// opaque entries are grouped by everything that needs a bind. batches are ordered by state and index buffer,
+	// the state changes stay as few as in the sorted list and the layout doesnt change when only the camera moves
+	std::vector<IndirectBatch> lastBatches = std::move(indirectBatches);
+	indirectBatches.clear();
+	drawBatches.assign(drawList.order.size(), UINT32_MAX);
+
+	// draws with meshlets whose material has a mesh shading pipeline get their own batches
+	bool meshTasksActive = meshShading && engine.meshShaderSupported && gpuDrivenDraws && meshletCulling;
+
+	std::vector<IndirectBatch> batches;
+	std::map<std::tuple<uint32_t, VkBuffer, bool>, uint32_t> batchLookup;
+	for (uint32_t i = 0; i < drawList.order.size(); i++) {
+		const DrawList::SortEntry& entry = drawList.order[i];
+		const RenderObject& object = drawList.objects[entry.object];
+
+		if (object.material->passType == MaterialPass::Transparent) {
+			continue;
+		}
+
+		bool meshTasks = meshTasksActive && object.meshletCount > 0 && object.material->meshShaderPipeline != nullptr;
+
+		auto [it, inserted] = batchLookup.try_emplace({ entry.state, object.indexBuffer, meshTasks }, (uint32_t)batches.size());
+		if (inserted) {
+			batches.push_back({ i, 0, 0, entry.state, object.indexBuffer, meshTasks });
+		}
+
+		drawBatches[i] = it->second;
+		// a task command covers every meshlet of the draw
+		batches[it->second].maxDraws += (meshletCulling && object.meshletCount > 0 && !meshTasks) ? object.meshletCount : 1;
+	}
+
+	// the map is already in batch order
+	std::vector<uint32_t> batchOrder(batches.size());
+	uint32_t commandOffset = 0;
+	for (auto& [key, index] : batchLookup) {
+		batchOrder[index] = (uint32_t)indirectBatches.size();
+
+		IndirectBatch& batch = indirectBatches.emplace_back(batches[index]);
+		batch.commandOffset = commandOffset;
+		commandOffset += batch.maxDraws;
+	}
+	indirectCommandCount = commandOffset;
+
+	for (uint32_t& batch : drawBatches) {
+		if (batch != UINT32_MAX) {
+			batch = batchOrder[batch];
+		}
+	}
+
+	// recorded indirect draws only go stale when the batches do, a camera move alone keeps them
+	if (indirectBatches != lastBatches) {
+		batchVersion++;
+	}
+
+	// the list is rebuilt whenever the camera moves, so the visible set is too
+	visibleDraws.clear();
+	if (cpuCulling) {
+		cullBounds.clear();
+		cullBounds.reserve(drawList.order.size());
+		for (const DrawList::SortEntry& entry : drawList.order) {
+			const RenderObject& object = drawList.objects[entry.object];
+			cullBounds.push_back(object.bounds, object.transform);
+		}
+
+		culling::cull(cullBounds, frustum_from_matrix(sceneData.viewproj), visibleDraws, cullPath);
+	}
+
+	// handed to the worker here and collected by the geometry pass, everything recorded in between overlaps it
+	if (softwareOcclusion) {
+		uint32_t occlusionWidth = (uint32_t)occlusionResolution;
+		uint32_t occlusionHeight = std::max(occlusionWidth * drawExtent.height / std::max(drawExtent.width, 1u), 1u);
+		occlusionRasterizer.resize(occlusionWidth, occlusionHeight);
+
+		std::vector<SoftwareOcclusion::Occluder> occluders;
+		std::vector<SoftwareOcclusion::Candidate> candidates;
+
+		// only what survived the frustum, an occluder outside of it wouldnt cover any pixel anyway
+		uint32_t candidateCount = cpuCulling ? (uint32_t)visibleDraws.size() : (uint32_t)drawList.order.size();
+		candidates.reserve(candidateCount);
+		for (uint32_t n = 0; n < candidateCount; n++) {
+			uint32_t i = cpuCulling ? visibleDraws[n] : n;
+			const RenderObject& object = drawList.objects[drawList.order[i].object];
+
+			// the gpu culls its batched draws itself, testing them here would only cost worker time
+			if (!gpuDrivenDraws || drawBatches[i] == UINT32_MAX) {
+				candidates.push_back({ i, object.bounds, object.transform });
+			}
+
+			if (object.mesh->occluder && object.material->passType != MaterialPass::Transparent) {
+				occluders.push_back({ object.mesh->cpuPositions.data(), object.mesh->cpuIndices.data() + object.firstIndex, object.indexCount, object.transform });
+			}
+		}
+
+		occlusionRasterizer.start(sceneData.viewproj, std::move(occluders), std::move(candidates));
+	}
+}
+
+void Renderer::render_pass_geometry(VkCommandBuffer cmd, GeometryPass pass, GeometryDraws draws) {
+
+	// draws go through the recorder so repeated binds between draws are dropped
+	CommandRecorder recorder(cmd, &recordStats);
+
+	//set dynamic viewport and scissor
+	VkViewport viewport = {};
+	viewport.x = 0;
+	viewport.y = 0;
+	viewport.width = drawExtent.width;
+	viewport.height = drawExtent.height;
+	viewport.minDepth = 0.f;
+	viewport.maxDepth = 1.f;
+
+	recorder.set_viewport(viewport);
+
+	VkRect2D scissor = {};
+	scissor.offset.x = 0;
+	scissor.offset.y = 0;
+	scissor.extent.width = viewport.width;
+	scissor.extent.height = viewport.height;
+
+	recorder.set_scissor(scissor);
+
+	FrameData& frame = engine.get_current_frame();
+
+	// the draw data of the frame slot, the only push of the pass
+	GPUDrawPushConstants pushConstants;
+	pushConstants.drawDataBuffer = frame.drawDataAddress;
+
+	uint32_t lastState = UINT32_MAX;
+
+	auto bind_state = [&](const DrawList::SortEntry& entry, const RenderObject& object) {
+		if (entry.state == lastState) {
+			return;
+		}
+		lastState = entry.state;
+		VkPipelineLayout layout = object.material->pipeline->pipelineLayout.layout;
+
+		recorder.bind_pipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, managePipeline.get_pipeline(object.material->pipeline->pipelineID));
+
+		// nothing that changes per frame is recorded here, the camera comes from the scene buffer of the frame slot
+		VkDescriptorSet sets[] = { frame.sceneDescriptor, object.material->materialSet };
+		recorder.bind_descriptor_sets(VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 2, sets);
+
+		// layouts that share the range keep it, the recorder drops the repeat
+		recorder.push_constants(layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
+	};
+
+	// without hi-z the late half of the buffers is never written, the queries alone split the pass
+	bool indirectDraws = gpuDrivenDraws && (pass != GeometryPass::Late || hizActive) && draws != GeometryDraws::Direct;
+
+	// transparent draws blend over everything opaque, so with occlusion culling they wait for the late pass.
+	// with queries the early pass also draws the opaque draws that arent queried, they are the occluders
+	bool queryPass = queriesActive && pass != GeometryPass::All;
+	bool cpuDraws = (pass != GeometryPass::Early || queryPass) && draws != GeometryDraws::Indirect;
+
+	// visible indices come out of both culls in increasing order, so the sort order holds either way
+	const std::vector<uint32_t>* visible = nullptr;
+	uint32_t drawCount = 0;
+	if (cpuDraws) {
+		if (softwareOcclusion) {
+			// blocks only if the worker is still busy, it started when the draw list was built
+			visible = &occlusionRasterizer.wait();
+			occlusionStats = occlusionRasterizer.get_stats();
+		}
+		else if (cpuCulling) {
+			visible = &visibleDraws;
+		}
+		drawCount = visible ? (uint32_t)visible->size() : (uint32_t)drawList.order.size();
+	}
+
+	if (queryPass && pass == GeometryPass::Early) {
+		drawQueries.assign(drawList.order.size(), UINT32_MAX);
+		queriedDraws.clear();
+
+		for (uint32_t n = 0; n < drawCount; n++) {
+			uint32_t i = visible ? (*visible)[n] : n;
+			const RenderObject& object = drawList.objects[drawList.order[i].object];
+
+			if ((gpuDrivenDraws && drawBatches[i] != UINT32_MAX) || object.material->passType == MaterialPass::Transparent
+				|| object.indexCount < (uint32_t)occlusionQueryMinIndices) {
+				continue;
+			}
+
+			// a box reaching past the near plane loses its front faces and would read as hidden, it is drawn as is
+			glm::mat4 mvp = sceneData.viewproj * object.transform;
+			bool inFront = true;
+			for (int c = 0; c < 8 && inFront; c++) {
+				glm::vec3 corner = object.bounds.origin + object.bounds.extents * glm::vec3((c & 1) ? 1.f : -1.f, (c & 2) ? 1.f : -1.f, (c & 4) ? 1.f : -1.f);
+				glm::vec4 clip = mvp * glm::vec4(corner, 1.f);
+				inFront = clip.w > 0.f && clip.z <= clip.w;
+			}
+			if (!inFront) {
+				continue;
+			}
+
+			drawQueries[i] = (uint32_t)queriedDraws.size();
+			queriedDraws.push_back(i);
+		}
+
+		frame.occlusionQueryCount = (uint32_t)queriedDraws.size();
+	}
+
+	// the draws recorded on the cpu that belong to this pass, and their query slot
+	auto cpu_draw_in_pass = [&](uint32_t i, uint32_t& query) {
+		query = UINT32_MAX;
+		if (gpuDrivenDraws && drawBatches[i] != UINT32_MAX) {
+			return false;
+		}
+		if (!queryPass) {
+			return true;
+		}
+
+		query = drawQueries[i];
+		const RenderObject& object = drawList.objects[drawList.order[i].object];
+		bool early = query == UINT32_MAX && object.material->passType != MaterialPass::Transparent;
+		return early == (pass == GeometryPass::Early);
+	};
+
+	// the opaque draws of the pass go into the depth first with only their positions, the color pass then
+	// shades every covered pixel once. queried draws are left to the color pass, their query isnt in yet.
+	// the late pass is only what the early depth missed, there the prepass would save little
+	if (depthPrepass && pass != GeometryPass::Late) {
+		VkPipelineLayout prepassLayout = managePipeline.get_layout(depthPrepassPipeline.pipelineLayout.pipelineLayoutID);
+		recorder.bind_pipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, managePipeline.get_pipeline(depthPrepassPipeline.pipelineID));
+		recorder.bind_descriptor_sets(VK_PIPELINE_BIND_POINT_GRAPHICS, prepassLayout, 0, 1, &frame.sceneDescriptor);
+		recorder.push_constants(prepassLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
+
+		// batches only hold opaque draws of one index buffer, so of one mesh. the commands are the early ones
+		if (indirectDraws) {
+			for (uint32_t b = 0; b < indirectBatches.size(); b++) {
+				const IndirectBatch& batch = indirectBatches[b];
+				const RenderObject& object = drawList.objects[drawList.order[batch.firstEntry].object];
+				// the task commands have no index ranges to draw the depth from, those draws only go in the color pass
+				if (batch.meshTasks || object.mesh->meshBuffers.positionBufferAddress == 0) {
+					continue;
+				}
+
+				recorder.bind_index_buffer(object.indexBuffer, 0, object.indexType);
+				recorder.draw_indexed_indirect_count(frame.indirectBuffer.buffer, batch.commandOffset * sizeof(VkDrawIndexedIndirectCommand),
+					frame.countBuffer.buffer, b * sizeof(uint32_t), batch.maxDraws, sizeof(VkDrawIndexedIndirectCommand));
+			}
+		}
+
+		for (uint32_t n = 0; n < drawCount; n++) {
+			uint32_t i = visible ? (*visible)[n] : n;
+			const RenderObject& object = drawList.objects[drawList.order[i].object];
+
+			uint32_t query;
+			if (!cpu_draw_in_pass(i, query) || query != UINT32_MAX || object.material->passType == MaterialPass::Transparent
+				|| object.mesh->meshBuffers.positionBufferAddress == 0) {
+				continue;
+			}
+
+			recorder.bind_index_buffer(object.indexBuffer, 0, object.indexType);
+			recorder.draw_indexed(object.indexCount, 1, object.firstIndex, object.vertexOffset, i);
+		}
+	}
+
+	if (indirectDraws) {
+		// the late phase has its own half of the command and count buffers
+		size_t commandPhase = pass == GeometryPass::Late ? frame.commandCapacity : 0;
+		size_t countPhase = pass == GeometryPass::Late ? frame.drawDataCapacity : 0;
+
+		// the cull pass wrote the surviving commands and how many there are, the cpu never sees the result
+		for (uint32_t b = 0; b < indirectBatches.size(); b++) {
+			const IndirectBatch& batch = indirectBatches[b];
+			const DrawList::SortEntry& entry = drawList.order[batch.firstEntry];
+			const RenderObject& object = drawList.objects[entry.object];
+
+			if (batch.meshTasks) {
+				// the task shader finds every draw through its command, the mesh shader reads the meshlet indices itself
+				PipelineResource* meshPipeline = object.material->meshShaderPipeline;
+				VkPipelineLayout meshLayout = meshPipeline->pipelineLayout.layout;
+				recorder.bind_pipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, managePipeline.get_pipeline(meshPipeline->pipelineID));
+
+				VkDescriptorSet sets[] = { frame.sceneDescriptor, object.material->materialSet };
+				recorder.bind_descriptor_sets(VK_PIPELINE_BIND_POINT_GRAPHICS, meshLayout, 0, 2, sets);
+
+				MeshTaskPushConstants taskConstants{};
+				taskConstants.drawDataBuffer = frame.drawDataAddress;
+				taskConstants.cullDataBuffer = frame.cullDataAddress;
+				taskConstants.commandBuffer = frame.indirectAddress;
+				taskConstants.paramsBuffer = frame.cullParamsAddress;
+				taskConstants.indexBuffer = object.indexBufferAddress;
+				taskConstants.commandOffset = (uint32_t)(commandPhase + batch.commandOffset);
+				taskConstants.shortIndices = object.indexType == VK_INDEX_TYPE_UINT16 ? 1 : 0;
+				recorder.push_constants(meshLayout, VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT, 0, sizeof(MeshTaskPushConstants), &taskConstants);
+
+				// the pipeline changed under the state, the next batch binds its own again
+				lastState = UINT32_MAX;
+
+				recorder.draw_mesh_tasks_indirect_count(engine.cmdDrawMeshTasksIndirectCount, frame.indirectBuffer.buffer, (commandPhase + batch.commandOffset) * sizeof(VkDrawIndexedIndirectCommand),
+					frame.countBuffer.buffer, (countPhase + b) * sizeof(uint32_t), batch.maxDraws, sizeof(VkDrawIndexedIndirectCommand));
+				continue;
+			}
+
+			bind_state(entry, object);
+			recorder.bind_index_buffer(object.indexBuffer, 0, object.indexType);
+
+			recorder.draw_indexed_indirect_count(frame.indirectBuffer.buffer, (commandPhase + batch.commandOffset) * sizeof(VkDrawIndexedIndirectCommand),
+				frame.countBuffer.buffer, (countPhase + b) * sizeof(uint32_t), batch.maxDraws, sizeof(VkDrawIndexedIndirectCommand));
+		}
+	}
+
+	if (!cpuDraws) {
+		return;
+	}
+
+	// sorted by state, so pipeline and material only get bound when the state part of the key changes
+	for (uint32_t n = 0; n < drawCount; n++) {
+		uint32_t i = visible ? (*visible)[n] : n;
+
+		uint32_t query;
+		if (!cpu_draw_in_pass(i, query)) {
+			continue;
+		}
+
+		const DrawList::SortEntry& entry = drawList.order[i];
+		const RenderObject& object = drawList.objects[entry.object];
+
+		bind_state(entry, object);
+		recorder.bind_index_buffer(object.indexBuffer, 0, object.indexType);
+
+		if (query != UINT32_MAX) {
+			// the gpu drops the draw if none of the box samples passed, the result never comes back to the cpu
+			VkConditionalRenderingBeginInfoEXT conditionalInfo{ .sType = VK_STRUCTURE_TYPE_CONDITIONAL_RENDERING_BEGIN_INFO_EXT };
+			conditionalInfo.buffer = frame.queryResultBuffer.buffer;
+			conditionalInfo.offset = query * sizeof(uint32_t);
+			engine.cmdBeginConditionalRendering(cmd, &conditionalInfo);
+
+			recorder.draw_indexed(object.indexCount, 1, object.firstIndex, object.vertexOffset, i);
+
+			engine.cmdEndConditionalRendering(cmd);
+			continue;
+		}
+
+		// the draw index goes through firstInstance, no draw parameters feature needed
+		recorder.draw_indexed(object.indexCount, 1, object.firstIndex, object.vertexOffset, i);
+	}
+
+	if (!queryPass || pass != GeometryPass::Early || queriedDraws.empty()) {
+		return;
+	}
+
+	// the boxes go last so every opaque draw that isnt queried is already in the depth
+	VkPipelineLayout proxyLayout = managePipeline.get_layout(occlusionProxyPipeline.pipelineLayout.pipelineLayoutID);
+	recorder.bind_pipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, managePipeline.get_pipeline(occlusionProxyPipeline.pipelineID));
+
+	for (uint32_t q = 0; q < queriedDraws.size(); q++) {
+		const RenderObject& object = drawList.objects[drawList.order[queriedDraws[q]].object];
+
+		// flat bounds are given some thickness, a box with no area never passes a sample
+		OcclusionProxyPushConstants proxyConstants;
+		proxyConstants.boxMatrix = sceneData.viewproj * object.transform * glm::translate(object.bounds.origin) * glm::scale(glm::max(object.bounds.extents, glm::vec3(1e-3f)));
+		recorder.push_constants(proxyLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(OcclusionProxyPushConstants), &proxyConstants);
 
-	rect_indices[3] = 2;
-	rect_indices[4] = 1;
-	rect_indices[5] = 3;
+		vkCmdBeginQuery(cmd, frame.occlusionQueryPool, q, 0);
+		recorder.draw(14, 1, 0, 0);
+		vkCmdEndQuery(cmd, frame.occlusionQueryPool, q);
+	}
+}
 
-	rectangle = engine.uploadMesh(rect_indices, rect_vertices);
+void Renderer::write_draw_data(FrameData& frame) {
 
-	testMeshes = loadGltfMeshes(&engine, "C:/Users/Alberto/source/repos/GROTESK/GROTESK/res/assets/basicmesh.glb").value();
+	size_t count = drawList.order.size();
 
-	uint32_t white = glm::packUnorm4x8(glm::vec4(1, 1, 1, 1));
-	whiteImage = create_image((void*)&white, VkExtent3D{ 1, 1, 1 }, VK_FORMAT_R8G8B8A8_UNORM,
-		VK_IMAGE_USAGE_SAMPLED_BIT);
+	if (count > frame.drawDataCapacity) {
+		// the slot fence was waited, nothing still reads the old buffer
+		if (frame.drawDataCapacity > 0) {
+			vmaDestroyBuffer(engine.vmaAllocator, frame.drawDataBuffer.buffer, frame.drawDataBuffer.allocation);
+			vmaDestroyBuffer(engine.vmaAllocator, frame.cullDataBuffer.buffer, frame.cullDataBuffer.allocation);
+			vmaDestroyBuffer(engine.vmaAllocator, frame.countBuffer.buffer, frame.countBuffer.allocation);
+			vmaDestroyBuffer(engine.vmaAllocator, frame.visibilityBuffer.buffer, frame.visibilityBuffer.allocation);
+			vmaDestroyBuffer(engine.vmaAllocator, frame.queryResultBuffer.buffer, frame.queryResultBuffer.allocation);
+			vkDestroyQueryPool(engine.device, frame.occlusionQueryPool, engine.vkAllocator);
+		}
 
-	uint32_t grey = glm::packUnorm4x8(glm::vec4(0.66f, 0.66f, 0.66f, 1));
-	greyImage = create_image((void*)&grey, VkExtent3D{ 1, 1, 1 }, VK_FORMAT_R8G8B8A8_UNORM,
-		VK_IMAGE_USAGE_SAMPLED_BIT);
+		size_t capacity = std::max<size_t>(frame.drawDataCapacity, 1024);
+		while (capacity < count) {
+			capacity *= 2;
+		}
 
-	uint32_t black = glm::packUnorm4x8(glm::vec4(0, 0, 0, 1));
-	blackImage = create_image((void*)&black, VkExtent3D{ 1, 1, 1 }, VK_FORMAT_R8G8B8A8_UNORM,
-		VK_IMAGE_USAGE_SAMPLED_BIT);
+		frame.drawDataBuffer = engine.create_buffer(capacity * sizeof(GPUDrawData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		frame.drawDataCapacity = capacity;
+		frame.bufferVersion++;
+		// the new buffers start out empty
+		frame.drawDataVersion = 0;
+		frame.cullDataVersion = 0;
+
+		// there are never more batches than draws, so the counts fit the same capacity. counts are doubled,
+		// the early culling phase uses the first half and the late phase the second
+		frame.cullDataBuffer = engine.create_buffer(capacity * sizeof(GPUCullData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		frame.countBuffer = engine.create_buffer(2 * capacity * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+		frame.visibilityBuffer = engine.create_buffer(capacity * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+
+		// host visible so the skipped draws can be counted once the slot comes around again
+		VkBufferUsageFlags queryResultUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		if (engine.conditionalRenderingSupported) {
+			queryResultUsage |= VK_BUFFER_USAGE_CONDITIONAL_RENDERING_BIT_EXT;
+		}
+		frame.queryResultBuffer = engine.create_buffer(capacity * sizeof(uint32_t), queryResultUsage, VMA_MEMORY_USAGE_GPU_TO_CPU);
+		frame.occlusionQueryCount = 0;
+
+		VkQueryPoolCreateInfo queryPoolInfo{ .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+		queryPoolInfo.queryType = VK_QUERY_TYPE_OCCLUSION;
+		queryPoolInfo.queryCount = (uint32_t)capacity;
+		VK_CHECK(vkCreateQueryPool(engine.device, &queryPoolInfo, engine.vkAllocator, &frame.occlusionQueryPool));
+
+		VkBufferDeviceAddressInfo addressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = frame.drawDataBuffer.buffer };
+		frame.drawDataAddress = vkGetBufferDeviceAddress(engine.device, &addressInfo);
+		addressInfo.buffer = frame.cullDataBuffer.buffer;
+		frame.cullDataAddress = vkGetBufferDeviceAddress(engine.device, &addressInfo);
+		addressInfo.buffer = frame.countBuffer.buffer;
+		frame.countAddress = vkGetBufferDeviceAddress(engine.device, &addressInfo);
+		addressInfo.buffer = frame.visibilityBuffer.buffer;
+		frame.visibilityAddress = vkGetBufferDeviceAddress(engine.device, &addressInfo);
+	}
 
-	uint32_t magenta = glm::packUnorm4x8(glm::vec4(1, 0, 1, 1));
-	std::array<uint32_t, 16 * 16 > pixels; //for 16x16 checkerboard texture
-	for (int x = 0; x < 16; x++) {
-		for (int y = 0; y < 16; y++) {
-			pixels[y * 16 + x] = ((x % 2) ^ (y % 2)) ? magenta : black;
+	// straight into the mapped buffer in draw order. the list only changes when it is rebuilt,
+	// a slot that already holds this version still has the same objects and transforms
+	GPUDrawData* drawData = (GPUDrawData*)frame.drawDataBuffer.info.pMappedData;
+	if (frame.drawDataVersion != drawListVersion) {
+		for (size_t i = 0; i < count; i++) {
+			const DrawList::SortEntry& entry = drawList.order[i];
+			const RenderObject& object = drawList.objects[entry.object];
+
+			drawData[i].worldMatrix = object.transform;
+			drawData[i].vertexBuffer = object.vertexBufferAddress;
+			drawData[i].materialIndex = material_index(entry);
+			drawData[i].vertexFormat = (uint32_t)object.mesh->meshBuffers.vertexFormat;
+			drawData[i].positionBuffer = object.mesh->meshBuffers.positionBufferAddress;
+			drawData[i].positionOffset = object.mesh->meshBuffers.positionOffset;
+			drawData[i].positionScale = object.mesh->meshBuffers.positionScale;
 		}
+		frame.drawDataVersion = drawListVersion;
 	}
-	errorCheckerBoardImage = create_image(pixels.data(), VkExtent3D{ 16, 16, 1 }, VK_FORMAT_R8G8B8A8_UNORM,
-		VK_IMAGE_USAGE_SAMPLED_BIT);
 
-	VkSamplerCreateInfo samplInfo = { .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
-	samplInfo.magFilter = VK_FILTER_NEAREST;
-	samplInfo.minFilter = VK_FILTER_NEAREST;
+	if (!gpuDrivenDraws) {
+		return;
+	}
 
-	vkCreateSampler(engine.device, &samplInfo, engine.vkAllocator, &defaultSamplerNearest);
+	if (indirectCommandCount > frame.commandCapacity) {
+		if (frame.commandCapacity > 0) {
+			vmaDestroyBuffer(engine.vmaAllocator, frame.indirectBuffer.buffer, frame.indirectBuffer.allocation);
+		}
 
-	samplInfo.magFilter = VK_FILTER_LINEAR;
-	samplInfo.minFilter = VK_FILTER_LINEAR;
-	vkCreateSampler(engine.device, &samplInfo, engine.vkAllocator, &defaultSamplerLinear);
+		size_t capacity = std::max<size_t>(frame.commandCapacity, 1024);
+		while (capacity < indirectCommandCount) {
+			capacity *= 2;
+		}
+		frame.commandCapacity = capacity;
 
+		frame.bufferVersion++;
 
-	engine.mainDeletionQueue.push_sampler(defaultSamplerNearest);
-	engine.mainDeletionQueue.push_sampler(defaultSamplerLinear);
-	engine.mainDeletionQueue.push_allocated_image(whiteImage);
-	engine.mainDeletionQueue.push_allocated_image(blackImage);
-	engine.mainDeletionQueue.push_allocated_image(greyImage);
-	engine.mainDeletionQueue.push_allocated_image(errorCheckerBoardImage);
-	engine.mainDeletionQueue.push_mesh_buffer_deletion(rectangle);
+		// doubled like the counts, one half per culling phase
+		frame.indirectBuffer = engine.create_buffer(2 * capacity * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
 
+		VkBufferDeviceAddressInfo addressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = frame.indirectBuffer.buffer };
+		frame.indirectAddress = vkGetBufferDeviceAddress(engine.device, &addressInfo);
+	}
 
-	GLTFMetallic_Roughness::MaterialResources materialResources;
-	materialResources.colorImage = whiteImage;
-	materialResources.colorSampler = defaultSamplerLinear;
-	materialResources.metalRoughImage = whiteImage;
-	materialResources.metalRoughSampler = defaultSamplerLinear;
+	// the batches are rebuilt with the list, so the same version covers them
+	GPUCullData* cullData = (GPUCullData*)frame.cullDataBuffer.info.pMappedData;
+	if (frame.cullDataVersion != drawListVersion) {
+		for (size_t i = 0; i < count; i++) {
+			const RenderObject& object = drawList.objects[drawList.order[i].object];
+
+			cullData[i].sphere = glm::vec4(object.bounds.origin, object.bounds.sphereRadius);
+			cullData[i].indexCount = object.indexCount;
+			cullData[i].firstIndex = object.firstIndex;
+			cullData[i].batch = drawBatches[i];
+			cullData[i].commandOffset = drawBatches[i] != UINT32_MAX ? indirectBatches[drawBatches[i]].commandOffset : 0;
+			// the batches only made room for meshlets while the mode is on
+			bool meshlets = meshletCulling && object.meshletCount > 0;
+			cullData[i].meshlets = meshlets ? object.meshlets : 0;
+			cullData[i].meshletCount = meshlets ? object.meshletCount : 0;
+			cullData[i].vertexOffset = object.vertexOffset;
+			cullData[i].meshTasks = drawBatches[i] != UINT32_MAX && indirectBatches[drawBatches[i]].meshTasks ? 1 : 0;
+		}
+		frame.cullDataVersion = drawListVersion;
+	}
 
-	AllocatedBuffer materialConstants = engine.create_buffer(sizeof(GLTFMetallic_Roughness::MaterialConstants), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	// level 0 of the pyramid is the largest power of two that fits the draw extent
+	VkExtent2D pyramidExtent{ std::max(std::bit_floor(drawExtent.width), 1u), std::max(std::bit_floor(drawExtent.height), 1u) };
+
+	// the pyramid of the last draw is only any use if it covers the same area
+	bool pyramidUsable = occlusionCulling && depthPyramidValid
+		&& pyramidExtent.width == depthPyramidExtent.width && pyramidExtent.height == depthPyramidExtent.height;
+
+	depthPyramidExtent = pyramidExtent;
+	depthPyramidLevels = (uint32_t)std::bit_width(std::max(pyramidExtent.width, pyramidExtent.height));
+
+	GPUCullParams* params = (GPUCullParams*)frame.cullParamsBuffer.info.pMappedData;
+	params->viewproj = sceneData.viewproj;
+	params->occlusionViewProj = depthPyramidViewProj;
+	params->pyramidSize = glm::vec2(pyramidExtent.width, pyramidExtent.height);
+	params->pyramidLevels = depthPyramidLevels;
+	params->drawCount = (uint32_t)count;
+	params->occlusion = pyramidUsable ? 1 : 0;
+	params->phaseStride = (uint32_t)frame.drawDataCapacity;
+	params->commandStride = (uint32_t)frame.commandCapacity;
+	params->pad = 0;
+	params->cameraPosition = glm::inverse(sceneData.view)[3];
+}
 
-	void* data;
+void Renderer::begin_geometry_commands(VkCommandBuffer cmd, VkCommandBufferUsageFlags flags) {
 
-	vmaMapMemory(engine.vmaAllocator, materialConstants.allocation, &data);
+	// the slot fence was waited at the start of the frame, so the old recording isnt in use anymore
+	VK_CHECK(vkResetCommandBuffer(cmd, 0));
 
-	GLTFMetallic_Roughness::MaterialConstants* sceneUniformData = reinterpret_cast<GLTFMetallic_Roughness::MaterialConstants*>(data);
+	VkCommandBufferInheritanceRenderingInfo renderingInheritance{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO };
+	renderingInheritance.colorAttachmentCount = 1;
+	renderingInheritance.pColorAttachmentFormats = &engine.drawImage.imageFormat;
+	renderingInheritance.depthAttachmentFormat = engine.depthImage.imageFormat;
+	renderingInheritance.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkCommandBufferInheritanceInfo inheritance{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+	if (renderMode == RenderMode::Classic) {
+		inheritance.renderPass = drawImageRenderPass;
+		inheritance.subpass = 0;
+		inheritance.framebuffer = drawImageFrameBuffer;
+	}
+	else {
+		inheritance.pNext = &renderingInheritance;
+	}
 
-	sceneUniformData->colorFactors = glm::vec4{ 1,1,1,1 };
-	sceneUniformData->metal_rough_factors = glm::vec4{ 1,0.5,0,0 };
+	VkCommandBufferBeginInfo beginInfo = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | flags);
+	beginInfo.pInheritanceInfo = &inheritance;
 
-	engine.mainDeletionQueue.push_allocated_buffer(materialConstants);
+	VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+}
 
-	materialResources.dataBuffer = materialConstants.buffer;
-	materialResources.dataBufferOffset = 0;
+VkCommandBuffer Renderer::get_geometry_commands() {
+
+	FrameData& frame = engine.get_current_frame();
+
+	// the draw data and the commands the cull wrote are read through the buffers of the slot, so only their
+	// reallocation matters and not what is in them
+	GeometryCacheKey key;
+	key.batchVersion = batchVersion;
+	key.pipelineVersion = managePipeline.get_version();
+	key.framebufferVersion = framebufferVersion;
+	key.bufferVersion = frame.bufferVersion;
+	key.drawFormat = engine.drawImage.imageFormat;
+	key.drawExtent = drawExtent;
+	key.renderMode = renderMode;
+	key.depthPrepass = depthPrepass;
+
+	if (frame.geometryCacheKey == key) {
+		geometryReuses++;
+		return frame.geometryCommandBuffer;
+	}
 
-	defaultData = metalRoughMaterial.write_material(engine.device, MaterialPass::MainColor, materialResources, globalDescriptorAllocator);
+	begin_geometry_commands(frame.geometryCommandBuffer, 0);
+	render_pass_geometry(frame.geometryCommandBuffer, GeometryPass::All, GeometryDraws::Indirect);
+	VK_CHECK(vkEndCommandBuffer(frame.geometryCommandBuffer));
 
+	frame.geometryCacheKey = key;
+	geometryRecords++;
 
+	return frame.geometryCommandBuffer;
 }
 
-void Renderer::render_pass_geometry(VkCommandBuffer cmd) {
+VkCommandBuffer Renderer::get_direct_geometry_commands() {
 
+	FrameData& frame = engine.get_current_frame();
 
-	//set dynamic viewport and scissor
-	VkViewport viewport = {};
-	viewport.x = 0;
-	viewport.y = 0;
-	viewport.width = drawExtent.width;
-	viewport.height = drawExtent.height;
-	viewport.minDepth = 0.f;
-	viewport.maxDepth = 1.f;
+	// the draws picked on the cpu, also where the software occlusion job is collected
+	begin_geometry_commands(frame.directCommandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	render_pass_geometry(frame.directCommandBuffer, GeometryPass::All, GeometryDraws::Direct);
+	VK_CHECK(vkEndCommandBuffer(frame.directCommandBuffer));
 
-	vkCmdSetViewport(cmd, 0, 1, &viewport);
+	return frame.directCommandBuffer;
+}
 
-	VkRect2D scissor = {};
-	scissor.offset.x = 0;
-	scissor.offset.y = 0;
-	scissor.extent.width = viewport.width;
-	scissor.extent.height = viewport.height;
+void Renderer::render_imgui(VkCommandBuffer cmd) {
+	//classic renderpass
+	ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
+}
 
-	vkCmdSetScissor(cmd, 0, 1, &scissor);
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, managePipeline.get_pipeline(meshPipeline.pipelineID));
+void Renderer::render_dynamic_geometry(VkCommandBuffer cmd, GeometryPass pass) {
+	// color is loaded since the background pass wrote it
+	VkRenderingAttachmentInfo colorAttachment = vkinit::attachment_info(engine.drawImage.imageView, nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	VkRenderingAttachmentInfo depthAttachment = vkinit::depth_attachment_info(engine.depthImage.imageView, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+	// depth_attachment_info clears to 0, the far plane with reverse z like the classic pass
+	if (pass == GeometryPass::Late) {
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	}
 
-	VkDescriptorSet imageSet = engine.get_current_frame().frameDescriptors->allocate(engine.device, singleImageDescriptorLayout);
+	VkRenderingInfo renderInfo = vkinit::rendering_info(drawExtent, &colorAttachment, &depthAttachment);
 
-	{
-		DescriptorWriter writer;
-		writer.write_image(0, errorCheckerBoardImage.imageView, defaultSamplerNearest, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+	if (cacheGeometryCommands && gpuDrivenDraws && pass == GeometryPass::All) {
+		VkCommandBuffer geometry[] = { get_geometry_commands(), get_direct_geometry_commands() };
 
-		writer.update_set(engine.device, imageSet);
+		renderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+		vkCmdBeginRendering(cmd, &renderInfo);
+		vkCmdExecuteCommands(cmd, 2, geometry);
+	}
+	else {
+		vkCmdBeginRendering(cmd, &renderInfo);
+		render_pass_geometry(cmd, pass);
 	}
-	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, managePipeline.get_layout(meshPipeline.pipelineLayout.pipelineLayoutID), 0, 1, &imageSet, 0, nullptr);
 
-	GPUDrawPushConstants pushConstants;
+	vkCmdEndRendering(cmd);
+}
 
-	glm::mat4 view = glm::translate(glm::vec3{ 0,0,-5 });
-	// camera projection
-	glm::mat4 projection = glm::perspective(glm::radians(70.f), (float)drawExtent.width / (float)drawExtent.height, 0.1f, 10000.0f);
+void Renderer::render_composite(VkCommandBuffer cmd) {
 
-	projection[1][1] *= -1;
+	CommandRecorder recorder(cmd, &recordStats);
 
-	//pushConstants.worldMatrix = glm::mat4(1.0f);	
-	pushConstants.worldMatrix = projection * view;
-	pushConstants.vertexBuffer = testMeshes[2]->meshBuffers.vertexBufferAddress;
+	VkViewport viewport = {};
+	viewport.x = 0;
+	viewport.y = 0;
+	viewport.width = engine.swapchainExtent.width;
+	viewport.height = engine.swapchainExtent.height;
+	viewport.minDepth = 0.f;
+	viewport.maxDepth = 1.f;
 
-	vkCmdPushConstants(cmd, managePipeline.get_layout(meshPipeline.pipelineLayout.pipelineLayoutID), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
-	vkCmdBindIndexBuffer(cmd, testMeshes[2]->meshBuffers.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+	recorder.set_viewport(viewport);
 
-	vkCmdDrawIndexed(cmd, testMeshes[2]->surfaces[0].count, 1, testMeshes[2]->surfaces[0].startIndex, 0, 0);
+	VkRect2D scissor = {};
+	scissor.offset.x = 0;
+	scissor.offset.y = 0;
+	scissor.extent = engine.swapchainExtent;
 
-	AllocatedBuffer gpuSceneDataBuffer = engine.create_buffer(sizeof(GPUSceneData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-	engine.get_current_frame().deletionQueue.push_allocated_buffer(gpuSceneDataBuffer);
+	recorder.set_scissor(scissor);
 
-	void* mappedData = nullptr;
-	vmaMapMemory(engine.vmaAllocator, gpuSceneDataBuffer.allocation, &mappedData);
-	*(GPUSceneData*)mappedData = sceneData;
-	vmaUnmapMemory(engine.vmaAllocator, gpuSceneDataBuffer.allocation);
+	VkPipelineLayout layout = managePipeline.get_layout(compositePipeline.pipelineLayout.pipelineLayoutID);
 
-	VkDescriptorSet globalDescriptor = engine.get_current_frame().frameDescriptors->allocate(engine.device, gpuSceneDataDescriptorLayout);
-	
-	DescriptorWriter writer;
-	writer.write_buffer(0, gpuSceneDataBuffer.buffer, sizeof(GPUSceneData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-	writer.update_set(engine.device, globalDescriptor);
+	recorder.bind_pipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, managePipeline.get_pipeline(compositePipeline.pipelineID));
+	recorder.bind_descriptor_sets(VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &compositeDescriptors);
 
+	// only the draw extent part of the draw image holds the frame, it gets stretched over the whole swapchain
+	CompositePushConstants pushConstants;
+	pushConstants.uvScale.x = (float)drawExtent.width / (float)engine.drawImage.imageExtent.width;
+	pushConstants.uvScale.y = (float)drawExtent.height / (float)engine.drawImage.imageExtent.height;
 
-}
+	recorder.push_constants(layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(CompositePushConstants), &pushConstants);
 
-void Renderer::render_imgui(VkCommandBuffer cmd) {
-	//classic renderpass
-	ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
+	recorder.draw(3, 1, 0, 0);
 }
 
-void Renderer::render_dynamic_imgui(VkCommandBuffer cmd, VkImageView targetImageView) {
-	//inactive
+void Renderer::render_dynamic_composite(VkCommandBuffer cmd, VkImageView targetImageView) {
 	VkRenderingAttachmentInfo colorAttachment = vkinit::attachment_info(targetImageView, nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	// the composite covers every pixel, the old contents are never read
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	VkRenderingInfo renderInfo = vkinit::rendering_info(engine.swapchainExtent, &colorAttachment, nullptr);
 
 	vkCmdBeginRendering(cmd, &renderInfo);
 
+	render_composite(cmd);
 	ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
 
 	vkCmdEndRendering(cmd);
@@ -675,6 +2059,244 @@ void Renderer::render_background(VkCommandBuffer cmd) {
 	vkCmdDispatch(cmd, std::ceil(drawExtent.width / 16.0), std::ceil(drawExtent.height / 16.0), 1);
 }
 
+void Renderer::render_cull(VkCommandBuffer cmd, uint32_t phase) {
+
+	FrameData& frame = engine.get_current_frame();
+
+	// the graph only tracks images, so the hops between transfer, compute and indirect reads are done here
+	VkMemoryBarrier2 barrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+	if (phase == 0) {
+		// the counts of both phases start at zero
+		vkCmdFillBuffer(cmd, frame.countBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	}
+	else {
+		// the late phase reads the visibility the early one wrote
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	}
+
+	VkDependencyInfo depInfo{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	depInfo.memoryBarrierCount = 1;
+	depInfo.pMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(cmd, &depInfo);
+
+	CullPushConstants pushConstants;
+	pushConstants.drawDataBuffer = frame.drawDataAddress;
+	pushConstants.cullDataBuffer = frame.cullDataAddress;
+	pushConstants.commandBuffer = frame.indirectAddress;
+	pushConstants.countBuffer = frame.countAddress;
+	pushConstants.visibilityBuffer = frame.visibilityAddress;
+	pushConstants.paramsBuffer = frame.cullParamsAddress;
+	pushConstants.phase = phase;
+	pushConstants.pad = 0;
+
+	uint32_t drawCount = (uint32_t)drawList.order.size();
+
+	VkPipelineLayout layout = managePipeline.get_layout(cullPipelineLayoutID);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, managePipeline.get_pipeline(cullPipelineID));
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &cullDescriptors, 0, nullptr);
+	vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &pushConstants);
+	// one thread per draw, 64 wide groups
+	vkCmdDispatch(cmd, (drawCount + 63) / 64, 1, 1);
+
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT;
+	// the task shaders also read their commands as storage to find the draw
+	if (std::any_of(indirectBatches.begin(), indirectBatches.end(), [](const IndirectBatch& batch) { return batch.meshTasks; })) {
+		barrier.dstStageMask |= VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT;
+		barrier.dstAccessMask |= VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+	}
+	vkCmdPipelineBarrier2(cmd, &depInfo);
+}
+
+void Renderer::render_depth_pyramid(VkCommandBuffer cmd) {
+
+	VkPipelineLayout layout = managePipeline.get_layout(depthReducePipelineLayoutID);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, managePipeline.get_pipeline(depthReducePipelineID));
+
+	// every level reads the one before it, the whole pyramid stays in general so only memory has to be made visible
+	VkMemoryBarrier2 barrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+
+	VkDependencyInfo depInfo{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	depInfo.memoryBarrierCount = 1;
+	depInfo.pMemoryBarriers = &barrier;
+
+	DepthReducePushConstants pushConstants;
+	pushConstants.sourceSize = glm::ivec2(drawExtent.width, drawExtent.height);
+
+	for (uint32_t level = 0; level < depthPyramidLevels; level++) {
+		pushConstants.destinationSize = glm::ivec2(std::max(depthPyramidExtent.width >> level, 1u), std::max(depthPyramidExtent.height >> level, 1u));
+
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &depthReduceDescriptors[level], 0, nullptr);
+		vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthReducePushConstants), &pushConstants);
+		vkCmdDispatch(cmd, (pushConstants.destinationSize.x + 7) / 8, (pushConstants.destinationSize.y + 7) / 8, 1);
+
+		if (level + 1 < depthPyramidLevels) {
+			vkCmdPipelineBarrier2(cmd, &depInfo);
+		}
+
+		pushConstants.sourceSize = pushConstants.destinationSize;
+	}
+}
+
+bool Renderer::occlusion_debug_shown() const {
+	// nothing to show before the rasterizer was sized, the ui and the frame have to agree on this
+	return softwareOcclusion && showOcclusionDebug && occlusionRasterizer.get_width() > 0;
+}
+
+VkDescriptorSet Renderer::get_occlusion_debug_texture() const {
+	return occlusion_debug_shown() ? engine.get_current_frame().occlusionDebugTexture : VK_NULL_HANDLE;
+}
+
+void Renderer::render_occlusion_debug(VkCommandBuffer cmd, RGImage target) {
+
+	FrameData& frame = engine.get_current_frame();
+
+	// the geometry pass already collected the job, without a redraw none was started
+	occlusionRasterizer.wait();
+
+	const std::vector<float>& depth = occlusionRasterizer.get_depth();
+	uint32_t width = occlusionRasterizer.get_width();
+	uint32_t height = occlusionRasterizer.get_height();
+
+	// reverse z puts almost everything close to zero, scaled by the nearest value so the occluders stand out
+	float nearest = 0.f;
+	for (float d : depth) {
+		nearest = std::max(nearest, d);
+	}
+	float scale = nearest > 0.f ? 1.f / nearest : 0.f;
+
+	// this slot's fence was waited, the copy of the last use of the buffer is done
+	uint32_t* pixels = (uint32_t*)frame.occlusionDebugBuffer.info.pMappedData;
+	for (size_t i = 0; i < depth.size(); i++) {
+		pixels[i] = glm::packUnorm4x8(glm::vec4(glm::vec3(depth[i] * scale), 1.f));
+	}
+
+	VkBufferImageCopy copy{};
+	copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	copy.imageSubresource.layerCount = 1;
+	copy.imageExtent = { width, height, 1 };
+
+	vkCmdCopyBufferToImage(cmd, frame.occlusionDebugBuffer.buffer, renderGraph.get_image(target), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+
+	// the graph can hand out a different image every frame. only this slot binds the set and its fence was waited,
+	// and the composite that binds it is recorded after this pass
+	DescriptorWriter writer;
+	writer.write_image(0, renderGraph.get_view(target), defaultSamplerNearest, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+	writer.update_set(engine.device, frame.occlusionDebugTexture);
+}
+
+void Renderer::render_occlusion_query_results(VkCommandBuffer cmd) {
+
+	FrameData& frame = engine.get_current_frame();
+
+	if (frame.occlusionQueryCount == 0) {
+		return;
+	}
+
+	// the wait happens on the gpu, the copy stalls until the early pass finished its queries
+	vkCmdCopyQueryPoolResults(cmd, frame.occlusionQueryPool, 0, frame.occlusionQueryCount, frame.queryResultBuffer.buffer, 0, sizeof(uint32_t), VK_QUERY_RESULT_WAIT_BIT);
+
+	// the late pass reads the results as predicates, the host reads them for the stats
+	VkMemoryBarrier2 barrier{ .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2 };
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_CONDITIONAL_RENDERING_BIT_EXT | VK_PIPELINE_STAGE_2_HOST_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_CONDITIONAL_RENDERING_READ_BIT_EXT | VK_ACCESS_2_HOST_READ_BIT;
+
+	VkDependencyInfo depInfo{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+	depInfo.memoryBarrierCount = 1;
+	depInfo.pMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(cmd, &depInfo);
+}
+
+void Renderer::collect_occlusion_queries(FrameData& frame) {
+
+	if (frame.occlusionQueryCount == 0) {
+		return;
+	}
+
+	// the slot fence was waited, these are the results the gpu used a few frames ago. readback memory
+	// doesnt have to be coherent
+	vmaInvalidateAllocation(engine.vmaAllocator, frame.queryResultBuffer.allocation, 0, frame.occlusionQueryCount * sizeof(uint32_t));
+	const uint32_t* results = (const uint32_t*)frame.queryResultBuffer.info.pMappedData;
+
+	queryStats = {};
+	queryStats.queried = frame.occlusionQueryCount;
+	for (uint32_t q = 0; q < frame.occlusionQueryCount; q++) {
+		if (results[q] == 0) {
+			queryStats.skipped++;
+		}
+	}
+
+	frame.occlusionQueryCount = 0;
+}
+
+void Renderer::create_depth_pyramid() {
+
+	// the old pyramid goes out with the last submitted frame, same as the depth image it was built from
+	if (depthPyramid.image != VK_NULL_HANDLE) {
+		engine.get_last_frame().deletionQueue.push_deletion_lambda([device = engine.device, allocator = engine.vmaAllocator, callbacks = engine.vkAllocator, pyramid = depthPyramid, mips = depthPyramidMips]() {
+			for (VkImageView view : mips) {
+				vkDestroyImageView(device, view, callbacks);
+			}
+			vkDestroyImageView(device, pyramid.imageView, nullptr);
+			vmaDestroyImage(allocator, pyramid.image, pyramid.allocation);
+		});
+	}
+
+	// sized for the largest draw extent the depth image allows, a frame only uses the levels its extent needs
+	VkExtent3D size{ std::bit_floor(engine.depthImage.imageExtent.width), std::bit_floor(engine.depthImage.imageExtent.height), 1 };
+	depthPyramid = create_image(size, VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, true);
+
+	uint32_t levels = (uint32_t)std::bit_width(std::max(size.width, size.height));
+
+	depthPyramidMips.clear();
+	for (uint32_t level = 0; level < levels; level++) {
+		VkImageViewCreateInfo viewInfo = vkinit::imageview_create_info(VK_FORMAT_R32_SFLOAT, depthPyramid.image, VK_IMAGE_ASPECT_COLOR_BIT);
+		viewInfo.subresourceRange.baseMipLevel = level;
+		viewInfo.subresourceRange.levelCount = 1;
+
+		VkImageView view;
+		VK_CHECK(vkCreateImageView(engine.device, &viewInfo, engine.vkAllocator, &view));
+		depthPyramidMips.push_back(view);
+	}
+
+	// fresh sets like the draw image ones, frames in flight still have the old ones bound
+	DescriptorWriter writer;
+	cullDescriptors = drawTargetDescriptorAllocator.allocate(engine.device, cullDescriptorLayout);
+	writer.write_image(0, depthPyramid.imageView, depthPyramidSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+	writer.update_set(engine.device, cullDescriptors);
+
+	depthReduceDescriptors.clear();
+	for (uint32_t level = 0; level < levels; level++) {
+		VkDescriptorSet set = drawTargetDescriptorAllocator.allocate(engine.device, depthReduceDescriptorLayout);
+
+		writer.clear();
+		if (level == 0) {
+			writer.write_image(0, engine.depthImage.imageView, depthPyramidSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		}
+		else {
+			writer.write_image(0, depthPyramidMips[level - 1], depthPyramidSampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		}
+		writer.write_image(1, depthPyramidMips[level], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+		writer.update_set(engine.device, set);
+
+		depthReduceDescriptors.push_back(set);
+	}
+}
+
 void Renderer::create_draw_image_renderpass() {
 	VkAttachmentDescription colorAttachment = {};
 	colorAttachment.format = engine.drawImage.imageFormat; // VK_FORMAT_R16G16B16A16_SFLOAT
@@ -683,8 +2305,9 @@ void Renderer::create_draw_image_renderpass() {
 	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	// the render graph does the transitions around the pass, so the layouts stay as attachment layouts
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentDescription depthAttachment = {};
 	depthAttachment.format = engine.depthImage.imageFormat;
@@ -693,8 +2316,8 @@ void Renderer::create_draw_image_renderpass() {
 	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
 	
 
 	VkAttachmentReference colorAttachmentRef = {};
@@ -703,7 +2326,7 @@ void Renderer::create_draw_image_renderpass() {
 
 	VkAttachmentReference depthAttachmentRef = {};
 	depthAttachmentRef.attachment = 1;
-	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
 
 
 	VkSubpassDescription subpass = {};
@@ -714,38 +2337,38 @@ void Renderer::create_draw_image_renderpass() {
 
 	std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
 
-	VkSubpassDependency dependency = {};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	dependency.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
 	VkRenderPassCreateInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	renderPassInfo.attachmentCount = (uint32_t)attachments.size();
 	renderPassInfo.pAttachments = attachments.data();
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+	// no external dependencies, the render graph barriers in front of and behind the pass cover them
+	renderPassInfo.dependencyCount = 0;
+	renderPassInfo.pDependencies = nullptr;
 
 	VK_CHECK(vkCreateRenderPass(engine.device, &renderPassInfo, nullptr, &drawImageRenderPass));
 
 	engine.mainDeletionQueue.push_renderpass(drawImageRenderPass);
+
+	// load ops dont take part in render pass compatibility, so this one shares the framebuffer and pipelines
+	attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+
+	VK_CHECK(vkCreateRenderPass(engine.device, &renderPassInfo, nullptr, &drawImageLoadRenderPass));
+
+	engine.mainDeletionQueue.push_renderpass(drawImageLoadRenderPass);
 }
 
 void Renderer::create_swapchain_renderpass() {
 	VkAttachmentDescription colorAttachment = {};
 	colorAttachment.format = engine.swapchainImageFormat; // e.g., VK_FORMAT_B8G8R8A8_UNORM
 	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD; // Preserve copied data
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE; // the composite writes every pixel
 	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 
 	VkAttachmentReference colorAttachmentRef = {};
@@ -757,22 +2380,15 @@ void Renderer::create_swapchain_renderpass() {
 	subpass.colorAttachmentCount = 1;
 	subpass.pColorAttachments = &colorAttachmentRef;
 
-	VkSubpassDependency dependency = {};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT; // Wait for vkCmdCopyImage
-	dependency.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT; // Copy writes
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
 	VkRenderPassCreateInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	renderPassInfo.attachmentCount = 1;
 	renderPassInfo.pAttachments = &colorAttachment;
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+	// no external dependencies, the render graph barriers in front of and behind the pass cover them
+	renderPassInfo.dependencyCount = 0;
+	renderPassInfo.pDependencies = nullptr;
 
 	VK_CHECK(vkCreateRenderPass(engine.device, &renderPassInfo, nullptr, &swapchainRenderPass));
 
@@ -821,6 +2437,7 @@ void Renderer::create_draw_image_framebuffer() {
 	framebufferInfo.layers = 1; // Single layer
 
 	VK_CHECK(vkCreateFramebuffer(engine.device, &framebufferInfo, nullptr, &drawImageFrameBuffer));
+	framebufferVersion++;
 
 	engine.mainDeletionQueue.push_framebuffer(drawImageFrameBuffer);
 }
@@ -911,6 +2528,8 @@ void PipelineManager::manage_pipeline(PipelineResource& res, TrackShader trackSh
 
 	auto pipelineFinder = pipelineLookup.find(res.pipelineID);
 
+	version++;
+
 	if (pipelineFinder == pipelineLookup.end()) {
 		res.pipelineID = PipelineManager::createPipelineID();
 		pipelineLookup[res.pipelineID] = res.pipeline;
@@ -984,6 +2603,8 @@ void PipelineManager::manage_pipeline(PipelineResource& res, TrackShader trackSh
 void PipelineManager::store_pipeline(PipelineID pID, LayoutID lId, VkPipeline pipeline, VkPipelineLayout layout) {
 
 
+	version++;
+
 	auto plook = pipelineLookup.find(pID);
 	if (plook != pipelineLookup.end()) {
 		plook->second = pipeline;
@@ -1033,6 +2654,16 @@ void PipelineManager::track_shaders_for_hotload(PipelineResource& resource) {
 		shaderMap[resource.shader.computeShader.file].push_back(&resource);
 		fmt::print("Registered compute shader: {}\n", resource.shader.computeShader.file);
 	}
+
+	if (!resource.shader.taskShader.file.empty()) {
+		shaderMap[resource.shader.taskShader.file].push_back(&resource);
+		fmt::print("Registered task shader: {}\n", resource.shader.taskShader.file);
+	}
+
+	if (!resource.shader.meshShader.file.empty()) {
+		shaderMap[resource.shader.meshShader.file].push_back(&resource);
+		fmt::print("Registered mesh shader: {}\n", resource.shader.meshShader.file);
+	}
 }
 
 void Renderer::HotloadShader() {
@@ -1090,6 +2721,26 @@ void Renderer::HotloadShader() {
 					pipelinesToRebuild.insert(r);
 				}
 			}
+			if (file == r->shader.taskShader.file) {
+				fmt::print("Checking file: {} old: {} new: {}\n",
+					file,
+					r->shader.taskShader.lastModified.time_since_epoch().count(),
+					currentWriteTimeStamp.time_since_epoch().count());
+				if (currentWriteTimeStamp != r->shader.taskShader.lastModified) {
+					r->shader.taskShader.lastModified = currentWriteTimeStamp;
+					pipelinesToRebuild.insert(r);
+				}
+			}
+			if (file == r->shader.meshShader.file) {
+				fmt::print("Checking file: {} old: {} new: {}\n",
+					file,
+					r->shader.meshShader.lastModified.time_since_epoch().count(),
+					currentWriteTimeStamp.time_since_epoch().count());
+				if (currentWriteTimeStamp != r->shader.meshShader.lastModified) {
+					r->shader.meshShader.lastModified = currentWriteTimeStamp;
+					pipelinesToRebuild.insert(r);
+				}
+			}
 		}
 	}
 
@@ -1097,7 +2748,8 @@ void Renderer::HotloadShader() {
 
 		rebuild(engine.device, *r);
 		
-		managePipeline.manage_pipeline(*r, TrackShader::Yes);
+		// already in the shader map, tracking again would register it twice
+		managePipeline.manage_pipeline(*r, TrackShader::No);
 	}
 	pipelinesToRebuild.clear();
 
@@ -1139,6 +2791,20 @@ VkPipeline Renderer::rebuild(VkDevice device, PipelineResource& res)  {
 
 	VkShaderModule vertexModule = VK_NULL_HANDLE;
 	VkShaderModule fragmentModule = VK_NULL_HANDLE;
+	VkShaderModule taskModule = VK_NULL_HANDLE;
+	VkShaderModule meshModule = VK_NULL_HANDLE;
+
+	if (!res.shader.taskShader.file.empty()) {
+		taskModule = shaderUtil::compileToSPV(device, res.shader.taskShader.file, EShLangTask);
+		resConfig->shaderStages.push_back(vkinit::pipeline_shader_stage_create_info(
+			VK_SHADER_STAGE_TASK_BIT_EXT, taskModule));
+	}
+
+	if (!res.shader.meshShader.file.empty()) {
+		meshModule = shaderUtil::compileToSPV(device, res.shader.meshShader.file, EShLangMesh);
+		resConfig->shaderStages.push_back(vkinit::pipeline_shader_stage_create_info(
+			VK_SHADER_STAGE_MESH_BIT_EXT, meshModule));
+	}
 
 	if (!res.shader.vertexShader.file.empty()) {
 		vertexModule = shaderUtil::compileToSPV(device, res.shader.vertexShader.file, EShLangVertex);
@@ -1173,7 +2839,6 @@ VkPipeline Renderer::rebuild(VkDevice device, PipelineResource& res)  {
 	if (resConfig->renderMode == RenderMode::Dynamic) {
 		pipelineInfo.renderPass = VK_NULL_HANDLE;
 		pipelineInfo.subpass = 0;
-		resConfig->renderPass = VK_NULL_HANDLE;
 	}
 	else {
 		pipelineInfo.renderPass = resConfig->renderPass;
@@ -1207,6 +2872,8 @@ VkPipeline Renderer::rebuild(VkDevice device, PipelineResource& res)  {
 
 	if (vertexModule != VK_NULL_HANDLE) vkDestroyShaderModule(device, vertexModule, nullptr);
 	if (fragmentModule != VK_NULL_HANDLE) vkDestroyShaderModule(device, fragmentModule, nullptr);
+	if (taskModule != VK_NULL_HANDLE) vkDestroyShaderModule(device, taskModule, nullptr);
+	if (meshModule != VK_NULL_HANDLE) vkDestroyShaderModule(device, meshModule, nullptr);
 
 	return newPipeline;
 }
@@ -1242,7 +2909,11 @@ void GLTFMetallic_Roughness::build_pipelines(VulkanEngine* engine, Renderer* ren
 	layoutBuilder.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 	layoutBuilder.add_binding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 
-	materialLayout = layoutBuilder.build(engine->device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+	VkShaderStageFlags materialStages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	if (engine->meshShaderSupported) {
+		materialStages |= VK_SHADER_STAGE_MESH_BIT_EXT;
+	}
+	materialLayout = layoutBuilder.build(engine->device, materialStages);
 
 	VkDescriptorSetLayout layouts[] = { renderer->gpuSceneDataDescriptorLayout, materialLayout };
 
@@ -1268,14 +2939,16 @@ void GLTFMetallic_Roughness::build_pipelines(VulkanEngine* engine, Renderer* ren
 	builder.disable_blending();
 	builder.enable_depthtest(true, VK_COMPARE_OP_GREATER_OR_EQUAL);
 	builder.set_renderpass(renderer->drawImageRenderPass);
+	builder.set_color_attachment_format(engine->drawImage.imageFormat);
+	builder.set_depth_format(engine->depthImage.imageFormat);
 	builder.res->pipelineLayout.layout = sharedLayout.layout;
 
-	opaquePipeline.pipeline = builder.build_pipeline(engine->device, RenderMode::Classic, &opaquePipeline);
+	opaquePipeline.pipeline = builder.build_pipeline(engine->device, renderer->renderMode, &opaquePipeline);
 
 	builder.enable_blending_additive();
 	builder.enable_depthtest(false, VK_COMPARE_OP_GREATER_OR_EQUAL);
 	builder.res->pipelineLayout.layout = sharedLayout.layout;
-	transparentPipeline.pipeline = builder.build_pipeline(engine->device, RenderMode::Classic, &transparentPipeline);
+	transparentPipeline.pipeline = builder.build_pipeline(engine->device, renderer->renderMode, &transparentPipeline);
 
 	vkDestroyShaderModule(engine->device, meshVertShader, nullptr);
 	vkDestroyShaderModule(engine->device, meshFragShader, nullptr);
@@ -1283,9 +2956,75 @@ void GLTFMetallic_Roughness::build_pipelines(VulkanEngine* engine, Renderer* ren
 	renderer->managePipeline.manage_pipeline(opaquePipeline, TrackShader::Yes, &sharedLayout);
 	renderer->managePipeline.manage_pipeline(transparentPipeline, TrackShader::Yes, &sharedLayout);
 
+	if (engine->meshShaderSupported) {
+		build_mesh_shader_pipeline(engine, renderer, layouts);
+	}
+
 	engine->mainDeletionQueue.push_descriptor_set_layout(materialLayout);
 }
 
+void GLTFMetallic_Roughness::build_mesh_shader_pipeline(VulkanEngine* engine, Renderer* renderer, VkDescriptorSetLayout layouts[2]) {
+
+	opaqueMeshShaderPipeline.type = PipelineType::Graphics;
+	opaqueMeshShaderPipeline.pipelineLayout.isOwned = LayoutOwnership::False;
+
+	opaqueMeshShaderPipeline.shader.taskShader.file = "C:/Users/Alberto/source/repos/GROTESK/GROTESK/res/shaders/meshlet.task";
+	opaqueMeshShaderPipeline.shader.meshShader.file = "C:/Users/Alberto/source/repos/GROTESK/GROTESK/res/shaders/meshlet.mesh";
+	opaqueMeshShaderPipeline.shader.fragmentShader.file = "C:/Users/Alberto/source/repos/GROTESK/GROTESK/res/shaders/mesh.frag";
+
+	opaqueMeshShaderPipeline.shader.taskShader.stage = VK_SHADER_STAGE_TASK_BIT_EXT;
+	opaqueMeshShaderPipeline.shader.meshShader.stage = VK_SHADER_STAGE_MESH_BIT_EXT;
+	opaqueMeshShaderPipeline.shader.fragmentShader.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	opaqueMeshShaderPipeline.shader.taskShader.lastModified = shaderUtil::getFileTimeStamp(opaqueMeshShaderPipeline.shader.taskShader.file);
+	opaqueMeshShaderPipeline.shader.meshShader.lastModified = shaderUtil::getFileTimeStamp(opaqueMeshShaderPipeline.shader.meshShader.file);
+	opaqueMeshShaderPipeline.shader.fragmentShader.lastModified = shaderUtil::getFileTimeStamp(opaqueMeshShaderPipeline.shader.fragmentShader.file);
+
+	VkShaderModule taskShader = shaderUtil::compileToSPV(engine->device, opaqueMeshShaderPipeline.shader.taskShader.file, EShLangTask);
+	VkShaderModule meshShader = shaderUtil::compileToSPV(engine->device, opaqueMeshShaderPipeline.shader.meshShader.file, EShLangMesh);
+	VkShaderModule fragShader = shaderUtil::compileToSPV(engine->device, opaqueMeshShaderPipeline.shader.fragmentShader.file, EShLangFragment);
+
+	// same sets as the vertex pipelines, the push constants are the task shader's and reach the mesh shader too
+	auto* config = opaqueMeshShaderPipeline.getGraphicsConfig();
+
+	config->pushConstantRange.offset = 0;
+	config->pushConstantRange.size = sizeof(MeshTaskPushConstants);
+	config->pushConstantRange.stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+
+	config->layoutInfo = vkinit::pipeline_layout_create_info();
+	config->layoutInfo.setLayoutCount = 2;
+	config->layoutInfo.pSetLayouts = layouts;
+	config->layoutInfo.pPushConstantRanges = &config->pushConstantRange;
+	config->layoutInfo.pushConstantRangeCount = 1;
+
+	PipelineLayoutResource meshLayout;
+	meshLayout.isShared = SharedLayout::Yes;
+
+	VK_CHECK(vkCreatePipelineLayout(engine->device, &config->layoutInfo, engine->vkAllocator, &meshLayout.layout));
+
+	// the same fixed function state as the opaque pipeline, the vertex input and topology dont apply
+	PipelineBuilder builder;
+	builder.set_mesh_shaders(taskShader, meshShader, fragShader);
+	builder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	builder.set_polygon_mode(VK_POLYGON_MODE_FILL);
+	builder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+	builder.set_multisampling_none();
+	builder.disable_blending();
+	builder.enable_depthtest(true, VK_COMPARE_OP_GREATER_OR_EQUAL);
+	builder.set_renderpass(renderer->drawImageRenderPass);
+	builder.set_color_attachment_format(engine->drawImage.imageFormat);
+	builder.set_depth_format(engine->depthImage.imageFormat);
+	builder.res->pipelineLayout.layout = meshLayout.layout;
+
+	opaqueMeshShaderPipeline.pipeline = builder.build_pipeline(engine->device, renderer->renderMode, &opaqueMeshShaderPipeline);
+
+	vkDestroyShaderModule(engine->device, taskShader, nullptr);
+	vkDestroyShaderModule(engine->device, meshShader, nullptr);
+	vkDestroyShaderModule(engine->device, fragShader, nullptr);
+
+	renderer->managePipeline.manage_pipeline(opaqueMeshShaderPipeline, TrackShader::Yes, &meshLayout);
+}
+
 MaterialInstance GLTFMetallic_Roughness::write_material(VkDevice device, MaterialPass pass, const MaterialResources& resources, DescriptorAllocatorGrowable& descriptorAllocator) {
 
 	MaterialInstance matData;
@@ -1296,6 +3035,10 @@ MaterialInstance GLTFMetallic_Roughness::write_material(VkDevice device, Materia
 	}
 	else {
 		matData.pipeline = &opaquePipeline;
+		// null without mesh shader support, those materials only ever take the vertex pipeline
+		if (opaqueMeshShaderPipeline.type == PipelineType::Graphics) {
+			matData.meshShaderPipeline = &opaqueMeshShaderPipeline;
+		}
 	}
 	matData.materialSet = descriptorAllocator.allocate(device, materialLayout);
 
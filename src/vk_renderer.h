@@ -3,13 +3,34 @@
 #include "vk_descriptors.h"
 #include "vk_loader.h"
 #include "vk_util.h"
+#include "vk_rendergraph.h"
+#include "vk_recorder.h"
+#include "vk_drawlist.h"
+#include "vk_culling.h"
+#include "vk_occlusion.h"
 
 class Renderer;
 
+// which draws a geometry pass records, occlusion culling splits the scene into an early and a late pass
+enum class GeometryPass {
+	All,
+	Early,
+	Late
+};
+
+// which draws of a pass are recorded, the indirect ones take everything that changes per frame from buffers
+enum class GeometryDraws {
+	All,
+	Indirect,
+	Direct
+};
+
 struct GLTFMetallic_Roughness {
 
 	PipelineResource opaquePipeline;
 	PipelineResource transparentPipeline;
+	// opaque surfaces drawn meshlet by meshlet through the task and mesh shaders, only built with VK_EXT_mesh_shader
+	PipelineResource opaqueMeshShaderPipeline;
 
 	VkDescriptorSetLayout materialLayout;
 
@@ -32,6 +53,7 @@ struct GLTFMetallic_Roughness {
 	DescriptorWriter writer;
 
 	void build_pipelines(VulkanEngine* engine, Renderer* renderer);
+	void build_mesh_shader_pipeline(VulkanEngine* engine, Renderer* renderer, VkDescriptorSetLayout layouts[2]);
 	void clear_resources(VkDevice device);
 
 	MaterialInstance write_material(VkDevice device, MaterialPass pass, const MaterialResources& resources, DescriptorAllocatorGrowable& descriptorAllocator);
@@ -49,6 +71,8 @@ public:
 	inline static PipelineID createPipelineID() { return nextPipelineID++; }
 
 	inline static auto& get_shaderMap() { return shaderMap; }
+	// bumped whenever a pipeline handle is created or replaced, recorded commands compare against it
+	inline uint64_t get_version() const { return version; }
 
 
 	void manage_pipeline(PipelineResource& res, TrackShader trackShader, PipelineLayoutResource* layout = nullptr);
@@ -69,6 +93,8 @@ public:
 	std::unordered_map<PipelineID, VkPipeline> pipelineLookup;
 	std::unordered_map<LayoutID, std::vector<VkPipeline>> sharedLayouts;
 
+	uint64_t version = 0;
+
 };
 
 
@@ -101,16 +127,119 @@ public:
 
 	// made it so polymorphism is still enabled for hotloading but specific pipelines can be made so there isnt heap overhead 
 	PipelineResource meshPipeline;
+	// samples the draw image into the swapchain image, the ui is drawn on top in the same pass
+	PipelineResource compositePipeline;
+	// bounding boxes drawn against the depth for occlusion queries, no color and no depth writes
+	PipelineResource occlusionProxyPipeline;
+	// opaque draws into the depth with only their position stream, no color
+	PipelineResource depthPrepassPipeline;
 
 
 	PipelineManager managePipeline;
+	RenderGraph renderGraph;
 	LayoutID gradientPipelineLayoutID;
 	PipelineID gradientPipelineID;
 	PipelineID skyPipelineID;
+	LayoutID cullPipelineLayoutID;
+	PipelineID cullPipelineID;
+	LayoutID depthReducePipelineLayoutID;
+	PipelineID depthReducePipelineID;
+	// decodes compressed meshes into their buffers at upload, used through VulkanEngine::uploadMeshCompressed
+	LayoutID meshDecodePipelineLayoutID;
+	PipelineID meshDecodePipelineID;
 
 	MaterialInstance defaultData;
+	MaterialInstance defaultTransparentData;
+	// the test mesh pipeline with the checkerboard texture
+	MaterialInstance testMaterial;
 	GLTFMetallic_Roughness metalRoughMaterial;
 
+	// classic uses the render passes and framebuffers, dynamic uses vkCmdBeginRendering and has no framebuffers at all
+	RenderMode renderMode = RenderMode::Classic;
+	// set from the ui, applied between frames since every graphics pipeline and the imgui backend get rebuilt
+	RenderMode requestedRenderMode = RenderMode::Classic;
+
+	// render on demand, the scene is only redrawn when something marked it dirty,
+	// otherwise the retained drawImage is composited again with the ui on top
+	bool renderOnDemand = false;
+	uint64_t sceneRedraws = 0;
+	uint64_t sceneSkips = 0;
+
+	// records the indirect draws once into a secondary per frame slot and replays them until the batches,
+	// a pipeline, the frame buffers or the render targets change. needs the gpu driven draws
+	bool cacheGeometryCommands = false;
+	uint64_t geometryRecords = 0;
+	uint64_t geometryReuses = 0;
+
+	// the test meshes repeated on a grid x grid layout, every fourth one transparent
+	int objectGridSize = 1;
+
+	// opaque draws are frustum culled by a compute pass and drawn with one indirect count call per batch
+	bool gpuDrivenDraws = false;
+	// two phase hi-z culling on top of the gpu driven draws. the early pass draws what passes against the pyramid
+	// of the last frame, the late pass re-tests everything else against a pyramid of the early depth
+	bool occlusionCulling = false;
+	// surfaces are split into meshlets that get frustum, normal cone and (late phase) hi-z tested one by one,
+	// every meshlet that survives is its own indirect command
+	bool meshletCulling = false;
+	// with VK_EXT_mesh_shader the culled meshlets of opaque draws go through task and mesh shaders instead, the
+	// task shader tests them and the mesh shader reads them straight from the meshlet and index buffers
+	bool meshShading = false;
+
+	// the opaque draws of the first geometry pass are drawn into the depth first from the position streams,
+	// the shaded pass then only runs the fragment shader for the surfaces that end up visible
+	bool depthPrepass = false;
+
+	// each surface is drawn with the coarsest level whose error projects to at most lodPixelError pixels,
+	// the bias scales that threshold by 2^lodBias
+	bool meshLods = false;
+	float lodPixelError = 1.f;
+	float lodBias = 0.f;
+
+	// draws outside the frustum are dropped on the cpu before recording, for when there is no indirect count
+	bool cpuCulling = false;
+	culling::Path cullPath = culling::best_path();
+	std::vector<culling::BenchmarkResult> cullBenchmark;
+
+	// opaque occluder meshes are rasterized into a small cpu depth buffer on a worker thread while the frame
+	// records, draws recorded on the cpu are tested against it. the height follows the aspect of the draw extent
+	bool softwareOcclusion = false;
+	int occlusionResolution = 256;
+	bool showOcclusionDebug = false;
+
+	// opaque draws of at least this many indices get a proxy box drawn inside an occlusion query after the
+	// other opaque draws, and are then drawn under conditional rendering so the gpu drops them if no sample passed
+	bool occlusionQueries = false;
+	int occlusionQueryMinIndices = 1000;
+
+	struct OcclusionQueryStats {
+		uint32_t queried = 0;
+		uint32_t skipped = 0;
+	};
+
+	// commands that went through a CommandRecorder last frame and how many of them were dropped as redundant
+	CommandRecorder::Stats lastRecordStats;
+
+	inline void mark_dirty(uint32_t flags) { dirtyFlags |= flags; }
+	// imgui needs a few frames after an input to settle hover and active states
+	inline void mark_ui_active() { uiFramesPending = FRAME_OVERLAP; }
+	inline size_t get_draw_count() const { return drawList.objects.size(); }
+	inline size_t get_indirect_batch_count() const { return indirectBatches.size(); }
+	inline uint32_t get_indirect_command_count() const { return indirectCommandCount; }
+	// triangles of the draw list as picked and as they would be at full detail
+	inline uint64_t get_lod_triangles() const { return lodTriangles; }
+	inline uint64_t get_full_triangles() const { return fullTriangles; }
+	inline VkExtent2D get_depth_pyramid_extent() const { return depthPyramidExtent; }
+	inline uint32_t get_depth_pyramid_levels() const { return depthPyramidLevels; }
+	inline size_t get_visible_draw_count() const { return cpuCulling ? visibleDraws.size() : drawList.order.size(); }
+	inline const SoftwareOcclusion::Stats& get_occlusion_stats() const { return occlusionStats; }
+	// read back a few frames late from the result buffer of the frame slot, never waited on
+	inline const OcclusionQueryStats& get_occlusion_query_stats() const { return queryStats; }
+	inline VkExtent2D get_occlusion_extent() const { return { occlusionRasterizer.get_width(), occlusionRasterizer.get_height() }; }
+	// the debug image is allocated at the largest resolution, only the top left of it is written
+	VkDescriptorSet get_occlusion_debug_texture() const;
+	inline bool is_idle() const { return renderOnDemand && dirtyFlags == DIRTY_NONE && uiFramesPending == 0; }
+
 
 	// engine functions
 	void init_renderer();
@@ -119,16 +248,22 @@ public:
 
 	void init_framebuffers();
 	void init_descriptors();
+	// recreates the swapchain framebuffers and, if the render targets grew, everything pointing at them
+	void resize_framebuffers(bool drawTargetsChanged);
 	
 	VkPipeline rebuild(VkDevice device, PipelineResource& res);
 
 	void HotloadShader();
 
+	void set_render_mode(RenderMode mode);
+
 private:
 	VulkanEngine& engine;
 
 	// Render-related resources
 	VkRenderPass swapchainRenderPass = VK_NULL_HANDLE;
+	// same attachments as drawImageRenderPass but the depth is loaded, for the late occlusion pass
+	VkRenderPass drawImageLoadRenderPass = VK_NULL_HANDLE;
 	std::vector<VkFramebuffer> swapchainFrameBuffers = {};
 	VkFramebuffer drawImageFrameBuffer = VK_NULL_HANDLE;
 	VkExtent2D drawExtent{};
@@ -138,30 +273,132 @@ private:
 	
 	VkDescriptorSetLayout singleImageDescriptorLayout;
 
+	// draw image bound as a sampled texture for the composite pass
+	VkDescriptorSet compositeDescriptors = VK_NULL_HANDLE;
+	VkSampler compositeSampler = VK_NULL_HANDLE;
+
 	GPUSceneData sceneData;
 
+	// bumped whenever the indirect batches change, or the meshes or materials they draw
+	uint64_t batchVersion = 0;
+	// bumped whenever the draw image framebuffer is created again
+	uint64_t framebufferVersion = 0;
+	// bumped whenever the draw list is rebuilt, the per frame draw and cull data are only rewritten after that
+	uint64_t drawListVersion = 0;
+	DrawList drawList;
+	CommandRecorder::Stats recordStats;
+
+	// draws sharing pipeline, material and index buffer, their commands are compacted into
+	// [commandOffset, commandOffset + maxDraws) of the indirect buffer
+	struct IndirectBatch {
+		uint32_t firstEntry;
+		uint32_t commandOffset;
+		uint32_t maxDraws;
+		uint32_t state;
+		VkBuffer indexBuffer;
+		// drawn with the task and mesh shaders of the material, one task command per draw
+		bool meshTasks;
+
+		// the first entry moves with the camera but always has the same state and index buffer
+		bool operator==(const IndirectBatch& other) const {
+			return commandOffset == other.commandOffset && maxDraws == other.maxDraws && state == other.state && indexBuffer == other.indexBuffer
+				&& meshTasks == other.meshTasks;
+		}
+	};
+	std::vector<IndirectBatch> indirectBatches;
+	// commands of one culling phase, the sum of maxDraws over the batches
+	uint32_t indirectCommandCount = 0;
+	uint64_t lodTriangles = 0;
+	uint64_t fullTriangles = 0;
+	// batch of every sorted entry, UINT32_MAX for the transparent ones that keep their back to front order
+	std::vector<uint32_t> drawBatches;
+
+	// min depth pyramid of the last scene draw, level 0 is the largest power of two inside the draw extent.
+	// stays in general, the levels are written as storage and sampled by the next level and the culling shader
+	AllocatedImage depthPyramid;
+	std::vector<VkImageView> depthPyramidMips;
+	std::vector<VkDescriptorSet> depthReduceDescriptors;
+	VkDescriptorSet cullDescriptors = VK_NULL_HANDLE;
+	VkDescriptorSetLayout depthReduceDescriptorLayout = VK_NULL_HANDLE;
+	VkDescriptorSetLayout cullDescriptorLayout = VK_NULL_HANDLE;
+	VkSampler depthPyramidSampler = VK_NULL_HANDLE;
+	ImageState depthPyramidState;
+	VkExtent2D depthPyramidExtent{};
+	uint32_t depthPyramidLevels = 0;
+	// the camera the pyramid was built with, the early phase projects into the pyramid with it
+	glm::mat4 depthPyramidViewProj{ 1.f };
+	bool depthPyramidValid = false;
+
+	// world space bounds in draw order and the draws that survived the cpu frustum test
+	CullBounds cullBounds;
+	std::vector<uint32_t> visibleDraws;
+	VkDescriptorSet meshImageDescriptors = VK_NULL_HANDLE;
+
+	// layouts and last access of the images the graph imports, carried from frame to frame
+	ImageState drawImageState;
+	ImageState depthImageState;
+
+	uint32_t dirtyFlags = DIRTY_ALL;
+	uint32_t uiFramesPending = 0;
+
 	DescriptorAllocatorGrowable globalDescriptorAllocator{};
+	// draw image, composite and depth pyramid sets, started over whenever the draw targets are recreated
+	DescriptorAllocatorGrowable drawTargetDescriptorAllocator{};
 	VkDescriptorPool imguiPool = VK_NULL_HANDLE;
 
 	std::vector<std::shared_ptr<MeshAsset>> testMeshes;
 
-	void init_draw_image_renderpass(VkCommandBuffer cmd);
+	// after the meshes so the worker is joined before the data it reads goes away
+	SoftwareOcclusion occlusionRasterizer;
+	// copied once the job is collected, the worker owns its own copy while it runs
+	SoftwareOcclusion::Stats occlusionStats;
+
+	// how the geometry of the current frame is split, set before its passes are added
+	bool hizActive = false;
+	bool queriesActive = false;
+	// query slot of every sorted entry or UINT32_MAX, and the entry of every slot. assigned by the early pass
+	std::vector<uint32_t> drawQueries;
+	std::vector<uint32_t> queriedDraws;
+	OcclusionQueryStats queryStats;
+
+	void init_draw_image_renderpass(VkCommandBuffer cmd, GeometryPass pass = GeometryPass::All);
 	void init_swapchain_renderpass(VkCommandBuffer cmd, uint32_t imageIndex);
 
 	void init_pipelines();
 
 	void init_backgound_pipelines();
 	void init_mesh_pipeline();
+	void init_composite_pipeline();
+	void init_cull_pipeline();
+	void init_depth_reduce_pipeline();
+	void init_mesh_decode_pipeline();
+	void init_occlusion_proxy_pipeline();
+	void init_depth_prepass_pipeline();
 	void init_default_data();
-	void render_pass_geometry(VkCommandBuffer cmd);
+	void update_scene();
+	void build_draw_list();
+	void write_draw_data(FrameData& frame);
+	void render_pass_geometry(VkCommandBuffer cmd, GeometryPass pass = GeometryPass::All, GeometryDraws draws = GeometryDraws::All);
+	void begin_geometry_commands(VkCommandBuffer cmd, VkCommandBufferUsageFlags flags);
+	VkCommandBuffer get_geometry_commands();
+	VkCommandBuffer get_direct_geometry_commands();
 	void init_imgui();
+	void init_imgui_backend();
 
 
 	void render_imgui(VkCommandBuffer cmd);
 
 	
-	void render_dynamic_imgui(VkCommandBuffer cmd, VkImageView targetImageView);
+	void render_composite(VkCommandBuffer cmd);
+	void render_dynamic_composite(VkCommandBuffer cmd, VkImageView targetImageView);
+	void render_dynamic_geometry(VkCommandBuffer cmd, GeometryPass pass = GeometryPass::All);
 	void render_background(VkCommandBuffer cmd);
+	void render_cull(VkCommandBuffer cmd, uint32_t phase);
+	void render_depth_pyramid(VkCommandBuffer cmd);
+	void render_occlusion_debug(VkCommandBuffer cmd, RGImage target);
+	bool occlusion_debug_shown() const;
+	void render_occlusion_query_results(VkCommandBuffer cmd);
+	void collect_occlusion_queries(FrameData& frame);
 
 
 
@@ -170,6 +407,10 @@ private:
 
 	void create_draw_image_framebuffer();
 	void create_swapchain_framebuffer();
+	void destroy_framebuffers();
+	void reset_draw_target_descriptors();
+	void write_draw_image_descriptors();
+	void create_depth_pyramid();
 
 	AllocatedImage create_image(VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped = false);
 	AllocatedImage create_image(void* data, VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped = false);
@@ -0,0 +1,325 @@
+#include "vk_rendergraph.h"
+#include "vk_initializers.h"
+#include "vk_util.h"
+#include <algorithm>
+
+// access bits that leave data behind which later accesses have to wait on
+static constexpr VkAccessFlags2 writeAccessMask =
+	VK_ACCESS_2_SHADER_WRITE_BIT |
+	VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+	VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_2_TRANSFER_WRITE_BIT |
+	VK_ACCESS_2_HOST_WRITE_BIT |
+	VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+// transient images and memory that went unused for this many frames are given back
+static constexpr uint64_t evictionFrames = 8;
+
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read(RGImage image, const ImageUsage& usage) {
+	graph.passes[pass].accesses.push_back({ image, usage, false, false });
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::write(RGImage image, const ImageUsage& usage) {
+	graph.passes[pass].accesses.push_back({ image, usage, true, false });
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::discard_write(RGImage image, const ImageUsage& usage) {
+	graph.passes[pass].accesses.push_back({ image, usage, true, true });
+	return *this;
+}
+
+void RenderGraph::init(VkDevice device, VmaAllocator allocator, const VkAllocationCallbacks* callbacks, std::function<void(std::function<void()>&&)>&& deferDeletion) {
+	this->device = device;
+	this->allocator = allocator;
+	this->callbacks = callbacks;
+	this->deferDeletion = std::move(deferDeletion);
+}
+
+void RenderGraph::destroy() {
+	// only called with the device idle
+	for (auto& cached : imageCache) {
+		vkDestroyImageView(device, cached.view, callbacks);
+		vkDestroyImage(device, cached.image, callbacks);
+	}
+	imageCache.clear();
+
+	for (auto& block : blocks) {
+		if (block.allocation != VK_NULL_HANDLE) {
+			vmaFreeMemory(allocator, block.allocation);
+		}
+	}
+	blocks.clear();
+}
+
+void RenderGraph::begin_frame() {
+	passes.clear();
+	images.clear();
+	executedPasses = 0;
+	frame++;
+
+	lastStats = stats;
+	stats = {};
+
+	evict_unused();
+}
+
+RGImage RenderGraph::import_image(const char* name, VkImage image, VkImageAspectFlags aspect, ImageState& state) {
+	Image img;
+	img.name = name;
+	img.image = image;
+	img.aspect = aspect;
+	img.state = state;
+	img.persistent = &state;
+	images.push_back(img);
+	return (RGImage)(images.size() - 1);
+}
+
+RGImage RenderGraph::create_transient(const char* name, const TransientImageDesc& desc) {
+	Image img;
+	img.name = name;
+	img.aspect = desc.aspect;
+	img.desc = desc;
+	images.push_back(img);
+	return (RGImage)(images.size() - 1);
+}
+
+RenderGraph::PassBuilder RenderGraph::add_pass(const char* name, std::function<void(VkCommandBuffer)>&& execute) {
+	passes.push_back({ name, std::move(execute), {} });
+	return PassBuilder{ *this, (uint32_t)(passes.size() - 1) };
+}
+
+void RenderGraph::execute(VkCommandBuffer cmd) {
+	uint32_t endPass = (uint32_t)passes.size();
+
+	allocate_transients(executedPasses, endPass);
+
+	std::vector<VkImageMemoryBarrier2> barriers;
+
+	for (uint32_t p = executedPasses; p < endPass; p++) {
+		Pass& pass = passes[p];
+		barriers.clear();
+
+		for (const Access& access : pass.accesses) {
+			Image& img = images[access.image];
+			ImageState& state = img.state;
+
+			if (img.block >= 0 && !img.touched) {
+				// first use of a transient this frame, whatever alias had the memory before has to be done with it
+				state = blocks[img.block].state;
+				state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			}
+			img.touched = true;
+
+			bool layoutChange = state.layout != access.usage.layout;
+			bool pendingWrites = (state.access & writeAccessMask) != 0;
+			// a write after reads only needs the execution dependency, a read after reads in the same layout needs nothing
+			bool writeAfterRead = access.write && state.stage != VK_PIPELINE_STAGE_2_NONE;
+
+			if (layoutChange || pendingWrites || writeAfterRead) {
+				VkImageMemoryBarrier2 barrier{ .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+				barrier.srcStageMask = state.stage;
+				barrier.srcAccessMask = state.access & writeAccessMask;
+				barrier.dstStageMask = access.usage.stage;
+				barrier.dstAccessMask = access.usage.access;
+				barrier.oldLayout = (layoutChange && access.discard) ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+				barrier.newLayout = access.usage.layout;
+				barrier.image = img.image;
+				barrier.subresourceRange = vkinit::image_subresource_range(img.aspect);
+				barriers.push_back(barrier);
+
+				state = access.usage;
+			}
+			else {
+				// every reader has to finish before the next writer
+				state.stage |= access.usage.stage;
+				state.access |= access.usage.access;
+			}
+
+			if (img.block >= 0) {
+				blocks[img.block].state = state;
+			}
+		}
+
+		if (!barriers.empty()) {
+			VkDependencyInfo depInfo{ .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+			depInfo.imageMemoryBarrierCount = (uint32_t)barriers.size();
+			depInfo.pImageMemoryBarriers = barriers.data();
+			vkCmdPipelineBarrier2(cmd, &depInfo);
+
+			stats.barriers += (uint32_t)barriers.size();
+			stats.barrierBatches++;
+		}
+
+		if (pass.execute) {
+			pass.execute(cmd);
+		}
+		stats.passes++;
+	}
+
+	executedPasses = endPass;
+
+	for (auto& img : images) {
+		if (img.persistent) {
+			*img.persistent = img.state;
+		}
+	}
+
+	stats.memoryBlocks = 0;
+	VkDeviceSize blockBytes = 0;
+	for (auto& block : blocks) {
+		if (block.frameUsed == frame) {
+			stats.memoryBlocks++;
+			blockBytes += block.size;
+		}
+	}
+	stats.aliasedBytes = stats.transientBytes > blockBytes ? stats.transientBytes - blockBytes : 0;
+}
+
+void RenderGraph::allocate_transients(uint32_t firstPass, uint32_t lastPass) {
+
+	struct Lifetime {
+		RGImage image;
+		uint32_t first;
+		uint32_t last;
+	};
+	std::vector<Lifetime> lifetimes;
+
+	for (uint32_t p = firstPass; p < lastPass; p++) {
+		for (const Access& access : passes[p].accesses) {
+			Image& img = images[access.image];
+			if (img.persistent) {
+				continue;
+			}
+			if (img.block >= 0) {
+				// placed by an earlier execute of this frame, its block stays taken until this use too
+				blocks[img.block].lastPass = std::max(blocks[img.block].lastPass, p);
+				continue;
+			}
+
+			auto it = std::find_if(lifetimes.begin(), lifetimes.end(), [&](const Lifetime& l) { return l.image == access.image; });
+			if (it == lifetimes.end()) {
+				lifetimes.push_back({ access.image, p, p });
+			}
+			else {
+				it->last = p;
+			}
+		}
+	}
+
+	// already in first use order, greedy placement then reuses a block as soon as its last user is done
+	for (const Lifetime& lifetime : lifetimes) {
+		Image& img = images[lifetime.image];
+
+		VkImageCreateInfo imageInfo = vkinit::image_create_info(img.desc.format, img.desc.usage, VkExtent3D{ img.desc.extent.width, img.desc.extent.height, 1 });
+
+		VkDeviceImageMemoryRequirements requirementsInfo{ .sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS };
+		requirementsInfo.pCreateInfo = &imageInfo;
+		VkMemoryRequirements2 requirements{ .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2 };
+		vkGetDeviceImageMemoryRequirements(device, &requirementsInfo, &requirements);
+
+		uint32_t blockIndex = find_block(requirements.memoryRequirements, lifetime.first);
+		MemoryBlock& block = blocks[blockIndex];
+		block.frameUsed = frame;
+		block.lastFrameUsed = frame;
+		block.lastPass = lifetime.last;
+
+		auto cached = std::find_if(imageCache.begin(), imageCache.end(), [&](const CachedImage& c) {
+			return c.block == blockIndex && c.desc == img.desc;
+		});
+
+		if (cached == imageCache.end()) {
+			CachedImage newImage;
+			newImage.desc = img.desc;
+			newImage.block = blockIndex;
+
+			VK_CHECK(vkCreateImage(device, &imageInfo, callbacks, &newImage.image));
+			VK_CHECK(vmaBindImageMemory(allocator, block.allocation, newImage.image));
+
+			VkImageViewCreateInfo viewInfo = vkinit::imageview_create_info(img.desc.format, newImage.image, img.desc.aspect);
+			VK_CHECK(vkCreateImageView(device, &viewInfo, callbacks, &newImage.view));
+
+			imageCache.push_back(newImage);
+			cached = imageCache.end() - 1;
+		}
+
+		cached->lastFrameUsed = frame;
+		img.image = cached->image;
+		img.view = cached->view;
+		img.block = (int32_t)blockIndex;
+
+		stats.transientImages++;
+		stats.transientBytes += requirements.memoryRequirements.size;
+	}
+}
+
+uint32_t RenderGraph::find_block(const VkMemoryRequirements& requirements, uint32_t firstUse) {
+	uint32_t freeSlot = UINT32_MAX;
+
+	for (uint32_t i = 0; i < blocks.size(); i++) {
+		MemoryBlock& block = blocks[i];
+		if (block.allocation == VK_NULL_HANDLE) {
+			freeSlot = i;
+			continue;
+		}
+
+		bool available = block.frameUsed != frame || block.lastPass < firstUse;
+		bool compatible = (block.memoryTypeBits & requirements.memoryTypeBits) != 0
+			&& block.size >= requirements.size
+			&& block.alignment % requirements.alignment == 0;
+
+		if (available && compatible) {
+			return i;
+		}
+	}
+
+	MemoryBlock block;
+	VmaAllocationCreateInfo allocInfo = {};
+	allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	allocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	VmaAllocationInfo info;
+	VK_CHECK(vmaAllocateMemory(allocator, &requirements, &allocInfo, &block.allocation, &info));
+
+	block.size = requirements.size;
+	block.alignment = requirements.alignment;
+	block.memoryTypeBits = 1u << info.memoryType;
+
+	if (freeSlot != UINT32_MAX) {
+		blocks[freeSlot] = block;
+		return freeSlot;
+	}
+
+	blocks.push_back(block);
+	return (uint32_t)(blocks.size() - 1);
+}
+
+void RenderGraph::evict_unused() {
+
+	// images first, an image is never used more recently than the block under it
+	for (auto it = imageCache.begin(); it != imageCache.end();) {
+		if (it->lastFrameUsed + evictionFrames < frame) {
+			deferDeletion([device = device, callbacks = callbacks, image = it->image, view = it->view]() {
+				vkDestroyImageView(device, view, callbacks);
+				vkDestroyImage(device, image, callbacks);
+			});
+			it = imageCache.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	for (auto& block : blocks) {
+		if (block.allocation != VK_NULL_HANDLE && block.lastFrameUsed + evictionFrames < frame) {
+			deferDeletion([allocator = allocator, allocation = block.allocation]() {
+				vmaFreeMemory(allocator, allocation);
+			});
+			// the slot is reused, cached images index blocks by position
+			block = MemoryBlock{};
+		}
+	}
+}
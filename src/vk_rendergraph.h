@@ -0,0 +1,159 @@
+#pragma once
+#include "vk_types.h"
+
+// how a pass touches an image, the graph derives the barriers from consecutive usages
+struct ImageUsage {
+	VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_NONE;
+	VkAccessFlags2 access = VK_ACCESS_2_NONE;
+	VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+namespace rgusage {
+	inline constexpr ImageUsage ComputeStorageWrite{ VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+	inline constexpr ImageUsage ColorAttachment{ VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	inline constexpr ImageUsage DepthAttachment{ VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL };
+	inline constexpr ImageUsage SampledFragment{ VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	inline constexpr ImageUsage SampledCompute{ VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	// sampled without leaving general, for images that are also written as storage between reads
+	inline constexpr ImageUsage SampledComputeGeneral{ VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_GENERAL };
+	inline constexpr ImageUsage BlitSource{ VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL };
+	inline constexpr ImageUsage BlitDestination{ VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL };
+	inline constexpr ImageUsage CopyDestination{ VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL };
+	// presentation happens outside of the command buffer, only the layout matters
+	inline constexpr ImageUsage Present{ VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR };
+};
+
+// last known state of an image, imported images keep it between frames so the first barrier of a frame is still minimal
+struct ImageState {
+	VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_NONE;
+	VkAccessFlags2 access = VK_ACCESS_2_NONE;
+	VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+struct TransientImageDesc {
+	VkFormat format;
+	VkExtent2D extent;
+	VkImageUsageFlags usage;
+	VkImageAspectFlags aspect;
+
+	bool operator==(const TransientImageDesc& other) const {
+		return format == other.format && extent.width == other.extent.width && extent.height == other.extent.height
+			&& usage == other.usage && aspect == other.aspect;
+	}
+};
+
+using RGImage = uint32_t;
+
+// passes are recorded in the order they are added, every pass lists the images it reads and writes and the graph
+// inserts one batched barrier in front of each pass that needs it. transient images only live inside the graph
+// and share memory with other transients whose lifetimes dont overlap
+class RenderGraph {
+public:
+
+	struct PassBuilder {
+		PassBuilder& read(RGImage image, const ImageUsage& usage);
+		PassBuilder& write(RGImage image, const ImageUsage& usage);
+		// the old contents are not needed, the transition starts from undefined
+		PassBuilder& discard_write(RGImage image, const ImageUsage& usage);
+
+		RenderGraph& graph;
+		uint32_t pass;
+	};
+
+	struct Stats {
+		uint32_t passes = 0;
+		uint32_t barriers = 0;
+		uint32_t barrierBatches = 0;
+		uint32_t transientImages = 0;
+		uint32_t memoryBlocks = 0;
+		VkDeviceSize transientBytes = 0;
+		VkDeviceSize aliasedBytes = 0;
+	};
+
+	// deferDeletion is handed objects that the gpu might still be using
+	void init(VkDevice device, VmaAllocator allocator, const VkAllocationCallbacks* callbacks, std::function<void(std::function<void()>&&)>&& deferDeletion);
+	void destroy();
+
+	void begin_frame();
+
+	RGImage import_image(const char* name, VkImage image, VkImageAspectFlags aspect, ImageState& state);
+	RGImage create_transient(const char* name, const TransientImageDesc& desc);
+	PassBuilder add_pass(const char* name, std::function<void(VkCommandBuffer)>&& execute);
+
+	// records every pass added since the last call, so a frame can be split across command buffers
+	void execute(VkCommandBuffer cmd);
+
+	VkImage get_image(RGImage image) const { return images[image].image; }
+	VkImageView get_view(RGImage image) const { return images[image].view; }
+
+	const Stats& get_stats() const { return lastStats; }
+
+private:
+	struct Access {
+		RGImage image;
+		ImageUsage usage;
+		bool write;
+		bool discard;
+	};
+
+	struct Pass {
+		const char* name;
+		std::function<void(VkCommandBuffer)> execute;
+		std::vector<Access> accesses;
+	};
+
+	struct Image {
+		const char* name;
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkImageAspectFlags aspect;
+		ImageState state;
+		// imported images write their state back here after execution
+		ImageState* persistent = nullptr;
+		// transient only
+		TransientImageDesc desc{};
+		int32_t block = -1;
+		bool touched = false;
+	};
+
+	// memory that transients get bound to, lives across frames so steady state frames allocate nothing
+	struct MemoryBlock {
+		VmaAllocation allocation = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		VkDeviceSize alignment = 0;
+		uint32_t memoryTypeBits = 0;
+		// last pass of this frame that used the block, and the access of the alias that used it last
+		uint64_t frameUsed = 0;
+		uint32_t lastPass = 0;
+		ImageState state;
+		uint64_t lastFrameUsed = 0;
+	};
+
+	struct CachedImage {
+		TransientImageDesc desc;
+		uint32_t block;
+		VkImage image;
+		VkImageView view;
+		uint64_t lastFrameUsed;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	VmaAllocator allocator = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* callbacks = nullptr;
+	std::function<void(std::function<void()>&&)> deferDeletion;
+
+	std::vector<Pass> passes;
+	std::vector<Image> images;
+	uint32_t executedPasses = 0;
+	uint64_t frame = 0;
+
+	std::vector<MemoryBlock> blocks;
+	std::vector<CachedImage> imageCache;
+
+	Stats stats;
+	Stats lastStats;
+
+	void allocate_transients(uint32_t firstPass, uint32_t lastPass);
+	uint32_t find_block(const VkMemoryRequirements& requirements, uint32_t firstUse);
+	void evict_unused();
+};
@@ -0,0 +1,265 @@
+#include "vk_simplify.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+
+// symmetric 4x4 matrix summing the squared distances to a set of planes
+struct Quadric {
+	double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+	double a11 = 0, a12 = 0, a13 = 0;
+	double a22 = 0, a23 = 0;
+	double a33 = 0;
+
+	void add_plane(double a, double b, double c, double d) {
+		a00 += a * a; a01 += a * b; a02 += a * c; a03 += a * d;
+		a11 += b * b; a12 += b * c; a13 += b * d;
+		a22 += c * c; a23 += c * d;
+		a33 += d * d;
+	}
+
+	void add(const Quadric& o) {
+		a00 += o.a00; a01 += o.a01; a02 += o.a02; a03 += o.a03;
+		a11 += o.a11; a12 += o.a12; a13 += o.a13;
+		a22 += o.a22; a23 += o.a23;
+		a33 += o.a33;
+	}
+
+	double error(const glm::vec3& p) const {
+		double x = p.x, y = p.y, z = p.z;
+		double e = a00 * x * x + a11 * y * y + a22 * z * z + a33
+			+ 2 * (a01 * x * y + a02 * x * z + a12 * y * z + a03 * x + a13 * y + a23 * z);
+		return std::max(e, 0.0);
+	}
+};
+
+struct Collapse {
+	uint32_t from;
+	uint32_t to;
+	double cost;
+};
+
+float simplify::edge_collapse(const std::vector<glm::vec3>& positions, const uint32_t* indices, uint32_t indexCount,
+	uint32_t targetIndexCount, float maxError, std::vector<uint32_t>& destination, bool lockBorders) {
+
+	std::vector<uint32_t> triangles(indices, indices + indexCount / 3 * 3);
+	if (triangles.empty()) {
+		return 0.f;
+	}
+
+	// the tables are indexed relative to the vertex range the surface uses
+	uint32_t minVertex = *std::min_element(triangles.begin(), triangles.end());
+	uint32_t maxVertex = *std::max_element(triangles.begin(), triangles.end());
+	uint32_t vertexRange = maxVertex - minVertex + 1;
+	for (uint32_t& index : triangles) {
+		index -= minVertex;
+	}
+	auto position = [&](uint32_t v) -> const glm::vec3& { return positions[v + minVertex]; };
+
+	// every triangle contributes its plane to its corners, the error is the sum of squared distances to them
+	std::vector<Quadric> quadrics(vertexRange);
+	for (size_t t = 0; t < triangles.size(); t += 3) {
+		glm::vec3 a = position(triangles[t]);
+		glm::vec3 normal = glm::cross(position(triangles[t + 1]) - a, position(triangles[t + 2]) - a);
+		float length = glm::length(normal);
+		if (length <= 0.f) {
+			continue;
+		}
+		normal /= length;
+
+		Quadric plane;
+		plane.add_plane(normal.x, normal.y, normal.z, -glm::dot(normal, a));
+		for (int k = 0; k < 3; k++) {
+			quadrics[triangles[t + k]].add(plane);
+		}
+	}
+
+	// edges used by anything but two triangles are borders or worse, their vertices never move
+	std::vector<bool> locked(vertexRange, false);
+	std::vector<uint64_t> borders;
+	{
+		std::vector<uint64_t> edges;
+		edges.reserve(triangles.size());
+		for (size_t t = 0; t < triangles.size(); t += 3) {
+			for (int k = 0; k < 3; k++) {
+				uint32_t a = triangles[t + k];
+				uint32_t b = triangles[t + (k + 1) % 3];
+				edges.push_back(((uint64_t)std::min(a, b) << 32) | std::max(a, b));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+
+		for (size_t i = 0; i < edges.size();) {
+			size_t j = i;
+			while (j < edges.size() && edges[j] == edges[i]) {
+				j++;
+			}
+			if (j - i != 2 && lockBorders) {
+				locked[edges[i] >> 32] = true;
+				locked[edges[i] & 0xFFFFFFFF] = true;
+			}
+			if (j - i == 1 && !lockBorders) {
+				borders.push_back(edges[i]);
+			}
+			i = j;
+		}
+	}
+
+	// free borders get a plane through the edge standing on its triangle, pulling a border vertex inwards then
+	// costs the distance it moves the outline instead of nothing
+	for (size_t t = 0; !borders.empty() && t < triangles.size(); t += 3) {
+		glm::vec3 corners[3] = { position(triangles[t]), position(triangles[t + 1]), position(triangles[t + 2]) };
+		glm::vec3 normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+		for (int k = 0; k < 3; k++) {
+			uint32_t a = triangles[t + k];
+			uint32_t b = triangles[t + (k + 1) % 3];
+			if (!std::binary_search(borders.begin(), borders.end(), ((uint64_t)std::min(a, b) << 32) | std::max(a, b))) {
+				continue;
+			}
+
+			glm::vec3 side = glm::cross(corners[(k + 1) % 3] - corners[k], normal);
+			float length = glm::length(side);
+			if (length <= 0.f) {
+				continue;
+			}
+			side /= length;
+
+			Quadric plane;
+			plane.add_plane(side.x, side.y, side.z, -glm::dot(side, corners[k]));
+			quadrics[a].add(plane);
+			quadrics[b].add(plane);
+		}
+	}
+
+	double maxCost = (double)maxError * maxError;
+	double reachedCost = 0.0;
+
+	std::vector<uint32_t> adjacencyOffsets(vertexRange + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<uint32_t> remap(vertexRange);
+	std::vector<bool> touched(vertexRange);
+	std::vector<Collapse> collapses;
+
+	// a pass collapses the cheapest edges that dont share a neighbourhood, then the triangles are rebuilt
+	while (triangles.size() > targetIndexCount) {
+
+		// triangles around every vertex
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (uint32_t v : triangles) {
+			adjacencyOffsets[v + 1]++;
+		}
+		for (uint32_t v = 0; v < vertexRange; v++) {
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		adjacency.resize(triangles.size());
+		{
+			std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (uint32_t i = 0; i < triangles.size(); i++) {
+				adjacency[fill[triangles[i]]++] = i / 3;
+			}
+		}
+
+		// every edge once, in the cheaper direction a locked vertex allows
+		collapses.clear();
+		for (size_t t = 0; t < triangles.size(); t += 3) {
+			for (int k = 0; k < 3; k++) {
+				uint32_t a = triangles[t + k];
+				uint32_t b = triangles[t + (k + 1) % 3];
+				if (a == b || (a > b && lockBorders)) {
+					// the other triangle on the edge has it the other way around, unless it is a border
+					// which is locked anyway. unlocked borders take both, the duplicates are never both applied
+					continue;
+				}
+
+				Quadric q = quadrics[a];
+				q.add(quadrics[b]);
+
+				double costAB = locked[a] ? DBL_MAX : q.error(position(b));
+				double costBA = locked[b] ? DBL_MAX : q.error(position(a));
+				if (costAB == DBL_MAX && costBA == DBL_MAX) {
+					continue;
+				}
+				collapses.push_back(costAB <= costBA ? Collapse{ a, b, costAB } : Collapse{ b, a, costBA });
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& l, const Collapse& r) { return l.cost < r.cost; });
+
+		for (uint32_t v = 0; v < vertexRange; v++) {
+			remap[v] = v;
+		}
+		std::fill(touched.begin(), touched.end(), false);
+
+		size_t removeGoal = (triangles.size() - targetIndexCount) / 3;
+		size_t removed = 0;
+		uint32_t collapsed = 0;
+
+		for (const Collapse& collapse : collapses) {
+			if (removed >= removeGoal || collapse.cost > maxCost) {
+				break;
+			}
+			if (touched[collapse.from] || touched[collapse.to]) {
+				continue;
+			}
+
+			// moving the vertex must not turn any of its remaining triangles over, or close to it
+			const glm::vec3& target = position(collapse.to);
+			bool flips = false;
+			size_t dropped = 0;
+			for (uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1] && !flips; a++) {
+				const uint32_t* tri = &triangles[adjacency[a] * 3];
+				if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) {
+					dropped++;
+					continue;
+				}
+
+				glm::vec3 p[3], q[3];
+				for (int k = 0; k < 3; k++) {
+					p[k] = position(tri[k]);
+					q[k] = tri[k] == collapse.from ? target : p[k];
+				}
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				flips = glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after);
+			}
+			if (flips) {
+				continue;
+			}
+
+			// everything around the removed vertex changes shape, its neighbours wait for the next pass
+			for (uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++) {
+				const uint32_t* tri = &triangles[adjacency[a] * 3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+			}
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			reachedCost = std::max(reachedCost, collapse.cost);
+			removed += dropped;
+			collapsed++;
+		}
+
+		if (collapsed == 0) {
+			break;
+		}
+
+		size_t write = 0;
+		for (size_t t = 0; t < triangles.size(); t += 3) {
+			uint32_t a = remap[triangles[t]];
+			uint32_t b = remap[triangles[t + 1]];
+			uint32_t c = remap[triangles[t + 2]];
+			if (a == b || b == c || a == c) {
+				continue;
+			}
+			triangles[write++] = a;
+			triangles[write++] = b;
+			triangles[write++] = c;
+		}
+		triangles.resize(write);
+	}
+
+	for (uint32_t v : triangles) {
+		destination.push_back(v + minVertex);
+	}
+
+	return (float)std::sqrt(reachedCost);
+}
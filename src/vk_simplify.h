@@ -0,0 +1,16 @@
+#pragma once
+#include "vk_types.h"
+
+// mesh simplification by edge collapse with a quadric error metric. vertices only ever collapse onto other
+// existing vertices, so a simplified level is just another index range over the same vertex buffer
+namespace simplify {
+
+	// appends at most targetIndexCount indices for the triangles in indices, or as close as it gets without
+	// moving a vertex further than maxError. vertices on open or non manifold edges stay where they are, that
+	// keeps the outline and the uv and normal seams of unwelded meshes closed.
+	// indices may point into destination, they are copied before anything is appended.
+	// without lockBorders those vertices collapse like any other, for when a level is needed more than closed seams.
+	// returns the error reached, an object space distance
+	float edge_collapse(const std::vector<glm::vec3>& positions, const uint32_t* indices, uint32_t indexCount,
+		uint32_t targetIndexCount, float maxError, std::vector<uint32_t>& destination, bool lockBorders = true);
+}
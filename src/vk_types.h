@@ -16,6 +16,7 @@
 #include <vma/vk_mem_alloc.h>
 #include <glm/mat4x4.hpp>
 #include <glm/vec4.hpp>
+#include <glm/vec2.hpp>
 #include <set>
 
 struct ComputePushConstants {
@@ -56,17 +57,160 @@ struct Vertex {
 	glm::vec4 color;
 };
 
+// 16 bytes against the 48 of Vertex. position as unorm16 inside the mesh bounds, normal octahedral as snorm8,
+// uvs as half floats and color as unorm8
+struct CompactVertex {
+	uint16_t position[3];
+	uint16_t normal;
+	uint32_t uv;
+	uint32_t color;
+};
+
+enum class VertexFormat : uint32_t {
+	Full,
+	Compact
+};
+
 struct GPUMeshBuffers {
 
 	AllocatedBuffer indexBuffer;
 	AllocatedBuffer vertexBuffer;
 	VkDeviceAddress vertexBufferAddress;
+	// the mesh shaders read the indices of a meshlet through this
+	VkDeviceAddress indexBufferAddress = 0;
+	// GPUMeshlet records of every surface, empty for meshes uploaded without them
+	AllocatedBuffer meshletBuffer{};
+	VkDeviceAddress meshletBufferAddress = 0;
+	// just the positions for the depth only passes, float xyz or the first 8 bytes of CompactVertex. 0 when not uploaded
+	AllocatedBuffer positionBuffer{};
+	VkDeviceAddress positionBufferAddress = 0;
+	// 16 bit indices are relative to the vertexOffset of their surface
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+	VertexFormat vertexFormat = VertexFormat::Full;
+	// compact positions decode to offset + unorm * scale
+	glm::vec4 positionOffset{ 0.f };
+	glm::vec4 positionScale{ 1.f };
 };
 
 
-struct GPUDrawPushConstants {
+// object space bounds, a box for exact tests and a sphere around it for quick ones
+struct Bounds {
+	glm::vec3 origin;
+	float sphereRadius;
+	glm::vec3 extents;
+};
+
+// per draw data, shaders index it with gl_InstanceIndex which is set to the draw index through firstInstance
+struct GPUDrawData {
 	glm::mat4 worldMatrix;
 	VkDeviceAddress vertexBuffer;
+	uint32_t materialIndex;
+	uint32_t vertexFormat;
+	VkDeviceAddress positionBuffer;
+	uint32_t pad[2];
+	glm::vec4 positionOffset;
+	glm::vec4 positionScale;
+};
+
+struct GPUDrawPushConstants {
+	VkDeviceAddress drawDataBuffer;
+};
+
+// what the culling shader needs per draw, batch is UINT32_MAX for draws that are recorded on the cpu
+struct GPUCullData {
+	glm::vec4 sphere;
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	uint32_t batch;
+	uint32_t commandOffset;
+	// the meshlets of the surface, a count of 0 draws it whole
+	VkDeviceAddress meshlets;
+	uint32_t meshletCount;
+	int32_t vertexOffset;
+	// 1 when the meshlets go through the task and mesh shaders, the draw then gets one task command
+	uint32_t meshTasks;
+	uint32_t pad[3];
+};
+
+// object space sphere, the normal cone as (axis, cutoff) and the index range the meshlet was reordered into.
+// a cutoff of 1 never culls, for meshlets whose triangles face too many ways
+struct GPUMeshlet {
+	glm::vec4 sphere;
+	glm::vec4 cone;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t vertexCount;
+	uint32_t pad;
+};
+
+// everything the culling shader needs that isnt per draw, kept out of the push constants to stay under 128 bytes
+struct GPUCullParams {
+	glm::mat4 viewproj;
+	// camera of the depth pyramid the early phase tests against
+	glm::mat4 occlusionViewProj;
+	glm::vec2 pyramidSize;
+	uint32_t pyramidLevels;
+	uint32_t drawCount;
+	uint32_t occlusion;
+	uint32_t phaseStride;
+	// commands of the late phase start this many in, meshlets can need more commands than there are draws
+	uint32_t commandStride;
+	uint32_t pad;
+	// world space, for the normal cones of the meshlets
+	glm::vec4 cameraPosition;
+};
+
+struct CullPushConstants {
+	VkDeviceAddress drawDataBuffer;
+	VkDeviceAddress cullDataBuffer;
+	VkDeviceAddress commandBuffer;
+	VkDeviceAddress countBuffer;
+	VkDeviceAddress visibilityBuffer;
+	VkDeviceAddress paramsBuffer;
+	uint32_t phase;
+	uint32_t pad;
+};
+
+// the task shader finds its draw through the command it was launched with, commandOffset is where the batch starts
+struct MeshTaskPushConstants {
+	VkDeviceAddress drawDataBuffer;
+	VkDeviceAddress cullDataBuffer;
+	VkDeviceAddress commandBuffer;
+	VkDeviceAddress paramsBuffer;
+	VkDeviceAddress indexBuffer;
+	uint32_t commandOffset;
+	uint32_t shortIndices;
+};
+
+struct MeshDecodePushConstants {
+	VkDeviceAddress indexBlocks;
+	VkDeviceAddress indexData;
+	VkDeviceAddress vertexBlocks;
+	VkDeviceAddress vertexData;
+	VkDeviceAddress indexBuffer;
+	VkDeviceAddress vertexBuffer;
+	VkDeviceAddress positionBuffer;
+	uint32_t indexCount;
+	uint32_t indexBlockCount;
+	uint32_t vertexCount;
+	uint32_t vertexBlockCount;
+	uint32_t shortIndices;
+	uint32_t vertexChannels;
+	uint32_t positionWords;
+	uint32_t pad;
+};
+
+struct DepthReducePushConstants {
+	glm::ivec2 sourceSize;
+	glm::ivec2 destinationSize;
+};
+
+struct CompositePushConstants {
+	glm::vec2 uvScale;
+};
+
+struct OcclusionProxyPushConstants {
+	glm::mat4 boxMatrix;
 };
 
 
@@ -125,6 +269,9 @@ struct Shader {
 	ShaderInfo geometryShader;
 	ShaderInfo fragmentShader;
 	ShaderInfo computeShader;
+	// mesh shading pipelines have these instead of a vertex shader
+	ShaderInfo taskShader;
+	ShaderInfo meshShader;
 };
 
 struct BaseGraphicsPipelineConfig {
@@ -154,6 +301,17 @@ struct BaseGraphicsPipelineConfig {
 	RenderMode renderMode;
 };
 
+// reasons the scene has to be redrawn when rendering on demand
+enum DirtyFlags : uint32_t {
+	DIRTY_NONE = 0,
+	DIRTY_CAMERA = 1 << 0,
+	DIRTY_SCENE = 1 << 1,
+	DIRTY_BACKGROUND = 1 << 2,
+	DIRTY_PIPELINES = 1 << 3,
+	DIRTY_RESIZE = 1 << 4,
+	DIRTY_ALL = 0xFFFFFFFF
+};
+
 enum PipelineType {
 	Uninitialized,
 	Graphics,
@@ -187,6 +345,8 @@ struct MaterialInstance {
 	PipelineResource* pipeline;
 	VkDescriptorSet materialSet;
 	MaterialPass passType;
+	// the same material drawn meshlet by meshlet through task and mesh shaders, null if it has no such pipeline
+	PipelineResource* meshShaderPipeline = nullptr;
 };
 
 enum struct TrackShader {
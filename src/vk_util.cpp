@@ -1,4 +1,5 @@
 #include "vk_util.h"
+#include <algorithm>
 
 std::string readFile(const std::string& filepath) {
 	std::ifstream file(filepath, std::ios::in | std::ios::binary);
@@ -193,6 +194,13 @@ VkShaderModule shaderUtil::compileToSPV(VkDevice device, const std::string& shad
 
 	glslang::TShader shader(stage);
 	shader.setStrings(&sourcePtr, 1);
+
+	// GL_EXT_mesh_shader only exists for vulkan 1.2+ and spir-v 1.4+, the other stages keep the defaults
+	if (stage == EShLangTask || stage == EShLangMesh) {
+		shader.setEnvInput(glslang::EShSourceGlsl, stage, glslang::EShClientVulkan, 100);
+		shader.setEnvClient(glslang::EShClientVulkan, glslang::EShTargetVulkan_1_3);
+		shader.setEnvTarget(glslang::EShTargetSpv, glslang::EShTargetSpv_1_6);
+	}
 	
 
 	RuntimeIncluder includer;
@@ -240,6 +248,9 @@ void DeletionQueue::flush_deletion_lambda() {
 }
 
 void DeletionQueue::flushFrameResources(VmaAllocator& vmaAllocator) {
+	// retired swapchain and render target objects
+	flush_deletion_lambda();
+
 	for (auto& b : vmaAllocatedBuffer) {
 		if (b.buffer != VK_NULL_HANDLE && b.allocation != VK_NULL_HANDLE) {
 			vmaDestroyBuffer(vmaAllocator, b.buffer, b.allocation);
@@ -252,6 +263,8 @@ void DeletionQueue::flushFrameResources(VmaAllocator& vmaAllocator) {
 
 void DeletionQueue::flushMainResources(VkDevice device, VmaAllocator& vmaAllocator) {
 
+	flush_deletion_lambda();
+
 
 	for (auto& s : samplers) {
 		vkDestroySampler(device, s, nullptr);
@@ -312,23 +325,50 @@ void DeletionQueue::flushMainResources(VkDevice device, VmaAllocator& vmaAllocat
 
 }
 
-void DeletionQueue::resizeFlush(VkDevice device, VmaAllocator& vmaAllocator) {
+void DeletionQueue::release_offscreen_image(const AllocatedImage& image) {
+	offscreenImages.erase(std::remove_if(offscreenImages.begin(), offscreenImages.end(),
+		[&](const AllocatedImage& img) { return img.image == image.image; }), offscreenImages.end());
+}
+void DeletionQueue::release_framebuffer(VkFramebuffer fb) {
+	framebuffer.erase(std::remove(framebuffer.begin(), framebuffer.end(), fb), framebuffer.end());
+}
+
 
-	for (auto& offs : offscreenImages) {
-		if (offs.imageView != VK_NULL_HANDLE) {
-			vkDestroyImageView(device, offs.imageView, nullptr);
-			offs.imageView = VK_NULL_HANDLE;
-		}
-		if (offs.image != VK_NULL_HANDLE) {
-			vmaDestroyImage(vmaAllocator, offs.image, offs.allocation);
-			offs.image = VK_NULL_HANDLE;
-		}
+
+void LatencyStats::record_input(uint64_t timestampNS) {
+	// keep the oldest unconsumed input, thats the one the user has been waiting on the longest
+	if (pendingInputNS == 0 || timestampNS < pendingInputNS) {
+		pendingInputNS = timestampNS;
 	}
-	for (auto& fb : framebuffer) {
-		if (fb != VK_NULL_HANDLE) {
-			vkDestroyFramebuffer(device, fb, nullptr);
-			fb = VK_NULL_HANDLE;
-		}
+}
+
+void LatencyStats::record_present(uint64_t presentNS) {
+	if (pendingInputNS == 0 || presentNS < pendingInputNS) {
+		return;
 	}
+
+	lastMs = (presentNS - pendingInputNS) / 1000000.f;
+	pendingInputNS = 0;
+
+	samples++;
+	// exponential average, reacts within a few dozen frames when the present mode is switched
+	averageMs = samples == 1 ? lastMs : averageMs + (lastMs - averageMs) * 0.05f;
+
+	windowMaxMs = std::max(windowMaxMs, lastMs);
+	if (++windowSamples >= maxWindow) {
+		maxMs = windowMaxMs;
+		windowMaxMs = 0.f;
+		windowSamples = 0;
+	}
+	maxMs = std::max(maxMs, windowMaxMs);
 }
 
+void LatencyStats::reset() {
+	lastMs = 0.f;
+	averageMs = 0.f;
+	maxMs = 0.f;
+	samples = 0;
+	pendingInputNS = 0;
+	windowSamples = 0;
+	windowMaxMs = 0.f;
+}
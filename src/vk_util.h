@@ -67,7 +67,9 @@ public:
 
 	void flushMainResources(VkDevice device, VmaAllocator& vmaAllocator);
 
-	void resizeFlush(VkDevice device, VmaAllocator& vmaAllocator);
+	// takes a resource back out of the queue, used when it gets retired through a frame queue instead
+	void release_offscreen_image(const AllocatedImage& image);
+	void release_framebuffer(VkFramebuffer fb);
 
 	template <typename T>
 	inline void push_sampler(const T& s) {
@@ -129,11 +131,23 @@ public:
 		if constexpr (requires { mesh->meshBuffers; }) {
 			vmaAllocatedBuffer.push_back(mesh->meshBuffers.indexBuffer);
 			vmaAllocatedBuffer.push_back(mesh->meshBuffers.vertexBuffer);
+			if (mesh->meshBuffers.meshletBuffer.buffer != VK_NULL_HANDLE) {
+				vmaAllocatedBuffer.push_back(mesh->meshBuffers.meshletBuffer);
+			}
+			if (mesh->meshBuffers.positionBuffer.buffer != VK_NULL_HANDLE) {
+				vmaAllocatedBuffer.push_back(mesh->meshBuffers.positionBuffer);
+			}
 		}
 		// Otherwise, assume mesh is already a GPUMeshBuffers object
 		else {
 			vmaAllocatedBuffer.push_back(mesh.indexBuffer);
 			vmaAllocatedBuffer.push_back(mesh.vertexBuffer);
+			if (mesh.meshletBuffer.buffer != VK_NULL_HANDLE) {
+				vmaAllocatedBuffer.push_back(mesh.meshletBuffer);
+			}
+			if (mesh.positionBuffer.buffer != VK_NULL_HANDLE) {
+				vmaAllocatedBuffer.push_back(mesh.positionBuffer);
+			}
 		}
 	}
 
@@ -151,9 +165,70 @@ private:
 		std::vector<VkPipelineLayout> pipelineLayouts;
 };
 
+// everything a recorded geometry secondary depends on, any change means it has to be recorded again.
+// only versions, handles and addresses can come back for a different object once the old one is freed
+struct GeometryCacheKey {
+	uint64_t batchVersion = 0;
+	uint64_t pipelineVersion = 0;
+	uint64_t framebufferVersion = 0;
+	uint64_t bufferVersion = 0;
+	VkFormat drawFormat = VK_FORMAT_UNDEFINED;
+	VkExtent2D drawExtent{};
+	RenderMode renderMode = RenderMode::Classic;
+	bool depthPrepass = false;
+
+	bool operator==(const GeometryCacheKey& other) const {
+		return batchVersion == other.batchVersion && pipelineVersion == other.pipelineVersion
+			&& framebufferVersion == other.framebufferVersion && bufferVersion == other.bufferVersion
+			&& drawFormat == other.drawFormat && drawExtent.width == other.drawExtent.width && drawExtent.height == other.drawExtent.height
+			&& renderMode == other.renderMode && depthPrepass == other.depthPrepass;
+	}
+};
+
 struct FrameData {
 	VkCommandPool commandPool;
 	VkCommandBuffer mainCommandBuffer;
+	// only used in low latency mode, holds the swapchain work that is recorded after the late acquire
+	VkCommandBuffer presentCommandBuffer;
+	// the indirect draws of the draw image pass, kept between frames while its key stays the same. the draws
+	// recorded on the cpu change with the camera and go into the other secondary every frame
+	VkCommandBuffer geometryCommandBuffer;
+	VkCommandBuffer directCommandBuffer;
+	GeometryCacheKey geometryCacheKey;
+	// per frame values the cached commands read instead of having them baked in
+	AllocatedBuffer sceneDataBuffer;
+	VkDescriptorSet sceneDescriptor;
+	// GPUDrawData for every draw of the frame, grows with the draw list
+	AllocatedBuffer drawDataBuffer;
+	VkDeviceAddress drawDataAddress = 0;
+	size_t drawDataCapacity = 0;
+	// gpu driven drawing, same capacity as the draw data, commands and counts hold both culling phases.
+	// commands grow on their own since meshlets can make more of them than there are draws
+	AllocatedBuffer cullDataBuffer;
+	AllocatedBuffer indirectBuffer;
+	AllocatedBuffer countBuffer;
+	AllocatedBuffer visibilityBuffer;
+	VkDeviceAddress cullDataAddress = 0;
+	VkDeviceAddress indirectAddress = 0;
+	VkDeviceAddress countAddress = 0;
+	VkDeviceAddress visibilityAddress = 0;
+	size_t commandCapacity = 0;
+	// bumped whenever any of the buffers above is reallocated
+	uint64_t bufferVersion = 0;
+	// draw list version the draw and cull data were last written for, 0 when the buffers hold nothing yet
+	uint64_t drawDataVersion = 0;
+	uint64_t cullDataVersion = 0;
+	AllocatedBuffer cullParamsBuffer;
+	VkDeviceAddress cullParamsAddress = 0;
+	// the cpu occlusion depth converted to rgba for the debug view, copied into the debug image
+	AllocatedBuffer occlusionDebugBuffer;
+	// imgui texture of the debug image, the image is a graph transient so the set is pointed at it every frame
+	VkDescriptorSet occlusionDebugTexture = VK_NULL_HANDLE;
+	// one occlusion query per draw at most, the results are copied into the buffer the conditional draws read.
+	// same capacity as the draw data
+	VkQueryPool occlusionQueryPool = VK_NULL_HANDLE;
+	AllocatedBuffer queryResultBuffer;
+	uint32_t occlusionQueryCount = 0;
 	VkSemaphore swapchainSemaphore;
 	VkFence renderFence;
 	DeletionQueue deletionQueue;
@@ -161,3 +236,24 @@ struct FrameData {
 };
 constexpr unsigned int FRAME_OVERLAP = 3;
 
+// tracks the time between the oldest input event consumed by a frame and the present call of that frame
+// timestamps are in nanoseconds from SDL_GetTicksNS so the SDL event timestamps can be used directly
+struct LatencyStats {
+
+	void record_input(uint64_t timestampNS);
+	void record_present(uint64_t presentNS);
+	void reset();
+
+	float lastMs = 0.f;
+	float averageMs = 0.f;
+	float maxMs = 0.f;
+	uint64_t samples = 0;
+
+private:
+	uint64_t pendingInputNS = 0;
+	// max is kept over a window so a single hitch doesnt stick forever
+	static constexpr uint64_t maxWindow = 240;
+	uint64_t windowSamples = 0;
+	float windowMaxMs = 0.f;
+};
+